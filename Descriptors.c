@@ -59,9 +59,21 @@ const USB_Descriptor_Device_t PROGMEM DeviceDescriptor =
 	.Header                 = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
 
 	.USBSpecification       = VERSION_BCD(01.10),
+#if defined(ENABLE_AUX_CDC)
+	/* Composite device, the functions are described by their Interface Association Descriptors. */
+	.Class                  = 0xEF,
+	.SubClass               = 0x02,
+	.Protocol               = 0x01,
+#elif defined(ENABLE_VENDOR_BULK)
+	/* Class defined by the interfaces, no CDC driver binds to it. */
+	.Class                  = 0x00,
+	.SubClass               = 0x00,
+	.Protocol               = 0x00,
+#else
 	.Class                  = 0x02,
 	.SubClass               = 0x00,
 	.Protocol               = 0x00,
+#endif
 
 	.Endpoint0Size          = FIXED_CONTROL_ENDPOINT_SIZE,
 
@@ -89,102 +101,47 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
 
 			.TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
-			.TotalInterfaces        = 2,
+			.TotalInterfaces        = TOTAL_INTERFACES,
 
-			.ConfigurationNumber    = 1,
+			.ConfigurationNumber    = CONFIG_THROUGHPUT,
+		#if defined(ENABLE_DUAL_CONFIG)
+			.ConfigurationStrIndex  = 0x03,
+		#else
 			.ConfigurationStrIndex  = NO_DESCRIPTOR,
+		#endif
 
 			.ConfigAttributes       = (USB_CONFIG_ATTR_BUSPOWERED | USB_CONFIG_ATTR_SELFPOWERED),
 
 			.MaxPowerConsumption    = USB_CONFIG_POWER_MA(100)
 		},
 
-	.CDC_CCI_Interface =
-		{
-			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
-
-			.InterfaceNumber        = 0,
-			.AlternateSetting       = 0,
-
-			.TotalEndpoints         = 1,
-
-			.Class                  = 0x02,
-			.SubClass               = 0x02,
-			.Protocol               = 0x01,
-
-			.InterfaceStrIndex      = NO_DESCRIPTOR
-		},
-
-	.CDC_Functional_IntHeader =
-		{
-			.Header                 = {.Size = sizeof(CDC_FUNCTIONAL_DESCRIPTOR(2)), .Type = 0x24},
-			.SubType                = 0x00,
-
-			.Data                   = {0x01, 0x10}
-		},
-
-	.CDC_Functional_AbstractControlManagement =
-		{
-			.Header                 = {.Size = sizeof(CDC_FUNCTIONAL_DESCRIPTOR(1)), .Type = 0x24},
-			.SubType                = 0x02,
-
-			.Data                   = {0x06}
-		},
-
-	.CDC_Functional_Union =
-		{
-			.Header                 = {.Size = sizeof(CDC_FUNCTIONAL_DESCRIPTOR(2)), .Type = 0x24},
-			.SubType                = 0x06,
-
-			.Data                   = {0x00, 0x01}
-		},
-
-	.CDC_NotificationEndpoint =
-		{
-			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
-
-			.EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_IN | CDC_NOTIFICATION_EPNUM),
-			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-			.EndpointSize           = CDC_NOTIFICATION_EPSIZE,
-			.PollingIntervalMS      = 0xFF
-		},
+	#include "ConfigurationBody.h"
+};
 
-	.CDC_DCI_Interface =
+#if defined(ENABLE_DUAL_CONFIG)
+/** The second configuration, the same interfaces and endpoints tuned for latency instead of
+ *  throughput (see CONFIG_LATENCY_FLUSH_US). The host picks one with SET_CONFIGURATION.
+ */
+const USB_Descriptor_Configuration_t PROGMEM LatencyConfigurationDescriptor =
+{
+	.Config =
 		{
-			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
-
-			.InterfaceNumber        = 1,
-			.AlternateSetting       = 0,
+			.Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
 
-			.TotalEndpoints         = 2,
+			.TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
+			.TotalInterfaces        = TOTAL_INTERFACES,
 
-			.Class                  = 0x0A,
-			.SubClass               = 0x00,
-			.Protocol               = 0x00,
+			.ConfigurationNumber    = CONFIG_LATENCY,
+			.ConfigurationStrIndex  = 0x04,
 
-			.InterfaceStrIndex      = NO_DESCRIPTOR
-		},
-
-	.CDC_DataOutEndpoint =
-		{
-			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+			.ConfigAttributes       = (USB_CONFIG_ATTR_BUSPOWERED | USB_CONFIG_ATTR_SELFPOWERED),
 
-			.EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_OUT | CDC_RX_EPNUM),
-			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-			.EndpointSize           = CDC_OUT_EPSIZE,
-			.PollingIntervalMS      = 0x01
+			.MaxPowerConsumption    = USB_CONFIG_POWER_MA(100)
 		},
 
-	.CDC_DataInEndpoint =
-		{
-			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
-
-			.EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_IN | CDC_TX_EPNUM),
-			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-			.EndpointSize           = CDC_IN_EPSIZE,
-			.PollingIntervalMS      = 0x01
-		}
+	#include "ConfigurationBody.h"
 };
+#endif
 
 /** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
  *  the string descriptor with index 0 (the first index). It is actually an array of 16-bit integers, which indicate
@@ -226,6 +183,23 @@ const USB_Descriptor_String_t PROGMEM ProductString =
 
 };
 
+#if defined(ENABLE_DUAL_CONFIG)
+/** Configuration strings, what lsusb -v shows the host's choice as. */
+const USB_Descriptor_String_t PROGMEM ThroughputConfigString =
+{
+	.Header                 = {.Size = USB_STRING_LEN(10), .Type = DTYPE_String},
+
+	.UnicodeString          = L"Throughput"
+};
+
+const USB_Descriptor_String_t PROGMEM LatencyConfigString =
+{
+	.Header                 = {.Size = USB_STRING_LEN(11), .Type = DTYPE_String},
+
+	.UnicodeString          = L"Low latency"
+};
+#endif
+
 /** This function is called by the library when in device mode, and must be overridden (see library "USB Descriptors"
  *  documentation) by the application code so that the address and size of a requested descriptor can be given
  *  to the USB library. When the device receives a Get Descriptor request on the control endpoint, this function
@@ -249,7 +223,13 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 			Size    = sizeof(USB_Descriptor_Device_t);
 			break;
 		case DTYPE_Configuration:
-			Address = (void*)&ConfigurationDescriptor;
+			#if defined(ENABLE_DUAL_CONFIG)
+			/* Indexed from 0, the latency configuration is the second one. */
+			if (DescriptorNumber == 1)
+			  Address = (void*)&LatencyConfigurationDescriptor;
+			else
+			#endif
+			  Address = (void*)&ConfigurationDescriptor;
 			Size    = sizeof(USB_Descriptor_Configuration_t);
 			break;
 		case DTYPE_String:
@@ -267,6 +247,16 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 					Address = (void*)&ProductString;
 					Size    = pgm_read_byte(&ProductString.Header.Size);
 					break;
+				#if defined(ENABLE_DUAL_CONFIG)
+				case 0x03:
+					Address = (void*)&ThroughputConfigString;
+					Size    = pgm_read_byte(&ThroughputConfigString.Header.Size);
+					break;
+				case 0x04:
+					Address = (void*)&LatencyConfigString;
+					Size    = pgm_read_byte(&LatencyConfigString.Header.Size);
+					break;
+				#endif
 			}
 
 			break;
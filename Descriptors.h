@@ -60,15 +60,90 @@
 		#define CDC_NOTIFICATION_EPSIZE        8
 
 		/** Size in bytes of the CDC data IN and OUT endpoints. */
-		#define CDC_OUT_EPSIZE                32
+		#if defined(ENABLE_INT_EP)
+			/* Gives the DPRAM (176 bytes on the 16U2) to the interrupt endpoint. */
+			#define CDC_OUT_EPSIZE            16
+		#else
+			#define CDC_OUT_EPSIZE            32
+		#endif
 		#define CDC_IN_EPSIZE                64
 
+		/** Endpoint number and size of the interrupt IN endpoint of the optional low latency
+		 *  interface, see \ref VENDOR_REQ_SetIntThreshold. */
+		#define INT_IN_EPNUM                   1
+		#define INT_IN_EPSIZE                 16
+
+		/** Number of interfaces the serial port takes: the CDC control and data pair, or the single
+		 *  vendor class bulk interface (see \ref VENDOR_HDR_LEN). */
+		#if defined(ENABLE_VENDOR_BULK)
+			#define SERIAL_INTERFACES          1
+		#else
+			#define SERIAL_INTERFACES          2
+		#endif
+
+		/** Interface number of the optional low latency interface. */
+		#define INT_INTERFACE_NUMBER           SERIAL_INTERFACES
+
+		#if defined(ENABLE_AUX_CDC)
+			#if (ENDPOINT_TOTAL_ENDPOINTS < 7)
+				#error ENABLE_AUX_CDC needs three more endpoints, this AVR has 5 (0-4), build it for the ATmega32U4.
+			#endif
+			#if defined(ENABLE_INT_EP)
+				#error ENABLE_AUX_CDC and ENABLE_INT_EP both use endpoint 1.
+			#endif
+			#if defined(ENABLE_VENDOR_BULK)
+				#error ENABLE_AUX_CDC is a CDC composite, it does not go with ENABLE_VENDOR_BULK.
+			#endif
+
+			/** Endpoints of the second CDC port, see auxcdc.h. */
+			#define AUX_RX_EPNUM               1
+			#define AUX_NOTIFICATION_EPNUM     5
+			#define AUX_TX_EPNUM               6
+
+			#define AUX_NOTIFICATION_EPSIZE    8
+			#define AUX_EPSIZE                32
+
+			/** Interface number of the control interface of the second CDC port, the data one follows. */
+			#define AUX_CONTROL_INTERFACE      2
+		#endif
+
+		#if defined(ENABLE_AUX_CDC)
+			#define TOTAL_INTERFACES           (SERIAL_INTERFACES + 2)
+		#elif defined(ENABLE_INT_EP)
+			#define TOTAL_INTERFACES           (SERIAL_INTERFACES + 1)
+		#else
+			#define TOTAL_INTERFACES           SERIAL_INTERFACES
+		#endif
+
+		/** Configuration values: the serial port tuned for throughput, and with ENABLE_DUAL_CONFIG a
+		 *  second configuration of the same endpoints tuned for latency (see CONFIG_LATENCY_FLUSH_US). */
+		#define CONFIG_THROUGHPUT              1
+		#define CONFIG_LATENCY                 2
+
 		#define CDC_CONTROL_EPNUM		0
 
 		#define CDC_OUT_DBLBANK	0
 		#define CDC_IN_DBLBANK 1
 
 		#define CDC_NOTIFICATION_DBLBANK 0
+
+		/* Endpoint DPRAM is handed out in endpoint order, the control endpoint first. The series 2
+		 * parts have 176 bytes of it, the Makefile sizes the control endpoint to what the others
+		 * leave (FIXED_CONTROL_ENDPOINT_SIZE); the ATmega32U4 has 832. */
+		#if defined(ENABLE_VENDOR_BULK)
+			#define NOTIFICATION_DPRAM         0
+		#else
+			#define NOTIFICATION_DPRAM         ((1 + CDC_NOTIFICATION_DBLBANK) * CDC_NOTIFICATION_EPSIZE)
+		#endif
+		#if defined(ENABLE_INT_EP)
+			#define INT_IN_DPRAM               INT_IN_EPSIZE
+		#else
+			#define INT_IN_DPRAM               0
+		#endif
+		#if !defined(__AVR_ATmega32U4__) && ((FIXED_CONTROL_ENDPOINT_SIZE + INT_IN_DPRAM + NOTIFICATION_DPRAM + \
+		     (1 + CDC_IN_DBLBANK) * CDC_IN_EPSIZE + (1 + CDC_OUT_DBLBANK) * CDC_OUT_EPSIZE) > 176)
+			#error The endpoints take more than the 176 bytes of DPRAM, use a smaller FIXED_CONTROL_ENDPOINT_SIZE.
+		#endif
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
 		 *  application code, as the configuration descriptor contains several sub-descriptors which
@@ -77,6 +152,14 @@
 		typedef struct
 		{
 			USB_Descriptor_Configuration_Header_t    Config;
+			#if defined(ENABLE_AUX_CDC)
+			USB_Descriptor_Interface_Association_t   CDC_IAD;
+			#endif
+			#if defined(ENABLE_VENDOR_BULK)
+			USB_Descriptor_Interface_t               Vendor_Interface;
+			USB_Descriptor_Endpoint_t                Vendor_DataOutEndpoint;
+			USB_Descriptor_Endpoint_t                Vendor_DataInEndpoint;
+			#else
 			USB_Descriptor_Interface_t               CDC_CCI_Interface;
 			CDC_FUNCTIONAL_DESCRIPTOR(2)             CDC_Functional_IntHeader;
 			CDC_FUNCTIONAL_DESCRIPTOR(1)             CDC_Functional_AbstractControlManagement;
@@ -85,6 +168,22 @@
 			USB_Descriptor_Interface_t               CDC_DCI_Interface;
 			USB_Descriptor_Endpoint_t                CDC_DataOutEndpoint;
 			USB_Descriptor_Endpoint_t                CDC_DataInEndpoint;
+			#endif
+			#if defined(ENABLE_INT_EP)
+			USB_Descriptor_Interface_t               Int_Interface;
+			USB_Descriptor_Endpoint_t                Int_DataInEndpoint;
+			#endif
+			#if defined(ENABLE_AUX_CDC)
+			USB_Descriptor_Interface_Association_t   Aux_IAD;
+			USB_Descriptor_Interface_t               Aux_CCI_Interface;
+			CDC_FUNCTIONAL_DESCRIPTOR(2)             Aux_Functional_IntHeader;
+			CDC_FUNCTIONAL_DESCRIPTOR(1)             Aux_Functional_AbstractControlManagement;
+			CDC_FUNCTIONAL_DESCRIPTOR(2)             Aux_Functional_Union;
+			USB_Descriptor_Endpoint_t                Aux_NotificationEndpoint;
+			USB_Descriptor_Interface_t               Aux_DCI_Interface;
+			USB_Descriptor_Endpoint_t                Aux_DataOutEndpoint;
+			USB_Descriptor_Endpoint_t                Aux_DataInEndpoint;
+			#endif
 		} USB_Descriptor_Configuration_t;
 
 	/* Function Prototypes: */
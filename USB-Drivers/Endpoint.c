@@ -78,9 +78,10 @@ void Endpoint_ClearStatusStage(void)
 {
 	if (USB_ControlRequest.bmRequestType & REQDIR_DEVICETOHOST)
 	{
+		/* A host that sent wLength = 0 has nothing to acknowledge, give up on the next SETUP. */
 		while (!(Endpoint_IsOUTReceived()))
 		{
-			if (USB_DeviceState == DEVICE_STATE_Unattached)
+			if ((USB_DeviceState == DEVICE_STATE_Unattached) || Endpoint_IsSETUPReceived())
 			  return;
 		}
 
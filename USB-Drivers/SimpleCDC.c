@@ -47,7 +47,7 @@ void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t* const CDCInter
 	if (!(Endpoint_IsSETUPReceived()))
 	  return;
 
-	if (USB_ControlRequest.wIndex != CDC_CONTROL_EPNUM)
+	if (USB_ControlRequest.wIndex != CDCInterfaceInfo->Config.ControlInterfaceNumber)
 	  return;
 
 	switch (USB_ControlRequest.bRequest)
@@ -62,7 +62,9 @@ void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t* const CDCInter
 
 			break;
 		case REQ_SetLineEncoding:
-			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			/* Anything but the whole structure would leave the data stage waiting for bytes that never come. */
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE)) &&
+			    (USB_ControlRequest.wLength == sizeof(CDCInterfaceInfo->State.LineEncoding)))
 			{
 				Endpoint_ClearSETUP();
 				Endpoint_Read_Control_Stream_LE(&CDCInterfaceInfo->State.LineEncoding, sizeof(CDCInterfaceInfo->State.LineEncoding));
@@ -100,12 +102,15 @@ bool CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t* const CDCInterfac
 {
 	memset(&CDCInterfaceInfo->State, 0x00, sizeof(CDCInterfaceInfo->State));
 
+	/* The vendor class interface has no notification endpoint. */
+	#if !defined(ENABLE_VENDOR_BULK)
 	if (!(Endpoint_ConfigureEndpoint(CDC_NOTIFICATION_EPNUM, EP_TYPE_INTERRUPT,
 	                                 ENDPOINT_DIR_IN, CDC_NOTIFICATION_EPSIZE,
 	                                 CDC_NOTIFICATION_DBLBANK ? ENDPOINT_BANK_DOUBLE : ENDPOINT_BANK_SINGLE)))
 	{
 		return false;
 	}
+	#endif
 
 	if (!(Endpoint_ConfigureEndpoint(CDC_TX_EPNUM, EP_TYPE_BULK,
 							         ENDPOINT_DIR_IN, CDC_IN_EPSIZE,
@@ -133,11 +138,11 @@ uint8_t CDC_Device_SendByte_Prep(USB_ClassInfo_CDC_Device_t* const CDCInterfaceI
 
 	Endpoint_SelectEndpoint(CDC_TX_EPNUM);
 
+	/* Both banks busy. The caller sends every packet it writes, so there is nothing to send
+	 * here: clearing the bank anyway would send an empty packet if the host frees one meanwhile. */
 	if (!(Endpoint_IsReadWriteAllowed()))
-	{
-		Endpoint_ClearIN();
-		return ENDPOINT_READYWAIT_Timeout;
-	}
+	  return ENDPOINT_READYWAIT_Timeout;
+
 	return ENDPOINT_READYWAIT_NoError;
 }
 
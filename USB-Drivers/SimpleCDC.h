@@ -94,6 +94,12 @@
 			typedef struct
 			{
 				struct
+				{
+					uint8_t ControlInterfaceNumber; /**< Interface number of the CDC control interface within the device. */
+				} Config; /**< Config data for the USB class interface within the device. All elements in this section
+				           *   <b>must</b> be set or the interface will fail to enumerate and operate correctly.
+				           */
+				struct
 				{
 					struct
 					{
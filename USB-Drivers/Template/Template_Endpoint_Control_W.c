@@ -6,7 +6,9 @@ uint8_t TEMPLATE_FUNC_NAME (const void* Buffer,
 	
 	if (Length > USB_ControlRequest.wLength)
 	  Length = USB_ControlRequest.wLength;
-	else if (!(Length))
+
+	/* Nothing to send, including wLength = 0: a zero length packet ends the transfer. */
+	if (!(Length))
 	  Endpoint_ClearIN();
 
 	while (Length || LastPacketFull)
@@ -25,21 +27,27 @@ uint8_t TEMPLATE_FUNC_NAME (const void* Buffer,
 		if (Endpoint_IsINReady())
 		{
 			uint8_t BytesInEndpoint = Endpoint_BytesInEndpoint();
-		
-			while (Length && (BytesInEndpoint < USB_ControlEndpointSize))
-			{
-				TEMPLATE_TRANSFER_BYTE(DataStream);
-				Length--;
-				BytesInEndpoint++;
-			}
-			
-			LastPacketFull = (BytesInEndpoint == USB_ControlEndpointSize);
+			uint8_t Chunk           = (USB_ControlEndpointSize - BytesInEndpoint);
+
+			/* What fits in the packet, copied in a loop that only counts down. */
+			if (Chunk > Length)
+			  Chunk = Length;
+
+			Length        -= Chunk;
+			LastPacketFull = ((BytesInEndpoint + Chunk) == USB_ControlEndpointSize);
+
+			while (Chunk--)
+			  TEMPLATE_TRANSFER_BYTE(DataStream);
+
 			Endpoint_ClearIN();
 		}
 	}
 	
 	while (!(Endpoint_IsOUTReceived()))
 	{
+		if (Endpoint_IsSETUPReceived())
+		  return ENDPOINT_RWCSTREAM_HostAborted;
+
 		if (USB_DeviceState == DEVICE_STATE_Unattached)
 		  return ENDPOINT_RWCSTREAM_DeviceDisconnected;
 		else if (USB_DeviceState == DEVICE_STATE_Suspended)
@@ -0,0 +1,173 @@
+/* Autobaud mode for fast-usbserial, see autobaud.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_AUTOBAUD
+
+#include <avr/pgmspace.h>
+
+#include "autobaud.h"
+#ifdef ENABLE_AUX_CDC
+#include "auxcdc.h"
+#endif
+
+/* RXD1, a plain input while the receiver is off. */
+#define AUTOBAUD_RX_PIN    PIND
+#define AUTOBAUD_RX_MASK   _BV(2)
+
+/* The ring buffers are not used by this mode, the edge intervals go in the
+ * USART to USB one. */
+#define AutobaudIntervals  ((uint16_t*)USARTtoUSB_BUFFER)
+#define AUTOBAUD_INTERVALS 32
+
+/** Ends a measurement this many of the shortest intervals in. */
+#define AUTOBAUD_SPAN      20
+
+/** Longest a level may last before the line counts as idle, in Timer1 cycles. */
+#define AUTOBAUD_IDLE_MAX  0xF000
+
+/** Rates a measurement within 2% of is taken as. */
+static const uint32_t PROGMEM Autobaud_Standard[] = {
+	4800, 9600, 14400, 19200, 28800, 38400, 57600, 76800, 115200, 230400, 250000
+};
+
+/** The rate found since the mode was last entered, 0 if none. */
+static uint32_t Autobaud_Baud;
+
+/* Serves the control endpoint and the console, and drops what comes on the OUT one. */
+static void Autobaud_Service(void)
+{
+	if (CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface))
+	  Endpoint_ClearOUT();
+
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	if (Endpoint_IsSETUPReceived())
+	  USB_Device_ProcessControlRequest();
+#ifdef ENABLE_AUX_CDC
+	AuxCDC_Task();
+#endif
+}
+
+/* Waits for the RX pin to read Level, serving the USB side on every Timer0
+ * overflow so that the loop that sees the edge stays short. False if the
+ * host went away or picked another mode meanwhile. */
+static bool Autobaud_Wait(const uint8_t Level)
+{
+	do {
+		if (TIFR0 & _BV(TOV0)) {
+			TIFR0 = _BV(TOV0);
+			Autobaud_Service();
+			if ((USB_DeviceState != DEVICE_STATE_Configured) || (SerialMode != SERIAL_MODE_AUTOBAUD))
+			  return false;
+		}
+	} while ((AUTOBAUD_RX_PIN & AUTOBAUD_RX_MASK) != Level);
+	return true;
+}
+
+/* Bits in the first n intervals at Bit16 (a bit time in 1/16 cycles), adding
+ * up their cycles in *Total. Those longer than MaxBits bits are left out, 0
+ * if one of the others is not a whole number of bits. */
+static uint16_t Autobaud_Bits(const uint8_t n, const uint32_t Bit16, const uint8_t MaxBits, uint32_t* const Total)
+{
+	uint16_t bits = 0;
+	*Total = 0;
+	for (uint8_t i = 0; i < n; i++) {
+		uint32_t t = (uint32_t)AutobaudIntervals[i] << 4;
+		uint32_t k = (t + Bit16 / 2) / Bit16;
+		if (k > MaxBits) continue;
+		uint32_t whole = k * Bit16;
+		if (!k || (((t > whole) ? (t - whole) : (whole - t)) > Bit16 / 3)) return 0;
+		bits += k;
+		*Total += AutobaudIntervals[i];
+	}
+	return bits;
+}
+
+/* Times the edges from the start bit the line is in, returns the rate they
+ * make or 0 if they do not make one. */
+static uint32_t Autobaud_Measure(void)
+{
+	uint16_t last = TCNT1;
+	uint16_t shortest = 0xFFFF;
+	uint16_t limit = AUTOBAUD_IDLE_MAX;
+	uint32_t sum = 0;
+	uint8_t level = 0;
+	uint8_t n = 0;
+
+	for (;;) {
+		uint16_t now = TCNT1;
+		if ((AUTOBAUD_RX_PIN & AUTOBAUD_RX_MASK) != level) {
+			uint16_t d = now - last;
+			level ^= AUTOBAUD_RX_MASK;
+			last = now;
+			AutobaudIntervals[n++] = d;
+			sum += d;
+			if (d < shortest) {
+				shortest = d;
+				limit = (d < AUTOBAUD_IDLE_MAX / 12) ? (12 * d) : AUTOBAUD_IDLE_MAX;
+			}
+			if ((n == AUTOBAUD_INTERVALS) || (sum >= (uint32_t)AUTOBAUD_SPAN * shortest)) break;
+		} else if ((uint16_t)(now - last) > limit) {
+			break;
+		}
+	}
+	if ((n < 2) || !shortest) return 0;
+
+	/* The short intervals give a bit time good enough to count the bits of the long ones. */
+	uint32_t total;
+	uint16_t bits = Autobaud_Bits(n, (uint32_t)shortest << 4, 3, &total);
+	if (!bits) return 0;
+	bits = Autobaud_Bits(n, (total << 4) / bits, 0xFF, &total);
+	if (!bits) return 0;
+	uint32_t bit16 = (total << 4) / bits;
+	uint32_t baud = ((uint32_t)F_CPU * 16 + bit16 / 2) / bit16;
+	if (baud < AUTOBAUD_MIN_BAUD) return 0;
+
+	for (uint8_t i = 0; i < (sizeof(Autobaud_Standard) / sizeof(Autobaud_Standard[0])); i++) {
+		uint32_t s = pgm_read_dword(&Autobaud_Standard[i]);
+		if ((((baud > s) ? (baud - s) : (s - baud)) * 50) <= s) return s;
+	}
+	return baud;
+}
+
+/** Main loop of the autobaud mode, returns when the device is unconfigured or
+ *  the host selects another mode, or with SERIAL_MODE_UART once it has a rate. */
+void Autobaud_Task(void)
+{
+	UCSR1B = 0;
+	Autobaud_Baud = 0;
+	/* Timer1 free running, the intervals are differences of TCNT1. */
+	uint16_t ocr = OCR1A;
+	OCR1A = 0xFFFF;
+	TIFR0 = _BV(TOV0);
+
+	/* Idle first, so a character the mode came in the middle of is not taken as one. */
+	while (Autobaud_Wait(AUTOBAUD_RX_MASK) && Autobaud_Wait(0)) {
+		uint32_t baud = Autobaud_Measure();
+		if (baud) {
+			VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS = baud;
+			Autobaud_Baud = baud;
+			SerialMode = SERIAL_MODE_UART;
+			break;
+		}
+	}
+
+	OCR1A = ocr;
+	TCNT1 = 0;
+	if (SerialMode == SERIAL_MODE_UART)
+	  EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+}
+
+void Autobaud_ProcessControlRequest(void)
+{
+	if (USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+	  return;
+
+	Endpoint_ClearSETUP();
+	Endpoint_Write_DWord_LE(Autobaud_Baud);
+	Endpoint_ClearIN();
+	Endpoint_ClearStatusStage();
+}
+
+#endif
@@ -0,0 +1,50 @@
+/* Autobaud mode for fast-usbserial, for targets that start talking at a
+ * rate nobody told the host: RC oscillator parts, bootloaders that pick
+ * their own, a board at an unknown rate on the bench. Instead of the host
+ * guessing through SET_LINE_CODING after SET_LINE_CODING, the firmware
+ * times the edges on the RX pin and works the rate out itself.
+ *
+ * The host selects SERIAL_MODE_AUTOBAUD with VENDOR_REQ_SetMode. The USART
+ * is off while the mode listens, PD2 (RXD1) reads as a plain input. From
+ * the first start bit on the loop timestamps every edge with Timer1, until
+ * the line is idle for 12 of the shortest intervals or it has seen 20 of
+ * them: one character with a gap after it, two back to back. Every
+ * interval is a whole number of bit times, the rate is their sum over the
+ * number of bits, so all the edges count and not just the shortest pulse.
+ * A rate within 2% of a standard one is taken as that one.
+ *
+ * The character has to have a single bit pulse in it somewhere, as any
+ * with bit 0 set does (the start bit then is one): 'U' (0x55) is the
+ * classic, '\r' does too. Measurements that do not come out as whole bit
+ * times, glitches or noise, are thrown away and the mode listens again.
+ *
+ * Once it has a rate the mode puts it in the line coding (data bits,
+ * parity and stop bits stay the host's) and goes back to the UART bridge,
+ * which starts with the next character. GET_LINE_CODING then returns the
+ * rate, and VENDOR_REQ_GetAutobaud returns it as 4 bytes, little endian,
+ * 0 if no rate was found since the mode was last entered. A fixed line
+ * coding from the EEPROM (see eeconfig.h) overrides what it finds.
+ *
+ * The USB side is served between characters and at least every 4ms while
+ * the line is idle; a measurement keeps it waiting for up to two
+ * characters. OUT data is dropped. From AUTOBAUD_MIN_BAUD up to about
+ * 250000 baud, the loop takes a few cycles to see an edge.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _AUTOBAUD_H_
+#define _AUTOBAUD_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		/** Slowest rate it finds, 12 bit times still fit in the 16 bit Timer1. */
+		#define AUTOBAUD_MIN_BAUD        4800
+
+	/* Function Prototypes: */
+		void Autobaud_Task(void);
+		void Autobaud_ProcessControlRequest(void);
+
+#endif
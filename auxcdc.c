@@ -0,0 +1,120 @@
+/* Second CDC-ACM port of fast-usbserial, see auxcdc.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_AUX_CDC
+
+#include "auxcdc.h"
+
+USB_ClassInfo_CDC_Device_t AuxSerial_CDC_Interface =
+	{
+		.Config = { .ControlInterfaceNumber = AUX_CONTROL_INTERFACE }
+	};
+
+static uint8_t AuxLine[AUX_LINE_MAX];
+static uint8_t AuxLineLen;
+
+/** Configures EP5 and EP6, EP1 must already be configured before the first port (ascending order). */
+void AuxCDC_ConfigureEndpoints(void)
+{
+	memset(&AuxSerial_CDC_Interface.State, 0x00, sizeof(AuxSerial_CDC_Interface.State));
+	AuxLineLen = 0;
+
+	Endpoint_ConfigureEndpoint(AUX_NOTIFICATION_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+	                           AUX_NOTIFICATION_EPSIZE, ENDPOINT_BANK_SINGLE);
+	Endpoint_ConfigureEndpoint(AUX_TX_EPNUM, EP_TYPE_BULK, ENDPOINT_DIR_IN,
+	                           AUX_EPSIZE, ENDPOINT_BANK_SINGLE);
+}
+
+static uint8_t AuxCDC_PutNumber(uint8_t* p, uint16_t n)
+{
+	uint8_t buf[5];
+	uint8_t len = 0;
+	do {
+		buf[len++] = '0' + (n % 10);
+		n /= 10;
+	} while (n);
+	for (uint8_t i = 0; i < len; i++) p[i] = buf[len - 1 - i];
+	return len;
+}
+
+/* True if the line is cmd, alone (arg 0xFF) or with a decimal argument of 0-254 in arg. */
+static bool AuxCDC_Match(const char* cmd, uint8_t* arg)
+{
+	uint8_t i = 0;
+	char c;
+	while ((c = pgm_read_byte(cmd++))) {
+		if ((i == AuxLineLen) || (AuxLine[i++] != c)) return false;
+	}
+	if (i == AuxLineLen) {
+		*arg = 0xFF;
+		return true;
+	}
+	if ((AuxLine[i++] != ' ') || (i == AuxLineLen)) return false;
+	uint16_t n = 0;
+	for (; i < AuxLineLen; i++) {
+		if ((AuxLine[i] < '0') || (AuxLine[i] > '9')) return false;
+		n = (n * 10) + (AuxLine[i] - '0');
+		/* 0xFF is "no argument", more would wrap. */
+		if (n > 254) return false;
+	}
+	*arg = n;
+	return true;
+}
+
+/* Runs the line in AuxLine, returns the length of the reply it left in r. */
+static uint8_t AuxCDC_Execute(uint8_t* r)
+{
+	uint8_t arg;
+	uint8_t len;
+	if (!AuxLineLen) return 0;
+	if (AuxCDC_Match(PSTR("mode"), &arg)) {
+		if ((arg != 0xFF) && SerialMode_Supported(arg))
+		  SerialMode = arg;
+		memcpy_P(r, PSTR("mode "), 5);
+		len = 5 + AuxCDC_PutNumber(r + 5, SerialMode);
+	} else {
+		memcpy_P(r, PSTR("?"), 1);
+		len = 1;
+	}
+	r[len++] = '\r';
+	r[len++] = '\n';
+	return len;
+}
+
+/** Polls the console, called from the LED tick of the UART loop so the first port only pays
+ *  for it every 4ms, and from the polled loop of every other mode. Replies are dropped rather
+ *  than waited for when the host is not reading. A "mode <n>" takes effect when the loop that
+ *  called this next checks SerialMode. */
+void AuxCDC_Task(void)
+{
+	Endpoint_SelectEndpoint(AUX_RX_EPNUM);
+	if (!Endpoint_IsOUTReceived()) return;
+
+	uint8_t len = Endpoint_BytesInEndpoint();
+	uint8_t reply[AUX_EPSIZE];
+	uint8_t rlen = 0;
+	while (len--) {
+		uint8_t c = Endpoint_Read_Byte();
+		if ((c == '\r') || (c == '\n')) {
+			/* One reply per OUT packet, it has to fit in one IN packet. */
+			if (!rlen) rlen = AuxCDC_Execute(reply);
+			AuxLineLen = 0;
+		} else if (AuxLineLen < AUX_LINE_MAX) {
+			AuxLine[AuxLineLen++] = c;
+		}
+	}
+	Endpoint_ClearOUT();
+
+	if (!rlen) return;
+	Endpoint_SelectEndpoint(AUX_TX_EPNUM);
+	if (!Endpoint_IsINReady()) return;
+	uint8_t* p = reply;
+	do {
+		Endpoint_Write_Byte(*p++);
+	} while (--rlen);
+	Endpoint_ClearIN();
+}
+
+#endif
@@ -0,0 +1,37 @@
+/* Second CDC-ACM port of fast-usbserial, a text console for status and
+ * configuration that does not share the byte stream of the target. It
+ * opens as a plain tty (no libusb), e.g. "screen /dev/ttyACM1".
+ *
+ * The 16U2 only has endpoints 0-4 and the first port uses 2-4, so this
+ * needs a chip with seven endpoints like the ATmega32U4. Endpoint plan:
+ * EP1 OUT (data, 32 bytes single bank), EP5 IN (notification, 8 bytes,
+ * never sent), EP6 IN (data, 32 bytes single bank). The first port keeps
+ * its endpoints and bank sizes.
+ *
+ * Commands are lines of text:
+ *   mode         print the SERIAL_MODE_* of the first port
+ *   mode <n>     select a SERIAL_MODE_*, like VENDOR_REQ_SetMode
+ * Anything else, including a <n> that is empty or above 254, answers "?".
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _AUXCDC_H_
+#define _AUXCDC_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+		#include "SimpleCDC.h"
+
+	/* Macros: */
+		#define AUX_LINE_MAX             16
+
+	/* External Variables: */
+		extern USB_ClassInfo_CDC_Device_t AuxSerial_CDC_Interface;
+
+	/* Function Prototypes: */
+		void AuxCDC_ConfigureEndpoints(void);
+		void AuxCDC_Task(void);
+
+#endif
@@ -0,0 +1,187 @@
+/* Timestamped receive capture mode for fast-usbserial.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_CAPTURE
+
+#include "capture.h"
+#ifdef ENABLE_AUX_CDC
+#include "auxcdc.h"
+#endif
+
+/* The ring buffers are not used by this mode, the records queue up in the
+ * USART to USB one until they fit in an IN packet. */
+#define CaptureRing    (USARTtoUSB_BUFFER)
+#define CAPTURE_RING_LEN 128
+
+/** Timer1 matches every 0.5ms and counts 16 cycles a microsecond. */
+#define CAPTURE_TICK_US  500
+#define CAPTURE_OCR1A    ((F_CPU / 2000) - 1)
+
+/** Longest record: a SOF, a status and a time record in front of the byte. */
+#define CAPTURE_REC_MAX  (7 + 2 + 5 + 2)
+
+static struct {
+	uint32_t Base;      /* Time of the last Timer1 match. */
+	uint32_t Last;      /* Time of the last record. */
+	uint32_t SofTime;
+	uint16_t SofFrame;
+	uint8_t  Sof;       /* A SOF came that no record has been sent after. */
+	uint8_t  Lost;
+	uint8_t  Wr;
+	uint8_t  Rd;
+	uint8_t  InLen;     /* Bytes in the IN bank being filled. */
+	uint8_t  Ticked;    /* Timer1 matched since the main loop last looked. */
+} Capture;
+
+/* Counts a Timer1 match, true if there was one. */
+static bool Capture_Tick(void)
+{
+	if (!(TIFR1 & _BV(OCF1A))) return false;
+	TIFR1 = _BV(OCF1A);
+	Capture.Base += CAPTURE_TICK_US;
+	Capture.Ticked = 1;
+	return true;
+}
+
+static uint32_t Capture_Now(void)
+{
+	/* OCF1A is set as TCNT1 reaches TOP, which is when the next tick starts. */
+	uint16_t t = TCNT1 + 1;
+	if (Capture_Tick()) t = TCNT1 + 1;
+	if (t > CAPTURE_OCR1A) t = 0;
+	return Capture.Base + (t >> 4);
+}
+
+static void Capture_Put(uint8_t d)
+{
+	CaptureRing[Capture.Wr] = d;
+	Capture.Wr = (Capture.Wr + 1) & (CAPTURE_RING_LEN-1);
+}
+
+static void Capture_Put32(uint32_t v)
+{
+	for (uint8_t i = 0; i < 4; i++, v >>= 8) Capture_Put(v);
+}
+
+static void Capture_Byte(uint8_t status, uint8_t d, uint32_t now)
+{
+	uint8_t free = (Capture.Rd - Capture.Wr - 1) & (CAPTURE_RING_LEN-1);
+	if (free < CAPTURE_REC_MAX) {
+		Capture.Lost = CAPTURE_STATUS_LOST;
+		return;
+	}
+	if (Capture.Sof) {
+		Capture.Sof = 0;
+		Capture_Put(CAPTURE_REC_SOF);
+		Capture_Put(Capture.SofFrame);
+		Capture_Put(Capture.SofFrame >> 8);
+		Capture_Put32(Capture.SofTime);
+	}
+	status = (status & (_BV(FE1) | _BV(DOR1) | _BV(UPE1))) | Capture.Lost;
+	Capture.Lost = 0;
+	if (status) {
+		Capture_Put(CAPTURE_REC_STATUS);
+		Capture_Put(status);
+	}
+	uint32_t delta = now - Capture.Last;
+	Capture.Last = now;
+	if (delta >= 0x4000) {
+		Capture_Put(CAPTURE_REC_TIME);
+		Capture_Put32(now);
+		delta = 0;
+	}
+	if (delta >= 0x80) {
+		Capture_Put(0x80 | (delta >> 8));
+	}
+	Capture_Put(delta);
+	Capture_Put(d);
+}
+
+/* Sends the IN bank being filled. */
+static void Capture_Flush(void)
+{
+	Endpoint_SelectEndpoint(CDC_TX_EPNUM);
+	Endpoint_ClearIN();
+	Capture.InLen = 0;
+}
+
+/** Main loop of the capture mode, returns when the device is unconfigured or
+ *  the host selects another mode. */
+void Capture_Task(void)
+{
+	/* Bit rate of the host, but polled: the UART modes only get the ring ISRs. */
+	EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+	memset(&Capture, 0, sizeof(Capture));
+	/* The flush timer runs a cycle long (8001 per CTC period), that would be 125ppm here. */
+	uint16_t ocr = OCR1A;
+	OCR1A = CAPTURE_OCR1A;
+	TCNT1 = 0;
+	TIFR1 = _BV(OCF1A);
+	USB_INT_Clear(USB_INT_SOFI);
+	Capture_Put(CAPTURE_REC_TIME);
+	Capture_Put32(0);
+
+	do {
+		if (UCSR1A & _BV(RXC1)) {
+			uint8_t status = UCSR1A;
+			uint8_t d = UDR1;
+			Capture_Byte(status, d, Capture_Now());
+			LEDs_TurnOnLEDs(LEDMASK_RX);
+		}
+
+		if (USB_INT_HasOccurred(USB_INT_SOFI)) {
+			USB_INT_Clear(USB_INT_SOFI);
+			Capture.SofTime = Capture_Now();
+			Capture.SofFrame = UDFNUM;
+			Capture.Sof = 1;
+		}
+
+		/* Fill the IN bank while no byte is waiting, a byte at a time. */
+		Endpoint_SelectEndpoint(CDC_TX_EPNUM);
+		if ((Capture.Rd != Capture.Wr) && Endpoint_IsINReady()) {
+			do {
+				Endpoint_Write_Byte(CaptureRing[Capture.Rd]);
+				Capture.Rd = (Capture.Rd + 1) & (CAPTURE_RING_LEN-1);
+				if (++Capture.InLen == CDC_IN_EPSIZE-1) {
+					Capture_Flush();
+					LEDs_TurnOnLEDs(LEDMASK_TX);
+					break;
+				}
+			} while ((Capture.Rd != Capture.Wr) && !(UCSR1A & _BV(RXC1)));
+		}
+
+		Capture_Tick();
+		if (Capture.Ticked) {
+			Capture.Ticked = 0;
+			/* A part filled packet goes once the records stop for a tick. */
+			if (Capture.InLen && (Capture.Rd == Capture.Wr)) {
+				Capture_Flush();
+				LEDs_TurnOnLEDs(LEDMASK_TX);
+			} else if (!Capture.InLen) {
+				LEDs_TurnOffLEDs(LEDMASK_TX | LEDMASK_RX);
+			}
+#ifdef ENABLE_AUX_CDC
+			AuxCDC_Task();
+#endif
+		}
+
+		/* Receive only. */
+		if (CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface))
+		  Endpoint_ClearOUT();
+
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		if (Endpoint_IsSETUPReceived())
+		  USB_Device_ProcessControlRequest();
+	} while ((USB_DeviceState == DEVICE_STATE_Configured) && (SerialMode == SERIAL_MODE_CAPTURE));
+
+	if (Capture.InLen && (USB_DeviceState == DEVICE_STATE_Configured))
+	  Capture_Flush();
+	OCR1A = ocr;
+	LEDs_TurnOffLEDs(LEDMASK_TX | LEDMASK_RX);
+	if (SerialMode == SERIAL_MODE_UART)
+	  EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+}
+
+#endif
@@ -0,0 +1,52 @@
+/* Timestamped receive capture mode for fast-usbserial, for using the board
+ * as a protocol sniffer. Every byte the USART receives is stamped with the
+ * Timer1 time it arrived, to the microsecond, and goes to the host as a
+ * record in a compact, delta encoded IN stream. The CDC bridge only tells
+ * the host when a whole IN packet got there, which can be milliseconds
+ * after the bytes.
+ *
+ * The line coding is the host's, the USART runs polled and OUT data is
+ * dropped. A byte is stamped when the loop sees it in UDR1, within a few
+ * microseconds of the middle of its first stop bit while the host keeps up
+ * (about 1Mbaud of continuous traffic); subtract a frame time for the
+ * start bit.
+ *
+ * The stream is a series of records, they may run over a packet boundary.
+ * Times are in microseconds since the mode was entered, each record is
+ * relative to the time of the one before it:
+ *
+ *   0x00..0x7F <byte>             received byte, delta of 0..127us
+ *   0x80..0xBF <lo> <byte>        received byte, delta of ((c & 0x3F) << 8) | lo
+ *   CAPTURE_REC_TIME <t 4>        the time is now t (32 bits), for longer gaps
+ *   CAPTURE_REC_SOF <f 2> <t 4>   USB frame f (11 bits) started at time t,
+ *                                 does not move the time
+ *   CAPTURE_REC_STATUS <flags>    CAPTURE_STATUS_* of the next byte
+ *
+ * Every capture starts with a CAPTURE_REC_TIME of 0. A CAPTURE_REC_SOF goes
+ * in front of the first record after each SOF, so an idle line costs
+ * nothing, and gives the host the USB frame to line its own clock up with.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		#define CAPTURE_REC_TIME         0xC0
+		#define CAPTURE_REC_SOF          0xC1
+		#define CAPTURE_REC_STATUS       0xC2
+
+		/* Status of a byte, the same bits as UCSR1A where the USART has them. */
+		#define CAPTURE_STATUS_LOST      (1 << 0) /**< Bytes before this one were dropped, the host was not reading. */
+		#define CAPTURE_STATUS_PARITY    (1 << 2) /**< Parity error. */
+		#define CAPTURE_STATUS_OVERRUN   (1 << 3) /**< The USART dropped bytes before this one. */
+		#define CAPTURE_STATUS_FRAMING   (1 << 4) /**< No stop bit, or a break. */
+
+	/* Function Prototypes: */
+		void Capture_Task(void);
+
+#endif
@@ -1,6 +0,0 @@
-#ifndef _DEBUG_TX_H_
-#define _DEBUG_TX_H_
-
-void debug_send(uint8_t c);
-
-#endif
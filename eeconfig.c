@@ -0,0 +1,116 @@
+/* Default configuration in the EEPROM, see eeconfig.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+#include "eeconfig.h"
+
+#include <avr/eeprom.h>
+
+#ifdef EECONFIG_BAUD
+#define EECONFIG_BAUD_SUM ((EECONFIG_BAUD & 0xFF) + ((EECONFIG_BAUD >> 8) & 0xFF) + \
+                           ((EECONFIG_BAUD >> 16) & 0xFF) + ((EECONFIG_BAUD >> 24) & 0xFF))
+EEConfig_t EEConfig_Stored EEMEM = {
+	EECONFIG_MAGIC,
+	{ EECONFIG_BAUD, CDC_LINEENCODING_OneStopBit, CDC_PARITY_None, 8, 0, 0, SERIAL_MODE_UART, EECONFIG_FLOW_NONE },
+	(uint8_t)-(EECONFIG_MAGIC + EECONFIG_BAUD_SUM + 8 + SERIAL_MODE_UART)
+};
+#else
+EEConfig_t EEConfig_Stored EEMEM;
+#endif
+
+/** EECONFIG_FLAG_* of the block applied at power-up, and EECONFIG_ARMED. */
+uint8_t EEConfig_Flags;
+
+/** Tells if the USART and this firmware can do what d asks for. */
+static bool EEConfig_DataValid(const EEConfig_Data_t* const d)
+{
+	if (d->BaudRateBPS > F_CPU / 8) return false;
+	if ((d->CharFormat != CDC_LINEENCODING_OneStopBit) && (d->CharFormat != CDC_LINEENCODING_TwoStopBits)) return false;
+	if (d->ParityType > CDC_PARITY_Even) return false;
+	if (d->BaudRateBPS && ((d->DataBits < 5) || (d->DataBits > 8))) return false;
+	if (d->FlushUs > EECONFIG_FLUSH_MAX_US) return false;
+	if (d->Flags & ~EECONFIG_FLAG_FIXED) return false;
+	if ((d->Flags & EECONFIG_FLAG_FIXED) && !d->BaudRateBPS) return false;
+	if (!SerialMode_Supported(d->Mode)) return false;
+#ifdef ENABLE_XONXOFF
+	if (d->Flow == EECONFIG_FLOW_XONXOFF) return true;
+#endif
+	return (d->Flow == EECONFIG_FLOW_NONE);
+}
+
+static void EEConfig_LineEncoding(const EEConfig_Data_t* const d)
+{
+	VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS = d->BaudRateBPS;
+	VirtualSerial_CDC_Interface.State.LineEncoding.CharFormat = d->CharFormat;
+	VirtualSerial_CDC_Interface.State.LineEncoding.ParityType = d->ParityType;
+	VirtualSerial_CDC_Interface.State.LineEncoding.DataBits = d->DataBits;
+}
+
+/** Reads the stored block, false if there is no valid one. */
+static bool EEConfig_Read(EEConfig_t* const c)
+{
+	eeprom_read_block(c, &EEConfig_Stored, sizeof(*c));
+	uint8_t sum = 0;
+	for (uint8_t i = 0; i < sizeof(*c); i++) sum += ((uint8_t*)c)[i];
+	return (c->Magic == EECONFIG_MAGIC) && !sum && EEConfig_DataValid(&c->Data);
+}
+
+/** Applies the stored block at power-up, after Timer1 is set up. True if it armed the port:
+ *  the line coding is in VirtualSerial_CDC_Interface and the USART is to be started with it. */
+bool EEConfig_Load(void)
+{
+	EEConfig_t c;
+	if (!EEConfig_Read(&c)) return false;
+	/* The bridge's flush timer only, capture and LIN set their own tick. */
+	if (c.Data.FlushUs) OCR1A = (F_CPU / 1000000) * c.Data.FlushUs - 1;
+	SerialMode = c.Data.Mode;
+#ifdef ENABLE_XONXOFF
+	XonXoff_Set(c.Data.Flow == EECONFIG_FLOW_XONXOFF);
+#endif
+	if (!c.Data.BaudRateBPS) return false;
+	EEConfig_Flags = c.Data.Flags | EECONFIG_ARMED;
+	EEConfig_LineEncoding(&c.Data);
+	return true;
+}
+
+/** Puts the stored line coding back over the host's, with EECONFIG_FLAG_FIXED. */
+void EEConfig_FixedLineEncoding(void)
+{
+	EEConfig_t c;
+	if (EEConfig_Read(&c) && c.Data.BaudRateBPS) EEConfig_LineEncoding(&c.Data);
+}
+
+void EEConfig_ProcessControlRequest(void)
+{
+	EEConfig_t c;
+
+	if (USB_ControlRequest.bRequest == VENDOR_REQ_GetConfig) {
+		if (USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+		  return;
+
+		if (!EEConfig_Read(&c)) memset(&c.Data, 0, sizeof(c.Data));
+		Endpoint_ClearSETUP();
+		Endpoint_Write_Control_Stream_LE(&c.Data, sizeof(c.Data));
+		Endpoint_ClearOUT();
+	} else {
+		if ((USB_ControlRequest.bmRequestType != (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) ||
+		    (USB_ControlRequest.wLength != sizeof(c.Data)))
+		  return;
+
+		Endpoint_ClearSETUP();
+		Endpoint_Read_Control_Stream_LE(&c.Data, sizeof(c.Data));
+		if (!EEConfig_DataValid(&c.Data)) {
+			Endpoint_StallTransaction();
+			return;
+		}
+		c.Magic = EECONFIG_MAGIC;
+		c.Check = 0;
+		for (uint8_t i = 0; i < sizeof(c) - 1; i++) c.Check -= ((uint8_t*)&c)[i];
+		/* Blocks for up to 3.4ms a byte that changes, about 34ms for all of them.
+		 * The RX ISR keeps filling the ring but nothing drains it meanwhile: from
+		 * about 115200 baud on a 256 byte ring it overflows and drops bytes,
+		 * counted as in VENDOR_REQ_GetDropped. */
+		eeprom_update_block(&c, &EEConfig_Stored, sizeof(c));
+		Endpoint_ClearIN();
+	}
+}
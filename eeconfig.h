@@ -0,0 +1,87 @@
+/* Default configuration of fast-usbserial in the EEPROM, for a board that
+ * has to listen before any host shows up: a logger on a console that
+ * prints its boot messages right at power-up, say.
+ *
+ * The block holds a line coding, the flush timeout, flags and the serial
+ * mode to start in. With a baud rate in it the port is armed: the USART
+ * runs with that coding from power-up and the USART to USB ring buffers
+ * what comes in until a host configures the device, then it goes out
+ * first. An armed UART bridge also keeps buffering while no host is
+ * configured, up to what the ring holds, the newest bytes are dropped
+ * after that (see VENDOR_REQ_GetDropped). The host's line coding still
+ * applies when it sends one, unless EECONFIG_FLAG_FIXED says otherwise:
+ * Linux's cdc_acm sets 9600 baud as it binds, which would glitch the
+ * USART on every plug in.
+ *
+ * VENDOR_REQ_GetConfig returns the EEConfig_Data_t of the stored block
+ * (all zeros if there is none), VENDOR_REQ_SetConfig writes one, wLength
+ * must be its size. Invalid ones are stalled. The new block takes effect
+ * at the next reset; writing the EEPROM takes the main loop away for up to
+ * 50ms, so do not send it in the middle of a transfer: received bytes the
+ * ring cannot hold meanwhile are dropped. An erased EEPROM
+ * and a block of all zeros leave the port unarmed, as without the block.
+ *
+ * Building with -DEECONFIG_BAUD=<baud> puts an armed 8N1 block in the .eep
+ * file, "make dfu-ee" or "make program" writes it.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _EECONFIG_H_
+#define _EECONFIG_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdbool.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		/** First byte of a valid block, changes with its layout. */
+		#define EECONFIG_MAGIC           0xC1
+
+		/** The host's line coding is ignored, the stored one stays. Needs a baud rate. */
+		#define EECONFIG_FLAG_FIXED      (1 << 0)
+
+		/** EEConfig_Flags only: the port was armed at power-up. */
+		#define EECONFIG_ARMED           (1 << 7)
+
+		/** No flow control. */
+		#define EECONFIG_FLOW_NONE       0
+
+		/** XON/XOFF both ways, see VENDOR_REQ_SetFlow. Needs ENABLE_XONXOFF. */
+		#define EECONFIG_FLOW_XONXOFF    1
+
+		/** Longest flush timeout, Timer1 counts 16 cycles a microsecond up to 65535. */
+		#define EECONFIG_FLUSH_MAX_US    4095
+
+	/* Type Defines: */
+		/** What VENDOR_REQ_GetConfig and VENDOR_REQ_SetConfig carry, little endian. */
+		typedef struct
+		{
+			uint32_t BaudRateBPS;    /**< 0 leaves the port unarmed. */
+			uint8_t  CharFormat;     /**< CDC_LINEENCODING_OneStopBit or _TwoStopBits. */
+			uint8_t  ParityType;     /**< CDC_PARITY_None, _Odd or _Even. */
+			uint8_t  DataBits;       /**< 5 to 8. */
+			uint16_t FlushUs;        /**< Flush timeout in microseconds, 0 for the default 500us. Capture and LIN keep a 500us tick. */
+			uint8_t  Flags;          /**< EECONFIG_FLAG_* */
+			uint8_t  Mode;           /**< SERIAL_MODE_* to start in, if this firmware has it. */
+			uint8_t  Flow;           /**< EECONFIG_FLOW_* */
+		} EEConfig_Data_t;
+
+		/** The block in the EEPROM: the bytes of all three add up to 0 (modulo 256). */
+		typedef struct
+		{
+			uint8_t         Magic;
+			EEConfig_Data_t Data;
+			uint8_t         Check;
+		} EEConfig_t;
+
+	/* External Variables: */
+		extern uint8_t EEConfig_Flags;
+		extern EEConfig_t EEConfig_Stored; /**< In the EEPROM, not RAM. */
+
+	/* Function Prototypes: */
+		bool EEConfig_Load(void);
+		void EEConfig_FixedLineEncoding(void);
+		void EEConfig_ProcessControlRequest(void);
+
+#endif
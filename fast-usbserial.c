@@ -40,29 +40,300 @@
  */
 
 #include "fast-usbserial.h"
+#include "eeconfig.h"
+#ifdef ENABLE_ONEWIRE
+#include "onewire.h"
+#endif
+#ifdef ENABLE_LIN
+#include "lin.h"
+#endif
+#ifdef ENABLE_CAPTURE
+#include "capture.h"
+#endif
+#ifdef ENABLE_AUTOBAUD
+#include "autobaud.h"
+#endif
+#ifdef ENABLE_AUX_CDC
+#include "auxcdc.h"
+#endif
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#define LATENCY(x) x
+#else
+#define LATENCY(x)
+#endif
+#ifdef ENABLE_TRACE
+#include "trace.h"
+#define TRACE(x) x
+#else
+#define TRACE(x)
+#endif
+#ifdef ENABLE_PROFILE
+#include "profile.h"
+#endif
+#ifdef ENABLE_STACK_STATS
+#include "stackuse.h"
+#endif
+#ifdef ENABLE_PASS_STATS
+#include "passtime.h"
+#define PASS(x) x
+#else
+#define PASS(x)
+#endif
 
 /* NOTE: Using Linker Magic,
  * - Reserved 256 bytes from start of RAM at 0x100 for UART RX Buffer
  * so we can use 256-byte aligned addresssing.
- * - Also 128 bytes from 0x200 for UART TX buffer, same addressing. */
+ * - Also 128 bytes from 0x200 for UART TX buffer, same addressing.
+ * BIG_UART_TX_RING swaps them, see USARTtoUSB_PAGE. The 256 byte one wraps
+ * on its own. The 128 byte one is masked with cbi when it is the TX ring
+ * (GPIOR0), GPIOR1 is out of cbi's reach so the RX one wraps with sbrc/ldi.
+ * - On the parts with more SRAM the USART to USB ring is bigger and wraps
+ * with sbrc/ldi on its page, see USARTtoUSB_WRAP_BIT. */
 
 
-#define USB2USART_BUFLEN 128
 #define USBtoUSART_rdp GPIOR0
 /* USBtoUSART_rdp is GPIOR0 so it can be masked with cbi. */
 static volatile uint8_t USBtoUSART_wrp = 0;
 /* USBtoUSART_wrp needs to be visible to ISR so saddly needs to be here. */
 
-#define USART2USB_BUFLEN 256
 #define USARTtoUSB_wrp GPIOR1
+#if (USART2USB_BUFLEN > 256)
+#define USARTtoUSB_wrp_page GPIOR2
+
+/** Where the RX ISR writes next, read so that the ISR cannot run between the two halves. */
+static inline RingPos_t USARTtoUSB_Wrp(void)
+{
+	uint8_t page, lo;
+	do {
+		page = USARTtoUSB_wrp_page;
+		lo = USARTtoUSB_wrp;
+	} while (page != USARTtoUSB_wrp_page);
+	return ((uint16_t)page << 8) | lo;
+}
 
-//#define DEBUGTX
+/** The ring position (an address here) of x, which may have run off the end of the ring. */
+#define USARTtoUSB_POS(x) ((USARTtoUSB_PAGE << 8) | ((x) & (USART2USB_BUFLEN-1)))
+#else
+#define USARTtoUSB_Wrp() USARTtoUSB_wrp
+#define USARTtoUSB_POS(x) ((x) & (USART2USB_BUFLEN-1))
+#endif
+
+/* The RX ISR stops at the guard, the slot before USARTtoUSB_rdp: the ring is full there, and one
+ * more byte would make it look empty and lose all of it. The byte is counted in USARTtoUSB_drops
+ * instead, so what a stall costs is the newest data, and a known amount of it. The guard lives in
+ * r6 (r6:r7 for the bigger rings, written with a single mov/movw) for cpse, which compares without
+ * touching SREG. */
+#ifdef HOST_BUILD
+static RingPos_t USARTtoUSB_guard;
+#define USARTtoUSB_SetGuard(rdp) (USARTtoUSB_guard = USARTtoUSB_POS((rdp) - 1))
+#elif (USART2USB_BUFLEN > 256)
+#define USARTtoUSB_SetGuard(rdp) asm volatile ("movw r6, %0" :: "r" ((RingPos_t)USARTtoUSB_POS((rdp) - 1)))
+#else
+#define USARTtoUSB_SetGuard(rdp) asm volatile ("mov r6, %0" :: "r" ((RingPos_t)USARTtoUSB_POS((rdp) - 1)))
+#endif
 
-#ifdef DEBUGTX
-#include "debug_tx.h"
-#define DEBUGB(x) debug_send(x)
+#ifdef HAVE_RX_SLOW_PATH
+#ifdef HOST_BUILD
+#define USARTtoUSB_Guard() USARTtoUSB_guard
 #else
-#define DEBUGB(x)
+static inline RingPos_t USARTtoUSB_Guard(void)
+{
+	RingPos_t g;
+#if (USART2USB_BUFLEN > 256)
+	asm volatile ("movw %0, r6" : "=r" (g));
+#else
+	asm volatile ("mov %0, r6" : "=r" (g));
+#endif
+	return g;
+}
+#endif
+#endif
+
+/** Bytes the RX ISR dropped, modulo 256, the main loop adds them up in USARTtoUSB_Dropped. */
+static volatile uint8_t USARTtoUSB_drops;
+static uint32_t USARTtoUSB_Dropped;
+
+#ifdef HAVE_RX_SLOW_PATH
+/** What the RX ISR does besides copying the byte, RX_SLOW_* bits. With any of them it takes
+ *  the slow path, which RX_SLOW_ON tells in one bit. */
+static volatile uint8_t RxSlow;
+#define RX_SLOW_ON       (1 << 0)
+#define RX_SLOW_PARMRK   (1 << 1) /**< Marks bytes with errors, see VENDOR_REQ_SetParmrk. */
+#define RX_SLOW_XONXOFF  (1 << 2) /**< Takes the target's XON and XOFF, see VENDOR_REQ_SetFlow. */
+
+static void RxSlow_Set(const uint8_t Bit, const bool On)
+{
+	uint8_t s = (On ? (RxSlow | Bit) : (RxSlow & ~Bit)) & ~RX_SLOW_ON;
+	RxSlow = s ? (s | RX_SLOW_ON) : 0;
+}
+#endif
+
+#ifdef ENABLE_XONXOFF
+#define XON   0x11
+#define XOFF  0x13
+
+/** The USART to USB ring levels the target is stopped at, and started again at. */
+#define XONXOFF_HIGH  ((USART2USB_BUFLEN * 3) / 4)
+#define XONXOFF_LOW   (USART2USB_BUFLEN / 4)
+
+/** The target sent XOFF: the UDRE ISR stays off until its XON. Written by the RX ISR only. */
+static volatile uint8_t XonXoff_Stopped;
+
+/** XONXOFF_* of what we sent the target, written by the main loop only. */
+static volatile uint8_t XonXoff_Out;
+#define XONXOFF_SENT     (1 << 0) /**< The target is stopped, or XOFF is on its way. */
+#define XONXOFF_PENDING  (1 << 1) /**< XOFF (with XONXOFF_SENT) or XON waits for UDR1, the UDRE ISR stays off. */
+
+#define USBtoUSART_Held() (XonXoff_Stopped || (XonXoff_Out & XONXOFF_PENDING))
+
+/** Starts the UDRE ISR on the USB to USART ring, unless the flow control holds it. */
+static inline void USBtoUSART_Start(void)
+{
+	ATOMIC_BLOCK(ATOMIC_FORCEON) {
+		if (!USBtoUSART_Held())
+		  UCSR1B = (_BV(RXCIE1) | _BV(TXEN1) | _BV(RXEN1) | _BV(UDRIE1));
+	}
+}
+
+/** Sends XOFF once the USART to USB ring holds XONXOFF_HIGH bytes (cnt), XON once it is down to
+ *  XONXOFF_LOW. The character goes ahead of what the USB to USART ring holds: the UDRE ISR is
+ *  held off until it is in UDR1, a character time at most. */
+static void XonXoff_Task(const RingPos_t cnt)
+{
+	uint8_t out = XonXoff_Out;
+	if (!(out & XONXOFF_PENDING)) {
+		if (!(RxSlow & RX_SLOW_XONXOFF)) return;
+		if (!(out & XONXOFF_SENT) && (cnt >= XONXOFF_HIGH)) out = XONXOFF_SENT;
+		else if ((out & XONXOFF_SENT) && (cnt <= XONXOFF_LOW)) out = 0;
+		else return;
+		XonXoff_Out = out | XONXOFF_PENDING;
+		ATOMIC_BLOCK(ATOMIC_FORCEON) {
+			UCSR1B &= ~_BV(UDRIE1);
+		}
+	}
+	if (!(UCSR1A & _BV(UDRE1))) return;
+	UDR1 = (out & XONXOFF_SENT) ? XOFF : XON;
+	XonXoff_Out = out & ~XONXOFF_PENDING;
+	if (USBtoUSART_wrp != USBtoUSART_rdp) USBtoUSART_Start();
+}
+
+/** Turns the XON/XOFF flow control on or off (VENDOR_REQ_SetFlow, EEConfig_Data_t.Flow). Off, a
+ *  target we stopped gets its XON, and one that stopped us is no longer waited for. */
+void XonXoff_Set(const bool On)
+{
+	RxSlow_Set(RX_SLOW_XONXOFF, On);
+	if (On) return;
+	XonXoff_Stopped = 0;
+	uint8_t out = XonXoff_Out;
+	if (out & XONXOFF_SENT) out = XONXOFF_PENDING;
+	XonXoff_Out = out;
+	if (out & XONXOFF_PENDING) {
+		ATOMIC_BLOCK(ATOMIC_FORCEON) {
+			UCSR1B &= ~_BV(UDRIE1);
+		}
+	} else if ((SerialMode == SERIAL_MODE_UART) && (USBtoUSART_wrp != USBtoUSART_rdp)) {
+		USBtoUSART_Start();
+	}
+}
+#else
+#define USBtoUSART_Held() 0
+#define USBtoUSART_Start() (UCSR1B = (_BV(RXCIE1) | _BV(TXEN1) | _BV(RXEN1) | _BV(UDRIE1)))
+#endif
+
+#if !defined(ENABLE_VENDOR_BULK)
+/** SERIAL_STATE notification of dropped bytes: 0 idle, 1 due, 2 the first packet of it is out. */
+static uint8_t OverrunNotify;
+
+/** Sends the notification on the 8 byte interrupt endpoint, in two packets, without waiting. */
+static void OverrunNotify_Task(void)
+{
+	Endpoint_SelectEndpoint(CDC_NOTIFICATION_EPNUM);
+	if (!Endpoint_IsINReady()) return;
+	if (OverrunNotify == 1) {
+		Endpoint_Write_Byte(REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE);
+		Endpoint_Write_Byte(NOTIF_SerialState);
+		Endpoint_Write_Word_LE(0);
+		Endpoint_Write_Word_LE(VirtualSerial_CDC_Interface.Config.ControlInterfaceNumber);
+		Endpoint_Write_Word_LE(2);
+		OverrunNotify = 2;
+	} else {
+		Endpoint_Write_Word_LE(CDC_CONTROL_LINE_IN_OVERRUNERROR);
+		OverrunNotify = 0;
+	}
+	Endpoint_ClearIN();
+}
+#endif
+
+#ifdef ENABLE_INT_EP
+/** Largest flush that goes out on the interrupt endpoint, 0 = off. */
+static uint8_t IntThreshold;
+
+static inline bool Endpoint_IsIdle(const uint8_t EndpointNumber)
+{
+	Endpoint_SelectEndpoint(EndpointNumber);
+	return !(UESTA0X & ((1 << NBUSYBK1) | (1 << NBUSYBK0)));
+}
+
+/** Picks the IN endpoint for a flush of cnt bytes and leaves it selected: the interrupt one for a
+ *  short reply after the line went quiet, bulk otherwise. Nothing is sent while a packet is still
+ *  waiting on the other endpoint, so the host sees the bytes in order. Returns the most bytes the
+ *  packet may take, 0 if there is no room right now. */
+static uint8_t IntEP_SelectTx(const RingPos_t cnt, const uint8_t flush)
+{
+	if (!Endpoint_IsIdle(INT_IN_EPNUM)) return 0;
+	if (flush && (cnt <= IntThreshold) && Endpoint_IsIdle(CDC_TX_EPNUM)) {
+		Endpoint_SelectEndpoint(INT_IN_EPNUM);
+		return INT_IN_EPSIZE;
+	}
+	return (CDC_Device_SendByte_Prep(&VirtualSerial_CDC_Interface) == 0) ? (CDC_IN_EPSIZE-1) : 0;
+}
+#define TX_PREP(cnt, flush) IntEP_SelectTx(cnt, flush)
+#else
+#define TX_PREP(cnt, flush) ((CDC_Device_SendByte_Prep(&VirtualSerial_CDC_Interface) == 0) ? (CDC_IN_EPSIZE-1) : 0)
+#endif
+
+#ifdef ENABLE_HOST_PRESENCE
+/** An application has the port open: the host set DTR, and has not cleared it since. */
+static bool HostOpen;
+#define HostPresence_Open() HostOpen
+
+/** What comes in while the port is closed is held for the next application, instead of
+ *  dropped as stale: a pre-armed port buffers for it, XON/XOFF stops the target. */
+#ifdef ENABLE_XONXOFF
+#define HostPresence_Keep() ((EEConfig_Flags & EECONFIG_ARMED) || (RxSlow & RX_SLOW_XONXOFF))
+#else
+#define HostPresence_Keep() (EEConfig_Flags & EECONFIG_ARMED)
+#endif
+
+/** At open, drops what the last application left: IN packets it did not read, OUT data that
+ *  did not go out yet. Called before the status stage, the host sends nothing new meanwhile. */
+static void HostPresence_Purge(void)
+{
+	Endpoint_ResetFIFO(CDC_TX_EPNUM);
+#ifdef ENABLE_INT_EP
+	Endpoint_ResetFIFO(INT_IN_EPNUM);
+#endif
+	Endpoint_ResetFIFO(CDC_RX_EPNUM);
+#if !defined(ENABLE_VENDOR_BULK)
+	Endpoint_ResetFIFO(CDC_NOTIFICATION_EPNUM);
+	OverrunNotify = 0;
+#endif
+	ATOMIC_BLOCK(ATOMIC_FORCEON) {
+		UCSR1B &= ~_BV(UDRIE1);
+		USBtoUSART_wrp = USBtoUSART_rdp;
+	}
+}
+#else
+#define HostPresence_Open() 1
+#endif
+
+#ifdef ENABLE_VENDOR_BULK
+/** Sequence number of the next IN packet, see VENDOR_HDR_LEN. */
+static uint8_t VendorSeq;
+#define TX_HDR_LEN VENDOR_HDR_LEN
+#else
+#define TX_HDR_LEN 0
 #endif
 
 /** LUFA CDC Class driver interface configuration and state information. This structure is
@@ -71,6 +342,19 @@ static volatile uint8_t USBtoUSART_wrp = 0;
  */
 USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface;
 
+/** Current SERIAL_MODE_*, the UART bridge unless the host asks otherwise. */
+uint8_t SerialMode;
+
+#ifdef HAVE_TICKS
+/** Timer0 overflows, the high byte of Ticks_Now(). */
+uint8_t TicksHigh;
+#endif
+
+#ifdef ENABLE_DUAL_CONFIG
+/** OCR1A of the throughput configuration, the default or the EEPROM's flush timeout. */
+static uint16_t ThroughputOCR1A;
+#endif
+
 
 /** Main program entry point. This routine contains the overall program flow, including initial
  *  setup of all components and the main program loop.
@@ -78,87 +362,188 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface;
 int main(void)
 {
 	SetupHardware();
-#ifdef DEBUGTX
-	PORTB |= _BV(4);
-	DDRB |= _BV(4);
-#endif
 	/* Clear the GPIOR-based TX register. */
 	USBtoUSART_rdp = 0;
+	/* A pre-armed bridge (see eeconfig.h) buffers while no host is configured, the ring
+	 * and USARTtoUSB_rdp carry over to the next configuration. So do the bytes it dropped
+	 * meanwhile, in USARTtoUSB_Dropped. */
+	bool held = (EEConfig_Flags & EECONFIG_ARMED) && (SerialMode == SERIAL_MODE_UART);
+	RingPos_t USARTtoUSB_rdp = USARTtoUSB_Wrp(); /* A single in is smaller than out and ldi (to clear) */
+	uint8_t drops_seen = 0; /* USARTtoUSB_drops as last added up, it starts at 0 too. */
 	sei();
-	DEBUGB(0xE1);
 	for (;;) {
-		/* We let the TX continue (flush buffer) if it was enabled before we got unconfigured. */
-		ATOMIC_BLOCK(ATOMIC_FORCEON) {
-			UCSR1B &= ~_BV(RXCIE1);
+		/* We let the TX continue (flush buffer) if it was enabled before we got unconfigured.
+		 * But disable RX since there is no longer a PC listening. */
+		if (!held) {
+			ATOMIC_BLOCK(ATOMIC_FORCEON) {
+				UCSR1B &= ~_BV(RXCIE1);
+			}
 		}
-		/* But disable RX since there is no longer a PC listening. */
 		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
 		do {
-			if (Endpoint_IsSETUPReceived())
-			  USB_Device_ProcessControlRequest();
+			if (Endpoint_IsSETUPReceived()) {
+				USB_Device_ProcessControlRequest();
+				TRACE(Trace_Setup());
+			}
+#ifdef ENABLE_XONXOFF
+			/* Buffering with no host, the target is stopped before the ring overflows. */
+			if (held) XonXoff_Task((USARTtoUSB_Wrp() - USARTtoUSB_rdp) & (USART2USB_BUFLEN-1));
+#endif
+			/* Added up as they come, the 8 bit count of the ISR wraps over a long wait. */
+			if (held) {
+				uint8_t drops = USARTtoUSB_drops - drops_seen;
+				drops_seen += drops;
+				USARTtoUSB_Dropped += drops;
+			}
 		} while (USB_DeviceState != DEVICE_STATE_Configured);
-		/* TX might still be transmitting, so be safe when re-enabling RX ISR. */
-		ATOMIC_BLOCK(ATOMIC_FORCEON) {
-			UCSR1B |= _BV(RXCIE1);
+#ifdef HAVE_SERIAL_MODES
+		/* The host picked another mode meanwhile, it uses the ring its own way. */
+		if (held && (SerialMode != SERIAL_MODE_UART)) {
+			held = false;
+			ATOMIC_BLOCK(ATOMIC_FORCEON) {
+				UCSR1B &= ~_BV(RXCIE1);
+			}
+		}
+#endif
+#ifdef ENABLE_ONEWIRE
+		if (SerialMode == SERIAL_MODE_ONEWIRE) {
+			OneWire_Task();
+			continue;
+		}
+#endif
+#ifdef ENABLE_LIN
+		if (SerialMode == SERIAL_MODE_LIN) {
+			Lin_Task();
+			continue;
+		}
+#endif
+#ifdef ENABLE_CAPTURE
+		if (SerialMode == SERIAL_MODE_CAPTURE) {
+			Capture_Task();
+			continue;
+		}
+#endif
+#ifdef ENABLE_AUTOBAUD
+		if (SerialMode == SERIAL_MODE_AUTOBAUD) {
+			Autobaud_Task();
+			continue;
+		}
+#endif
+		if (!held) {
+			/* TX might still be transmitting, so be safe when re-enabling RX ISR. */
+			USARTtoUSB_SetGuard(USARTtoUSB_Wrp());
+			ATOMIC_BLOCK(ATOMIC_FORCEON) {
+				UCSR1B |= _BV(RXCIE1);
+			}
+			USARTtoUSB_rdp = USARTtoUSB_Wrp();
+			USARTtoUSB_SetGuard(USARTtoUSB_rdp);
 		}
 		TIFR0 = _BV(TOV0);
 		TIFR1 = _BV(OCF1A);
+		TRACE(Trace_Write(TRACE_EV_START, 0));
 
 		/** Pulse generation counters to keep track of the number of milliseconds remaining for each pulse type */
 		struct {
 			uint8_t TxLEDPulse; /**< Milliseconds remaining for data Tx LED pulse */
 			uint8_t RxLEDPulse; /**< Milliseconds remaining for data Rx LED pulse */
 		} PulseMSRemaining = { 0,0 };
-		uint8_t last_cnt = 0;
-		uint8_t USARTtoUSB_rdp = USARTtoUSB_wrp; /* A single in is smaller than out and ldi (to clear) */
+		RingPos_t last_cnt = 0;
+		if (!held) {
+			drops_seen = USARTtoUSB_drops;
+			USARTtoUSB_Dropped = 0;
+		}
+		/* The host is told of drops from before it came like of any other. */
+#ifdef ENABLE_VENDOR_BULK
+		uint8_t dropped = USARTtoUSB_Dropped ? VENDOR_STATUS_DROPPED : 0;
+#else
+		OverrunNotify = (USARTtoUSB_Dropped != 0);
+#endif
+		uint8_t rxd = 0; /* Bytes of the OUT packet that did not fit, as of the last look. */
+		LATENCY(Latency_Start(USARTtoUSB_rdp, USBtoUSART_wrp));
+		/* Every pass serves what is due, the stage that loses data first when it waits first:
+		 * the USART to USB ring (a packet's worth, or the flush timer in TIFR1), then an OUT
+		 * packet, the control endpoint and the LED tick (TIFR0). The ring stages move a packet
+		 * at most, so short of a control request a pass is bounded (see ENABLE_PASS_STATS) and
+		 * an IN flush waits for one OUT copy at most. While the ring holds another packet that
+		 * the IN endpoint can take, the OUT packet waits for the next pass instead. */
 		do {
-			uint8_t USBtoUSART_free = (USB2USART_BUFLEN-1) - ( (USBtoUSART_wrp - USBtoUSART_rdp) & (USB2USART_BUFLEN-1) );
-			uint8_t rxd;
-			if ( ((rxd = CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface))) && (rxd <= USBtoUSART_free) ) {
-				uint16_t tmp; //  = 0x200 | USBtoUSART_wrp;
-				DEBUGB(0xE0);
-				DEBUGB(rxd);
-				uint8_t d;
-				asm (
-				"ldi %B0, 0x02\n\t"
-				"lds %A0, %1\n\t"
-				: "=&e" (tmp)
-				: "m" (USBtoUSART_wrp)
-				);
-				do {
-					d = Endpoint_Read_Byte();
-					asm (
-					"st %a0+, %2\n\t"
-					"andi %A0, 0x7F\n\t"
-					: "=e" (tmp)
-					: "0" (tmp), "r" (d)
-					);
-					DEBUGB(d);
-				} while (--rxd);
-				Endpoint_ClearOUT();
-				USBtoUSART_wrp = tmp & 0xFF; /* ASM already clears the lower byte to & 0x7F. */
-				UCSR1B = (_BV(RXCIE1) | _BV(TXEN1) | _BV(RXEN1) | _BV(UDRIE1));
-				goto rxled;
-			} else if (USBtoUSART_wrp != USBtoUSART_rdp) {
-				rxled:
-				LEDs_TurnOnLEDs(LEDMASK_RX);
-				PulseMSRemaining.RxLEDPulse = TX_RX_LED_PULSE_MS;
-			}
-			/* This requires the UART RX buffer to be 256 bytes. */
-			uint8_t cnt = USARTtoUSB_wrp - USARTtoUSB_rdp;
 			uint8_t flush_overflow = TIFR1 & _BV(OCF1A);
 			if (flush_overflow) TIFR1 = _BV(OCF1A);
+			PASS(PassTime_Start());
+			PASS(uint8_t events = 0);
+			LATENCY(Latency_Left(LATENCY_USB_TO_USART, USBtoUSART_rdp));
+			RingPos_t cnt = (USARTtoUSB_Wrp() - USARTtoUSB_rdp) & (USART2USB_BUFLEN-1);
+			uint8_t drops = USARTtoUSB_drops - drops_seen;
+			if (drops) {
+				drops_seen += drops;
+				USARTtoUSB_Dropped += drops;
+#ifdef ENABLE_VENDOR_BULK
+				dropped = VENDOR_STATUS_DROPPED;
+#else
+				if (!OverrunNotify) OverrunNotify = 1;
+#endif
+			}
+#ifdef ENABLE_HOST_PRESENCE
+			/* No application reads what arrives, by the time one does it is stale. So is a drop
+			 * the last one was not told about (HostPresence_Purge() for the notification). */
+			if (!HostOpen && !HostPresence_Keep()) {
+				USARTtoUSB_rdp = USARTtoUSB_POS(USARTtoUSB_rdp + cnt);
+				USARTtoUSB_SetGuard(USARTtoUSB_rdp);
+				LATENCY(Latency_Left(LATENCY_USART_TO_USB, USARTtoUSB_rdp));
+				cnt = 0;
+#ifdef ENABLE_VENDOR_BULK
+				dropped = 0;
+#endif
+			}
+#endif
+#ifdef ENABLE_XONXOFF
+			XonXoff_Task(cnt);
+#endif
+			LATENCY(Latency_Arrived(LATENCY_USART_TO_USB, USARTtoUSB_POS(USARTtoUSB_rdp + cnt)));
 			/* Check if the UART receive buffer flush timer has expired or the buffer is nearly full */
-			if ( ((cnt >= CDC_IN_EPSIZE-1) || (flush_overflow && cnt)) &&
-				(CDC_Device_SendByte_Prep(&VirtualSerial_CDC_Interface) == 0) ) {
+			uint8_t txcnt;
+			uint8_t in_more = 0;
+			if ( ((cnt >= CDC_IN_EPSIZE-1-TX_HDR_LEN) || (flush_overflow && cnt)) && HostPresence_Open() &&
+				((txcnt = TX_PREP(cnt, flush_overflow))) ) {
 				/* Endpoint will always be empty since we're the only writer
 				 * and we flush after every write. */
-				uint8_t txcnt = CDC_IN_EPSIZE-1;
+				txcnt -= TX_HDR_LEN;
 				if (txcnt > cnt) txcnt = cnt;
+#ifdef ENABLE_VENDOR_BULK
+				uint8_t status = 0;
+				if (cnt > txcnt) status |= VENDOR_STATUS_MORE;
+				if (cnt < CDC_IN_EPSIZE-1-TX_HDR_LEN) status |= VENDOR_STATUS_FLUSHED;
+				if (rxd) status |= VENDOR_STATUS_OUT_HELD; /* Still set only if it did not fit. */
+				status |= dropped;
+				dropped = 0;
+				Endpoint_Write_Byte(VendorSeq++);
+				Endpoint_Write_Byte(status);
+#endif
 				last_cnt -= txcnt;
-				DEBUGB(0xE2);
-				DEBUGB(txcnt);
+				/* Another packet is waiting, it goes before the next OUT packet. */
+				in_more = ((cnt - txcnt) >= CDC_IN_EPSIZE-1-TX_HDR_LEN);
+				PASS(events |= PASS_EV_IN);
+				TRACE(Trace_Write((cnt < CDC_IN_EPSIZE-1-TX_HDR_LEN) ? TRACE_EV_IN_FLUSH : TRACE_EV_IN, txcnt));
 				uint16_t tmp;
+#ifdef HOST_BUILD
+				tmp = USARTtoUSB_rdp;
+				do {
+					Endpoint_Write_Byte(USARTtoUSB_BUFFER[tmp & (USART2USB_BUFLEN-1)]);
+					tmp++;
+				} while (--txcnt);
+#else
+#if (USART2USB_BUFLEN > 256)
+				tmp = USARTtoUSB_rdp;
+				do {
+					uint8_t d;
+					asm (
+					"ld %0, %a1+\n\t"
+					"sbrc %B1, %3\n\t" /* Ran off the end, back to the first page. */
+					"ldi %B1, %4\n\t"
+					: "=&r" (d), "=e" (tmp)
+					: "1" (tmp), "I" (USARTtoUSB_WRAP_BIT), "M" (USARTtoUSB_PAGE)
+					);
+#else
 				asm (
 				/* Do not initialize high byte, it will be done on first loop. */
 				"mov %A0, %1\n\t"
@@ -168,37 +553,123 @@ int main(void)
 				do {
 					uint8_t d;
 					asm (
-					"ldi %B1, 0x01\n\t" /* Force high byte */
+					"ldi %B1, %3\n\t" /* Force high byte */
 					"ld %0, %a1+\n\t"
+#if USART2USB_BUFLEN == 128
+					"andi %A1, 0x7F\n\t"
+#endif
 					: "=&r" (d), "=e" (tmp)
-					: "1" (tmp)
+					: "1" (tmp), "M" (USARTtoUSB_PAGE)
 					);
+#endif
        	         	                Endpoint_Write_Byte(d);
-					DEBUGB(d);
 				} while (--txcnt);
+#endif
 		                Endpoint_ClearIN(); /* Go data, GO. */
-				USARTtoUSB_rdp = tmp & 0xFF;
+				USARTtoUSB_rdp = USARTtoUSB_POS(tmp);
+				USARTtoUSB_SetGuard(USARTtoUSB_rdp);
+				LATENCY(Latency_Left(LATENCY_USART_TO_USB, USARTtoUSB_rdp));
 				goto txled;
 			} else if (last_cnt != cnt) {
 				last_cnt = cnt;
 				txled:
+				PASS(PassTime_Restart());
 				TCNT1 = 0;
 				LEDs_TurnOnLEDs(LEDMASK_TX);
 				PulseMSRemaining.TxLEDPulse = TX_RX_LED_PULSE_MS;
 			}
+			uint8_t USBtoUSART_free = (USB2USART_BUFLEN-1) - ( (USBtoUSART_wrp - USBtoUSART_rdp) & (USB2USART_BUFLEN-1) );
+			if ( !in_more && ((rxd = CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface))) && (rxd <= USBtoUSART_free) ) {
+				uint16_t tmp; //  = 0x200 | USBtoUSART_wrp;
+				TRACE(Trace_Out(rxd));
+				PASS(events |= PASS_EV_OUT);
+				uint8_t d;
+				/* Cut-through: with the ring empty the UDRE ISR is off (it turns itself off
+				 * on the last byte), so an idle UART gets the first byte right now instead
+				 * of after the copy and an ISR entry. The rest queues behind it. */
+				if ((USBtoUSART_wrp == USBtoUSART_rdp) && (UCSR1A & _BV(UDRE1)) && !USBtoUSART_Held()) {
+					d = Endpoint_Read_Byte();
+					UDR1 = d;
+					if (!--rxd) {
+						Endpoint_ClearOUT();
+						goto rxled;
+					}
+				}
+#ifdef HOST_BUILD
+				tmp = USBtoUSART_wrp;
+				do {
+					d = Endpoint_Read_Byte();
+					USBtoUSART_BUFFER[tmp] = d;
+					tmp = (tmp + 1) & (USB2USART_BUFLEN-1);
+				} while (--rxd);
+#else
+				asm (
+				"ldi %B0, %2\n\t"
+				"lds %A0, %1\n\t"
+				: "=&e" (tmp)
+				: "m" (USBtoUSART_wrp), "M" (USBtoUSART_PAGE)
+				);
+				do {
+					d = Endpoint_Read_Byte();
+					asm (
+#if USB2USART_BUFLEN == 256
+					"st %a0, %2\n\t"
+					"inc %A0\n\t"
+#else
+					"st %a0+, %2\n\t"
+					"andi %A0, 0x7F\n\t"
+#endif
+					: "=e" (tmp)
+					: "0" (tmp), "r" (d)
+					);
+				} while (--rxd);
+#endif
+				Endpoint_ClearOUT();
+				USBtoUSART_wrp = tmp & 0xFF; /* ASM already wrapped the lower byte. */
+				USBtoUSART_Start();
+				LATENCY(Latency_Arrived(LATENCY_USB_TO_USART, USBtoUSART_wrp));
+				goto rxled;
+			} else if (USBtoUSART_wrp != USBtoUSART_rdp) {
+				rxled:
+				LEDs_TurnOnLEDs(LEDMASK_RX);
+				PulseMSRemaining.RxLEDPulse = TX_RX_LED_PULSE_MS;
+			}
+			TRACE(if (rxd) Trace_OutHeld(rxd)); /* Still set only if it did not fit. */
+			Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+			if (Endpoint_IsSETUPReceived()) {
+				USB_Device_ProcessControlRequest();
+				TRACE(Trace_Setup());
+				PASS(events |= PASS_EV_SETUP);
+			}
 			if (TIFR0 & _BV(TOV0)) { /* LED timer overflow. */
 				TIFR0 = _BV(TOV0);
+				PASS(events |= PASS_EV_TICK);
+#ifdef HAVE_TICKS
+				TicksHigh++;
+#endif
 				/* Turn off TX LED(s) once the TX pulse period has elapsed */
 				if (PulseMSRemaining.TxLEDPulse && !(--PulseMSRemaining.TxLEDPulse))
 				  LEDs_TurnOffLEDs(LEDMASK_TX);
 				if (PulseMSRemaining.RxLEDPulse && !(--PulseMSRemaining.RxLEDPulse))
 				  LEDs_TurnOffLEDs(LEDMASK_RX);
+#ifdef ENABLE_AUX_CDC
+				AuxCDC_Task();
+#endif
+#if !defined(ENABLE_VENDOR_BULK)
+				if (OverrunNotify) OverrunNotify_Task();
+#endif
 			}
-			Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
-			if (Endpoint_IsSETUPReceived())
-			  USB_Device_ProcessControlRequest();
-
+#ifdef HAVE_SERIAL_MODES
+			/* Other modes run their own loop, see the top of the outer loop. Checked on
+			 * every pass since the host (SETUP) and the console (tick) can both pick one. */
+			if (SerialMode != SERIAL_MODE_UART) break;
+#endif
+			PASS(PassTime_End(events));
 		} while (USB_DeviceState == DEVICE_STATE_Configured);
+		TRACE(Trace_Write(TRACE_EV_STOP, USB_DeviceState));
+		held = (EEConfig_Flags & EECONFIG_ARMED) && (SerialMode == SERIAL_MODE_UART);
+		/* The next host of a held port gets what is dropped from now on. */
+		if (held) USARTtoUSB_Dropped = 0;
 		/* Dont forget LEDs on if suddenly unconfigured. */
 		LEDs_TurnOffLEDs(LEDMASK_TX);
 		LEDs_TurnOffLEDs(LEDMASK_RX);
@@ -212,6 +683,11 @@ void SetupHardware(void)
 	MCUSR &= ~(1 << WDRF);
 	wdt_disable();
 
+#if (USART2USB_BUFLEN > 256)
+	/* The RX ISR writes wherever GPIOR1/GPIOR2 point. */
+	USARTtoUSB_wrp_page = USARTtoUSB_PAGE;
+#endif
+
 	/* Hardware Initialization */
 	Serial_Init(9600, false);
 	LEDs_Init();
@@ -219,12 +695,25 @@ void SetupHardware(void)
 
 	/* Timer0 is the LED timeout timer... */
 	TCCR0B = _BV(CS02);
+#ifdef ENABLE_PROFILE
+	/* ...and clocks the profiler on compare B. */
+	Profile_Init();
+#endif
 
 	/* Timer1 is the USB flush timeout timer. */
 	OCR1A = 8000; // 0.5ms at 16Mhz
 	TCCR1A = 0;
 	TCCR1B = _BV(WGM12) | _BV(CS10);
 
+	/* Pre-armed from the EEPROM: the USART to USB ring buffers from the first byte. */
+	if (EEConfig_Load()) {
+		USARTtoUSB_SetGuard(USARTtoUSB_Wrp());
+		EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+	}
+#ifdef ENABLE_DUAL_CONFIG
+	ThroughputOCR1A = OCR1A;
+#endif
+
 	/* Pull target /RESET line high */
 	AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
 	AVR_RESET_LINE_DDR  |= AVR_RESET_LINE_MASK;
@@ -233,13 +722,250 @@ void SetupHardware(void)
 /** Event handler for the library USB Configuration Changed event. */
 void EVENT_USB_Device_ConfigurationChanged(void)
 {
+#ifdef ENABLE_PARMRK
+	/* A new session starts with the plain stream. */
+	RxSlow_Set(RX_SLOW_PARMRK, false);
+#endif
+#ifdef ENABLE_HOST_PRESENCE
+	/* Open once the host sets DTR. */
+	HostOpen = false;
+#endif
+#ifdef ENABLE_INT_EP
+	/* Endpoints must be configured in ascending order, their DPRAM is allocated in that order. */
+	Endpoint_ConfigureEndpoint(INT_IN_EPNUM, EP_TYPE_INTERRUPT, ENDPOINT_DIR_IN,
+	                           INT_IN_EPSIZE, ENDPOINT_BANK_SINGLE);
+#ifdef ENABLE_DUAL_CONFIG
+	IntThreshold = (USB_ConfigurationNumber == CONFIG_LATENCY) ? INT_IN_EPSIZE : 0;
+#else
+	IntThreshold = 0;
+#endif
+#endif
+#ifdef ENABLE_DUAL_CONFIG
+	/* Capture and LIN keep their own tick until they end. TCNT1 restarts so it is below the new TOP. */
+	if (SerialMode == SERIAL_MODE_UART) {
+		OCR1A = (USB_ConfigurationNumber == CONFIG_LATENCY) ?
+		        ((F_CPU / 1000000) * CONFIG_LATENCY_FLUSH_US - 1) : ThroughputOCR1A;
+		TCNT1 = 0;
+	}
+#endif
+#ifdef ENABLE_VENDOR_BULK
+	VendorSeq = 0;
+#endif
+#ifdef ENABLE_AUX_CDC
+	Endpoint_ConfigureEndpoint(AUX_RX_EPNUM, EP_TYPE_BULK, ENDPOINT_DIR_OUT,
+	                           AUX_EPSIZE, ENDPOINT_BANK_SINGLE);
+#endif
+	/* That clears the CDC state, a pre-armed port keeps running with its line coding. */
+	uint8_t coding[sizeof(VirtualSerial_CDC_Interface.State.LineEncoding)];
+	memcpy(coding, &VirtualSerial_CDC_Interface.State.LineEncoding, sizeof(coding));
 	CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
+	if (EEConfig_Flags & EECONFIG_ARMED)
+	  memcpy(&VirtualSerial_CDC_Interface.State.LineEncoding, coding, sizeof(coding));
+#ifdef ENABLE_AUX_CDC
+	AuxCDC_ConfigureEndpoints();
+#endif
+}
+
+/** Tells if Mode is a SERIAL_MODE_* built into this firmware. */
+bool SerialMode_Supported(const uint8_t Mode)
+{
+	switch (Mode) {
+		case SERIAL_MODE_UART:
+#ifdef ENABLE_ONEWIRE
+		case SERIAL_MODE_ONEWIRE:
+#endif
+#ifdef ENABLE_LIN
+		case SERIAL_MODE_LIN:
+#endif
+#ifdef ENABLE_CAPTURE
+		case SERIAL_MODE_CAPTURE:
+#endif
+#ifdef ENABLE_AUTOBAUD
+		case SERIAL_MODE_AUTOBAUD:
+#endif
+			return true;
+	}
+	return false;
+}
+
+/** Handles the VENDOR_REQ_* control requests, see fast-usbserial.h. */
+static void Vendor_ProcessControlRequest(void)
+{
+	switch (USB_ControlRequest.bRequest)
+	{
+		case VENDOR_REQ_SetMode:
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+			    SerialMode_Supported(USB_ControlRequest.wValue))
+			{
+				Endpoint_ClearSETUP();
+				SerialMode = USB_ControlRequest.wValue;
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case VENDOR_REQ_GetMode:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Byte(SerialMode);
+				Endpoint_ClearIN();
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+#ifdef ENABLE_PARMRK
+		case VENDOR_REQ_SetParmrk:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				RxSlow_Set(RX_SLOW_PARMRK, USB_ControlRequest.wValue != 0);
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+#endif
+#ifdef ENABLE_XONXOFF
+		case VENDOR_REQ_SetFlow:
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+			    (USB_ControlRequest.wValue <= EECONFIG_FLOW_XONXOFF))
+			{
+				Endpoint_ClearSETUP();
+				XonXoff_Set(USB_ControlRequest.wValue == EECONFIG_FLOW_XONXOFF);
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+#endif
+#ifdef ENABLE_INT_EP
+		case VENDOR_REQ_SetIntThreshold:
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+			    (USB_ControlRequest.wValue <= INT_IN_EPSIZE))
+			{
+				Endpoint_ClearSETUP();
+				IntThreshold = USB_ControlRequest.wValue;
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case VENDOR_REQ_IntWrite:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				uint8_t len = USB_ControlRequest.wLength;
+				uint8_t USBtoUSART_free = (USB2USART_BUFLEN-1) - ( (USBtoUSART_wrp - USBtoUSART_rdp) & (USB2USART_BUFLEN-1) );
+				if ((SerialMode != SERIAL_MODE_UART) || !VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS ||
+				    (USB_ControlRequest.wLength > INT_WRITE_MAXLEN) || (len > USBtoUSART_free))
+				  break;
+
+				uint8_t buf[INT_WRITE_MAXLEN];
+				Endpoint_ClearSETUP();
+				Endpoint_Read_Control_Stream_LE(buf, len);
+				Endpoint_ClearIN();
+				if (len) {
+					uint8_t wrp = USBtoUSART_wrp;
+					for (uint8_t i = 0; i < len; i++) {
+						USBtoUSART_BUFFER[wrp] = buf[i];
+						wrp = (wrp + 1) & (USB2USART_BUFLEN-1);
+					}
+					USBtoUSART_wrp = wrp;
+					USBtoUSART_Start();
+				}
+			}
+
+			break;
+#endif
+#ifdef ENABLE_LATENCY_STATS
+		case VENDOR_REQ_GetLatency:
+			Latency_ProcessControlRequest();
+			break;
+#endif
+#ifdef ENABLE_TRACE
+		case VENDOR_REQ_GetTrace:
+			Trace_ProcessControlRequest();
+			break;
+#endif
+#ifdef ENABLE_PROFILE
+		case VENDOR_REQ_GetProfile:
+		case VENDOR_REQ_SetProfile:
+			Profile_ProcessControlRequest();
+			break;
+#endif
+#ifdef ENABLE_STACK_STATS
+		case VENDOR_REQ_GetStackUse:
+			StackUse_ProcessControlRequest();
+			break;
+#endif
+#ifdef ENABLE_PASS_STATS
+		case VENDOR_REQ_GetPassTime:
+			PassTime_ProcessControlRequest();
+			break;
+#endif
+		case VENDOR_REQ_GetConfig:
+		case VENDOR_REQ_SetConfig:
+			EEConfig_ProcessControlRequest();
+			break;
+#ifdef ENABLE_AUTOBAUD
+		case VENDOR_REQ_GetAutobaud:
+			Autobaud_ProcessControlRequest();
+			break;
+#endif
+		case VENDOR_REQ_GetDropped:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_DWord_LE(USARTtoUSB_Dropped);
+				Endpoint_ClearIN();
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+#ifdef ENABLE_VENDOR_BULK
+		case VENDOR_REQ_SetLineCoding:
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+			    (USB_ControlRequest.wLength == sizeof(VirtualSerial_CDC_Interface.State.LineEncoding)))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Read_Control_Stream_LE(&VirtualSerial_CDC_Interface.State.LineEncoding,
+				                                sizeof(VirtualSerial_CDC_Interface.State.LineEncoding));
+				EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+				Endpoint_ClearIN();
+			}
+
+			break;
+		case VENDOR_REQ_GetLineCoding:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&VirtualSerial_CDC_Interface.State.LineEncoding,
+				                                 sizeof(VirtualSerial_CDC_Interface.State.LineEncoding));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case VENDOR_REQ_SetControlLines:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				VirtualSerial_CDC_Interface.State.ControlLineStates.HostToDevice = USB_ControlRequest.wValue;
+				EVENT_CDC_Device_ControLineStateChanged(&VirtualSerial_CDC_Interface);
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+#endif
+	}
 }
 
 /** Event handler for the library USB Unhandled Control Request event. */
 void EVENT_USB_Device_UnhandledControlRequest(void)
 {
-	CDC_Device_ProcessControlRequest(&VirtualSerial_CDC_Interface);
+	if ((USB_ControlRequest.bmRequestType & CONTROL_REQTYPE_TYPE) == REQTYPE_VENDOR)
+	  Vendor_ProcessControlRequest();
+	else
+	  CDC_Device_ProcessControlRequest(&VirtualSerial_CDC_Interface);
+#ifdef ENABLE_AUX_CDC
+	/* A no-op if the first port took the request. */
+	CDC_Device_ProcessControlRequest(&AuxSerial_CDC_Interface);
+#endif
 }
 
 /** Event handler for the CDC Class driver Line Encoding Changed event.
@@ -250,6 +976,20 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
 {
 	uint8_t ConfigMask = 0;
 
+#ifdef ENABLE_AUX_CDC
+	/* The console has no UART behind it. */
+	if (CDCInterfaceInfo == &AuxSerial_CDC_Interface) return;
+#endif
+	/* A fixed line coding (see eeconfig.h) stays, and a running bridge is left alone. */
+	if (EEConfig_Flags & EECONFIG_FLAG_FIXED) {
+		EEConfig_FixedLineEncoding();
+		if ((SerialMode == SERIAL_MODE_UART) && (UCSR1B & _BV(RXCIE1))) return;
+	}
+
+	/* 1-Wire picks its own bit rates and autobaud listens with the USART off,
+	 * the line coding is applied when we get back. */
+	if ((SerialMode == SERIAL_MODE_ONEWIRE) || (SerialMode == SERIAL_MODE_AUTOBAUD)) return;
+
 	switch (CDCInterfaceInfo->State.LineEncoding.ParityType)
 	{
 		case CDC_PARITY_Odd:
@@ -304,22 +1044,165 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
 	UBRR1 = brr;
 	UCSR1C = ConfigMask;
 	UCSR1A = sreg;
-	UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+	/* Only the UART bridge runs on the ring ISRs, the other modes poll. */
+	if (SerialMode == SERIAL_MODE_UART)
+	  UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+	else
+	  UCSR1B = ((1 << TXEN1) | (1 << RXEN1));
+}
+
+#ifdef HAVE_RX_SLOW_PATH
+/* The RX ISR with RX_SLOW_ON. The error bits have to be read before the byte. The target's
+ * XON and XOFF start and stop the UDRE ISR right here, they are not data. A marked byte takes
+ * up to three slots, and while marking every byte needs room for three: once one is dropped
+ * the ones after it are too until the main loop makes room, and the gap stays in one piece. */
+static inline void USARTtoUSB_SlowByte(void)
+{
+	uint8_t status = UCSR1A;
+	uint8_t d = UDR1;
+#ifdef ENABLE_XONXOFF
+	if ((RxSlow & RX_SLOW_XONXOFF) && !(status & (_BV(FE1) | _BV(UPE1)))) {
+		if (d == XOFF) {
+			XonXoff_Stopped = 1;
+			UCSR1B &= ~_BV(UDRIE1);
+			return;
+		}
+		if (d == XON) {
+			XonXoff_Stopped = 0;
+			if (!(XonXoff_Out & XONXOFF_PENDING) && (USBtoUSART_wrp != USBtoUSART_rdp))
+			  UCSR1B |= _BV(UDRIE1);
+			return;
+		}
+	}
+#endif
+	RingPos_t wrp = USARTtoUSB_Wrp();
+	uint8_t n = 1, room = 1;
+#ifdef ENABLE_PARMRK
+	if (RxSlow & RX_SLOW_PARMRK) {
+		n = (status & (_BV(FE1) | _BV(UPE1))) ? 3 : (d == 0xFF) ? 2 : 1;
+		room = 3;
+	}
+#endif
+	if (((USARTtoUSB_Guard() - wrp) & (USART2USB_BUFLEN-1)) < room) {
+		USARTtoUSB_drops++;
+		return;
+	}
+	if (n > 1) {
+		USARTtoUSB_BUFFER[wrp & (USART2USB_BUFLEN-1)] = 0xFF;
+		wrp = USARTtoUSB_POS(wrp + 1);
+	}
+	if (n > 2) {
+		USARTtoUSB_BUFFER[wrp & (USART2USB_BUFLEN-1)] = 0x00;
+		wrp = USARTtoUSB_POS(wrp + 1);
+	}
+	USARTtoUSB_BUFFER[wrp & (USART2USB_BUFLEN-1)] = d;
+	wrp = USARTtoUSB_POS(wrp + 1);
+	USARTtoUSB_wrp = wrp;
+#if (USART2USB_BUFLEN > 256)
+	USARTtoUSB_wrp_page = wrp >> 8;
+#endif
 }
+#endif
+
+#ifdef HOST_BUILD
+/* What the ISRs below do, for the host build (see host/). */
+ISR(USART1_RX_vect)
+{
+#ifdef HAVE_RX_SLOW_PATH
+	if (RxSlow & RX_SLOW_ON) {
+		USARTtoUSB_SlowByte();
+		return;
+	}
+#endif
+	RingPos_t wrp = USARTtoUSB_Wrp();
+	uint8_t d = UDR1;
+	if (wrp == USARTtoUSB_guard) {
+		USARTtoUSB_drops++;
+		return;
+	}
+	USARTtoUSB_BUFFER[wrp & (USART2USB_BUFLEN-1)] = d;
+	wrp = USARTtoUSB_POS(wrp + 1);
+	USARTtoUSB_wrp = wrp;
+#if (USART2USB_BUFLEN > 256)
+	USARTtoUSB_wrp_page = wrp >> 8;
+#endif
+}
+
+ISR(USART1_UDRE_vect)
+{
+	uint8_t rdp = USBtoUSART_rdp;
+	UDR1 = USBtoUSART_BUFFER[rdp];
+	USBtoUSART_rdp = rdp = (rdp + 1) & (USB2USART_BUFLEN-1);
+	if (rdp == USBtoUSART_wrp)
+	  UCSR1B = (_BV(RXCIE1) | _BV(TXEN1) | _BV(RXEN1));
+}
+#else
+#ifdef HAVE_RX_SLOW_PATH
+/* Where the RX vector jumps to with RX_SLOW_ON, a plain ISR that saves SREG. The
+ * __vector prefix keeps avr-gcc from taking it for a misspelled vector name. */
+#define USART1_RX_SLOW_vect  __vector_usart1_rx_slow
+#define USART1_RX_SLOW_NAME  "__vector_usart1_rx_slow"
+ISR(USART1_RX_SLOW_vect, __attribute__((used)))
+{
+	USARTtoUSB_SlowByte();
+}
+#endif
 
 ISR(USART1_RX_vect, ISR_NAKED)
 {
 	/* This ISR doesnt change SREG. Whoa. */
 	asm volatile (
+#ifdef HAVE_RX_SLOW_PATH
+	"lds r3, %6\n\t" // RxSlow, 5 cycles with the sbrc while it is off.
+	"sbrc r3, 0\n\t" // RX_SLOW_ON
+	"jmp " USART1_RX_SLOW_NAME "\n\t"
+#endif
 	"lds r3, %0\n\t" // UDR1
 	"movw r4, r30\n\t"
 	"in r30, %1\n\t" // USARTtoUSB_wrp
-	"ldi r31, 0x01\n\t"
+#if (USART2USB_BUFLEN > 256)
+	"in r31, %3\n\t" // USARTtoUSB_wrp_page
+	"cpse r30, r6\n\t" // At the guard, the ring is full.
+	"rjmp 1f\n\t"
+	"cpse r31, r7\n\t"
+	"rjmp 1f\n\t"
+#else
+	"ldi r31, %2\n\t"
+	"cpse r30, r6\n\t" // At the guard, the ring is full.
+	"rjmp 1f\n\t"
+#endif
+	"lds r30, %5\n\t" // USARTtoUSB_drops++, Z+ counts without SREG (Z points into the ring page).
+	"ld r3, Z+\n\t"
+	"sts %5, r30\n\t"
+	"movw r30, r4\n\t"
+	"reti\n\t"
+	"1:\n\t"
+#if (USART2USB_BUFLEN > 256)
 	"st Z+, r3\n\t"
+	"sbrc r31, %4\n\t" // Wrap without touching SREG either.
+	"ldi r31, %2\n\t"
+	"out %1, r30\n\t"
+	"out %3, r31\n\t"
+#else
+	"st Z+, r3\n\t"
+#if USART2USB_BUFLEN == 128
+	"sbrc r30, 7\n\t" // Off the end, back to the start. GPIOR1 is past the reach of cbi.
+	"ldi r30, 0\n\t"
+#endif
 	"out %1, r30\n\t"
+#endif
 	"movw r30, r4\n\t"
 	"reti\n\t"
-	:: "m" (UDR1), "I" (_SFR_IO_ADDR(USARTtoUSB_wrp))
+	:: "m" (UDR1), "I" (_SFR_IO_ADDR(USARTtoUSB_wrp)), "M" (USARTtoUSB_PAGE)
+#if (USART2USB_BUFLEN > 256)
+	 , "I" (_SFR_IO_ADDR(USARTtoUSB_wrp_page)), "I" (USARTtoUSB_WRAP_BIT)
+#else
+	 , "n" (0), "n" (0)
+#endif
+	 , "m" (USARTtoUSB_drops)
+#ifdef HAVE_RX_SLOW_PATH
+	 , "m" (RxSlow)
+#endif
 	);
 }
 
@@ -329,11 +1212,13 @@ ISR(USART1_UDRE_vect, ISR_NAKED)
 	asm volatile (
 	"movw r4, r30\n\t"
 	"in r30, %1\n\t" // USBtoUSART_rdp
-	"ldi r31, 0x02\n\t"
+	"ldi r31, %4\n\t"
 	"ld r3, Z+\n\t"
 	"sts %0, r3\n\t"
 	"out %1, r30\n\t"
+#if USB2USART_BUFLEN == 128
 	"cbi %1, 7\n\t" // smart after-the-fact andi 0x7F without using SREG :P
+#endif
 	"movw r30, r4\n\t"
 	"in r2, %1\n\t"
 	"lds r3, %2\n\t" // USBtoUSART_wrp
@@ -343,9 +1228,10 @@ ISR(USART1_UDRE_vect, ISR_NAKED)
 	"sts %3, r30\n\t"
 	"movw r30, r4\n\t"
 	"reti\n\t"
-	:: "m" (UDR1), "I" (_SFR_IO_ADDR(USBtoUSART_rdp)), "m" (USBtoUSART_wrp), "m" (UCSR1B)
+	:: "m" (UDR1), "I" (_SFR_IO_ADDR(USBtoUSART_rdp)), "m" (USBtoUSART_wrp), "m" (UCSR1B), "M" (USBtoUSART_PAGE)
 	);
 }
+#endif
 
 /** Event handler for the CDC Class driver Host-to-Device Line Encoding Changed event.
  *
@@ -355,8 +1241,19 @@ void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const C
 {
 	bool CurrentDTRState = (CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR);
 
+#ifdef ENABLE_AUX_CDC
+	if (CDCInterfaceInfo == &AuxSerial_CDC_Interface) return;
+#endif
+
 	if (CurrentDTRState)
 	  AVR_RESET_LINE_PORT &= ~AVR_RESET_LINE_MASK;
 	else
 	  AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
+
+#ifdef ENABLE_HOST_PRESENCE
+	/* The new application starts with live data. */
+	if (CurrentDTRState && !HostOpen && !HostPresence_Keep() && (SerialMode == SERIAL_MODE_UART))
+	  HostPresence_Purge();
+	HostOpen = CurrentDTRState;
+#endif
 }
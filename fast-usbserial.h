@@ -63,8 +63,224 @@
 		/** LED mask for the library LED driver, to indicate that the USB interface is busy. */
 		#define LEDMASK_BUSY             (LEDS_LED1 | LEDS_LED2)
 
+		/** SRAM pages of the ring buffers, sized from the SRAM of the part (see the linker magic note in
+		 *  fast-usbserial.c, the Makefile moves .data past them per MCU).
+		 *
+		 *  On the 512 byte parts (ATmega8U2/16U2) there are 256 bytes at 0x100 and 128 at 0x200. By
+		 *  default the big one takes the USART to USB data, for logging; BIG_UART_TX_RING gives it to
+		 *  the USB to USART data instead, for uploads to the target.
+		 *
+		 *  The bigger parts give USART to USB, the direction that has to ride out the host not polling,
+		 *  all they can: 512 bytes on the ATmega32U2, 1KB on the ATmega32U4, aligned to their size so
+		 *  the RX ISR still wraps without touching SREG (see USARTtoUSB_WRAP_BIT). USB to USART gets
+		 *  256 bytes at 0x100, the host does not send more than fits anyway.
+		 *
+		 *  The alignment leaves the ATmega32U4 a hole at 0x200-0x3FF: its 1KB ring can only start at
+		 *  0x400, at 0x800 it would run past RAMEND (0xAFF). .data/.bss go in the hole, so the stack
+		 *  gets all of 0x800-0xAFF above the ring (STACK_BOTTOM). The ATmega32U4 build is untested:
+		 *  it has not been linked or run on a board yet. */
+		#if (RAMEND > 0x7FF)
+			#define USARTtoUSB_PAGE          0x04
+			#define USART2USB_BUFLEN         1024
+			#define USBtoUSART_PAGE          0x01
+			#define USB2USART_BUFLEN         256
+			/** Lowest address of the stack when .data/.bss are not right below it. */
+			#define STACK_BOTTOM             0x800
+		#elif (RAMEND > 0x2FF)
+			#define USARTtoUSB_PAGE          0x02
+			#define USART2USB_BUFLEN         512
+			#define USBtoUSART_PAGE          0x01
+			#define USB2USART_BUFLEN         256
+		#elif defined(BIG_UART_TX_RING)
+			#define USARTtoUSB_PAGE          0x02
+			#define USART2USB_BUFLEN         128
+			#define USBtoUSART_PAGE          0x01
+			#define USB2USART_BUFLEN         256
+		#else
+			#define USARTtoUSB_PAGE          0x01
+			#define USART2USB_BUFLEN         256
+			#define USBtoUSART_PAGE          0x02
+			#define USB2USART_BUFLEN         128
+		#endif
+
+		#if (USART2USB_BUFLEN > 256)
+			/** The USART to USB write pointer is an SRAM address (low byte in GPIOR1, page in GPIOR2),
+			 *  this bit of the page is set once it runs off the end of the ring. */
+			#define USARTtoUSB_WRAP_BIT      ((USART2USB_BUFLEN == 1024) ? 3 : 2)
+			#if defined(BIG_UART_TX_RING)
+				#error BIG_UART_TX_RING is for the 512 byte parts, this one has 256 bytes for USB to USART already.
+			#endif
+			#if defined(DEVICE_STATE_AS_GPIOR) && (DEVICE_STATE_AS_GPIOR == 2)
+				#error GPIOR2 holds the USART to USB write pointer on this part, drop DEVICE_STATE_AS_GPIOR.
+			#endif
+		#endif
+
+		/** Fixed SRAM location of the USART to USB ring buffer. Modes that do not run the UART ISRs may
+		 *  borrow it as scratch space, as well as the other one, at most 128 bytes of each. */
+		#if !defined(HOST_BUILD)
+			#define USARTtoUSB_BUFFER        ((uint8_t*)(USARTtoUSB_PAGE << 8))
+		#else
+			#define USARTtoUSB_BUFFER        (&mock_sram[USARTtoUSB_PAGE << 8])
+		#endif
+
+		/** Fixed SRAM location of the USB to USART ring buffer. */
+		#if !defined(HOST_BUILD)
+			#define USBtoUSART_BUFFER        ((uint8_t*)(USBtoUSART_PAGE << 8))
+		#else
+			#define USBtoUSART_BUFFER        (&mock_sram[USBtoUSART_PAGE << 8])
+		#endif
+
+		/** Serial port modes, selected by the host with \ref VENDOR_REQ_SetMode. */
+		#define SERIAL_MODE_UART         0 /**< Plain USB to UART bridge, the default. */
+		#define SERIAL_MODE_ONEWIRE      1 /**< 1-Wire bus master, see onewire.h. */
+		#define SERIAL_MODE_LIN          2 /**< LIN bus master/slave, see lin.h. */
+		#define SERIAL_MODE_CAPTURE      3 /**< Timestamped receive capture, see capture.h. */
+		#define SERIAL_MODE_AUTOBAUD     4 /**< Finds the rate of the RX line, see autobaud.h. */
+
+		#if defined(ENABLE_ONEWIRE) || defined(ENABLE_LIN) || defined(ENABLE_CAPTURE) || defined(ENABLE_AUTOBAUD)
+			#define HAVE_SERIAL_MODES
+		#endif
+
+		/* The RX ISR has more to do than copy the byte, when the host asks for it. */
+		#if defined(ENABLE_PARMRK) || defined(ENABLE_XONXOFF)
+			#define HAVE_RX_SLOW_PATH
+		#endif
+
+		/** Flush timeout of the latency configuration (ENABLE_DUAL_CONFIG, see CONFIG_LATENCY): what
+		 *  the USART brought goes out once the line is quiet for this long, instead of the 0.5ms (or
+		 *  the EEPROM's, see eeconfig.h) that the throughput configuration waits to fill a packet.
+		 *  With ENABLE_INT_EP short replies take the interrupt endpoint there from the start, as if
+		 *  VENDOR_REQ_SetIntThreshold had asked for INT_IN_EPSIZE. */
+		#define CONFIG_LATENCY_FLUSH_US  50
+
+		/** Instrumentation that needs a clock, see Ticks_Now(). */
+		#if defined(ENABLE_LATENCY_STATS) || defined(ENABLE_TRACE)
+			#define HAVE_TICKS
+		#endif
+
+		#if defined(ENABLE_LATENCY_STATS) && defined(ENABLE_TRACE)
+			#error ENABLE_LATENCY_STATS and ENABLE_TRACE do not fit in the RAM the ring buffers leave, pick one.
+		#endif
+		#if defined(ENABLE_PROFILE) && defined(HAVE_TICKS)
+			#error ENABLE_PROFILE does not fit in RAM together with ENABLE_LATENCY_STATS or ENABLE_TRACE.
+		#endif
+
+		/** Vendor specific control requests, addressed to the device as a whole so that they can be
+		 *  issued while the CDC driver of the host owns the interfaces. */
+		#define VENDOR_REQ_SetMode       0x01 /**< wValue is the new SERIAL_MODE_* value. */
+		#define VENDOR_REQ_GetMode       0x02 /**< Returns the current SERIAL_MODE_* value as one byte. */
+
+		/** With ENABLE_INT_EP: wValue is the largest reply (at most INT_IN_EPSIZE bytes) that is sent on the
+		 *  interrupt IN endpoint instead of the bulk one once the line goes quiet, 0 (the default) turns
+		 *  the interrupt endpoint off. Set it only while reading that endpoint. */
+		#define VENDOR_REQ_SetIntThreshold 0x03
+
+		/** With ENABLE_INT_EP: the data stage (at most INT_WRITE_MAXLEN bytes) is queued for the USART as
+		 *  if it came in on the bulk OUT endpoint. Control transfers have bandwidth reserved in every frame,
+		 *  which is what the interrupt OUT endpoint we have no room for would have given. Stalls if it
+		 *  does not fit in the ring buffer. */
+		#define VENDOR_REQ_IntWrite      0x04
+
+		#define INT_WRITE_MAXLEN         16
+
+		/** With ENABLE_VENDOR_BULK: line coding requests for the vendor class interface, same data and
+		 *  wValue as the CDC SET_LINE_CODING, GET_LINE_CODING and SET_CONTROL_LINE_STATE requests. The
+		 *  serial port stays closed until the first SetLineCoding, like with CDC. With
+		 *  ENABLE_HOST_PRESENCE nothing comes IN until SetControlLines sets DTR. */
+		#define VENDOR_REQ_SetLineCoding 0x05
+		#define VENDOR_REQ_GetLineCoding 0x06
+		#define VENDOR_REQ_SetControlLines 0x07
+
+		/** With ENABLE_VENDOR_BULK every IN packet starts with a sequence number, incremented per packet
+		 *  so the host sees lost or reordered transfers, and a VENDOR_STATUS_* byte. OUT packets are plain
+		 *  data. Packets stay below 64 bytes, so every one ends a transfer. */
+		#define VENDOR_HDR_LEN           2
+
+		#define VENDOR_STATUS_MORE       (1 << 0) /**< More data was waiting when this packet was sent. */
+		#define VENDOR_STATUS_FLUSHED    (1 << 1) /**< Sent by the flush timer, the line went quiet. */
+		#define VENDOR_STATUS_OUT_HELD   (1 << 2) /**< The last OUT packet is held back, the USART ring is full. */
+		#define VENDOR_STATUS_DROPPED    (1 << 3) /**< Received bytes were dropped before this data, see VENDOR_REQ_GetDropped. */
+
+		/** With ENABLE_LATENCY_STATS: returns the device residence time histograms, see latency.h. */
+		#define VENDOR_REQ_GetLatency    0x08
+
+		/** With ENABLE_TRACE: returns and removes the oldest trace records, see trace.h. */
+		#define VENDOR_REQ_GetTrace      0x09
+
+		/** With ENABLE_PROFILE: return the PC sample histogram, or clear it and move its window, see
+		 *  profile.h. */
+		#define VENDOR_REQ_GetProfile    0x0A
+		#define VENDOR_REQ_SetProfile    0x0B
+
+		/** With ENABLE_STACK_STATS: returns the stack region size and high-water mark, see stackuse.h. */
+		#define VENDOR_REQ_GetStackUse   0x0C
+
+		/** Returns the number of received bytes dropped since the port was configured because the USART
+		 *  to USB ring was full, 32 bits little endian. A port pre-armed by eeconfig.h also counts those
+		 *  it dropped while no host was configured. The newest bytes are the ones dropped. CDC hosts
+		 *  also get a SERIAL_STATE notification with the overrun bit (TIOCGICOUNT on Linux), vendor
+		 *  bulk hosts VENDOR_STATUS_DROPPED in the next IN packet. */
+		#define VENDOR_REQ_GetDropped    0x0D
+
+		/** With ENABLE_PASS_STATS: returns the longest main loop passes, see passtime.h. */
+		#define VENDOR_REQ_GetPassTime   0x0E
+
+		/** Return or write the default configuration in the EEPROM, see eeconfig.h. */
+		#define VENDOR_REQ_GetConfig     0x0F
+		#define VENDOR_REQ_SetConfig     0x10
+
+		/** With ENABLE_AUTOBAUD: returns the rate the autobaud mode found, see autobaud.h. */
+		#define VENDOR_REQ_GetAutobaud   0x11
+
+		/** With ENABLE_PARMRK: wValue 1 marks the received bytes with a parity or framing error
+		 *  in the USART to USB stream, as Linux does with PARMRK: 0xFF 0x00 and the byte, a break
+		 *  comes as 0xFF 0x00 0x00, and a good 0xFF as 0xFF 0xFF. 0 turns it off, so does a new
+		 *  configuration. The RX ISR saves SREG while it is on, it is off at 5 cycles a byte. */
+		#define VENDOR_REQ_SetParmrk     0x12
+
+		/** With ENABLE_XONXOFF: wValue is the EECONFIG_FLOW_* of the port. With XON/XOFF an XOFF
+		 *  from the target stops what goes to it within a character (the one in UDR1 still goes),
+		 *  XON starts it again; both are taken out of the stream to the host. The target gets XOFF
+		 *  as the USART to USB ring fills to 3/4 and XON once it is down to 1/4, ahead of the data
+		 *  queued for it. Off by default, EEConfig_Data_t.Flow sets it at power-up. */
+		#define VENDOR_REQ_SetFlow       0x13
+
+	/* Type Defines: */
+		/** A position in the USART to USB ring: the low byte of its address, or all of it where the
+		 *  ring is bigger than 256 bytes. Differences masked with USART2USB_BUFLEN-1 are byte counts. */
+		#if (USART2USB_BUFLEN > 256)
+			typedef uint16_t RingPos_t;
+		#else
+			typedef uint8_t RingPos_t;
+		#endif
+
+	/* External Variables: */
+		extern USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface;
+		extern uint8_t SerialMode;
+		#if defined(HAVE_TICKS)
+		extern uint8_t TicksHigh;
+		#endif
+
+	/* Inline Functions: */
+		#if defined(HAVE_TICKS)
+		/** Timer0 (16us ticks at 16MHz) extended to 16 bits, it wraps after about a second. The LED tick
+		 *  of the UART loop counts the overflows, so it only keeps time while that loop runs. */
+		static inline uint16_t Ticks_Now(void)
+		{
+			uint8_t lo = TCNT0;
+			uint8_t hi = TicksHigh;
+			/* Overflowed, but the LED tick has not counted it yet. */
+			if ((TIFR0 & _BV(TOV0)) && !(lo & 0x80)) hi++;
+			return ((uint16_t)hi << 8) | lo;
+		}
+		#endif
+
 	/* Function Prototypes: */
 		void SetupHardware(void);
+		bool SerialMode_Supported(const uint8_t Mode);
+		#if defined(ENABLE_XONXOFF)
+		void XonXoff_Set(const bool On);
+		#endif
 
 		void EVENT_USB_Device_Connect(void);
 		void EVENT_USB_Device_Disconnect(void);
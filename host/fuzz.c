@@ -0,0 +1,185 @@
+/* Control request fuzzing on the host build of fast-usbserial: LUFA's
+ * standard request handling, the CDC class requests and the vendor
+ * requests, with the mock host driving EP0 exactly as a real one would.
+ * A request the firmware neither answers nor stalls is a hang (abort).
+ *
+ * Input: a flags byte (bit 0: enumerate and configure first), then any
+ * number of requests, each an 8 byte SETUP packet followed, for host to
+ * device requests, by wLength bytes of data (zero padded at the end).
+ *
+ *   make fuzz && ./fuzz corpus/          libFuzzer, needs clang
+ *   ./fuzz-run [-n runs] [-s seed]      random requests, gcc + sanitizers
+ *   ./fuzz-run file...                  replay inputs
+ *
+ * Under the LUFA License, see ../fast-usbserial.c. */
+
+#undef main
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fast-usbserial.h"
+#include "mock.h"
+
+#define MAX_REQUESTS 64
+
+/* The host runs from the model hook, so it moves on to the next request while
+ * the firmware may still sit in the handler of the previous one, as a real
+ * host would. */
+static struct {
+	const uint8_t* In;
+	size_t         Len;
+	int            Count;
+	int            Step;     /* 0, 1: enumeration, 2: the input, 3, 4: the check. */
+	bool           Done;
+	uint64_t       Deadline;
+	uint8_t        Setup[8];
+	uint8_t        Data[1024];
+} Host;
+
+static bool next_request(void)
+{
+	static const uint8_t set_address[8] = { 0x00, 0x05, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	static const uint8_t set_config[8]  = { 0x00, 0x09, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+	if (Host.Step < 2) {
+		memcpy(Host.Setup, Host.Step ? set_config : set_address, 8);
+		Host.Step++;
+		return true;
+	}
+	if ((Host.Count == MAX_REQUESTS) || (Host.Len < 8)) return false;
+
+	memcpy(Host.Setup, Host.In, 8);
+	Host.In += 8;
+	Host.Len -= 8;
+	Host.Count++;
+	uint16_t len = Host.Setup[6] | (Host.Setup[7] << 8);
+	if (len > sizeof(Host.Data)) len = sizeof(Host.Data);
+	if (!(Host.Setup[0] & 0x80)) {
+		uint16_t have = (Host.Len < len) ? Host.Len : len;
+		memcpy(Host.Data, Host.In, have);
+		memset(Host.Data + have, 0, len - have);
+		Host.In += have;
+		Host.Len -= have;
+	}
+	return true;
+}
+
+static void host(void)
+{
+	static const uint8_t get_device[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x12, 0x00 };
+	uint8_t status = mock_usb_control_status();
+
+	if (!mock_usb_ready() || (status == MOCK_CTL_BUSY)) return;
+	if (Host.Done) {
+		/* The last handler has to let go of EP0 as well. */
+		if (mock_cycles > Host.Deadline) mock_hang("request handler did not return");
+		return;
+	}
+	if (Host.Step >= 3) {
+		/* A SETUP that ends the previous handler's status stage early is
+		 * stalled by its unhandled request check, and a host retries. */
+		if ((status == MOCK_CTL_STALL) && (Host.Step++ == 3)) {
+			mock_usb_control(Host.Setup, Host.Data);
+			return;
+		}
+		if (status != MOCK_CTL_ACK) mock_hang("device descriptor request not answered");
+		Host.Done = true;
+		Host.Deadline = mock_cycles + MOCK_CTL_TIMEOUT;
+		return;
+	}
+	if ((Host.Step == 2) && !next_request()) {
+		/* Whatever the input did, the device still has to answer this. */
+		memcpy(Host.Setup, get_device, 8);
+		Host.Step = 3;
+	} else if (Host.Step < 2) {
+		next_request();
+	}
+	mock_usb_control(Host.Setup, Host.Data);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* d, size_t n)
+{
+	if (!n) return 0;
+	memset(&Host, 0, sizeof(Host));
+	Host.In = d + 1;
+	Host.Len = n - 1;
+	Host.Step = (d[0] & 1) ? 0 : 2;
+
+	mock_reset();
+	mock_set_hook(host);
+	SerialMode = SERIAL_MODE_UART;
+	SetupHardware();
+	sei();
+	while (!Host.Done) {
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		if (Endpoint_IsSETUPReceived())
+		  USB_Device_ProcessControlRequest();
+	}
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+/* Requests a host could plausibly send, with the fields in and around range. */
+static size_t random_input(uint8_t* buf, size_t max)
+{
+	static const uint8_t types[] = { 0x00, 0x01, 0x02, 0x80, 0x81, 0x82, 0x21, 0xA1, 0x40, 0xC0, 0x41, 0xC1 };
+	size_t n = 0;
+	buf[n++] = rand() & 1;
+	int count = 1 + rand() % 8;
+	for (int r = 0; (r < count) && (n + 8 + 80 <= max); r++) {
+		uint8_t t = types[rand() % sizeof(types)];
+		uint8_t req = (t & 0x40) ? (rand() % 10) : (rand() % 0x24);
+		uint16_t len = (rand() % 4) ? (rand() % 80) : 0;
+		buf[n++] = t;
+		buf[n++] = req;
+		buf[n++] = rand() % 8;
+		buf[n++] = (rand() % 4) ? 0 : rand();
+		buf[n++] = rand() % 4;
+		buf[n++] = 0;
+		buf[n++] = len;
+		buf[n++] = len >> 8;
+		if (!(t & 0x80)) {
+			for (uint16_t i = 0; i < len; i++) buf[n++] = rand();
+		}
+	}
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long runs = 10000;
+	unsigned seed = 1;
+	int files = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && (i + 1 < argc)) {
+			runs = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "-s") && (i + 1 < argc)) {
+			seed = strtoul(argv[++i], NULL, 0);
+		} else {
+			FILE* f = fopen(argv[i], "rb");
+			if (!f) {
+				perror(argv[i]);
+				return 1;
+			}
+			static uint8_t buf[1 << 16];
+			size_t n = fread(buf, 1, sizeof(buf), f);
+			fclose(f);
+			LLVMFuzzerTestOneInput(buf, n);
+			files++;
+		}
+	}
+	if (files) return 0;
+
+	srand(seed);
+	for (unsigned long i = 0; i < runs; i++) {
+		uint8_t buf[1024];
+		size_t n = random_input(buf, sizeof(buf));
+		LLVMFuzzerTestOneInput(buf, n);
+	}
+	printf("%lu random inputs, seed %u, no hangs or faults\n", runs, seed);
+	return 0;
+}
+#endif
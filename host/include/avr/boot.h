@@ -0,0 +1,10 @@
+/* Host build: signature row, for the internal serial number. */
+
+#ifndef _MOCK_AVR_BOOT_H_
+#define _MOCK_AVR_BOOT_H_
+
+#include <stdint.h>
+
+uint8_t boot_signature_byte_get(uint16_t addr);
+
+#endif
@@ -0,0 +1,17 @@
+/* Host build: EEMEM variables are ordinary memory. */
+
+#ifndef _MOCK_AVR_EEPROM_H_
+#define _MOCK_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t* p);
+void    eeprom_update_byte(uint8_t* p, uint8_t v);
+void    eeprom_write_byte(uint8_t* p, uint8_t v);
+void    eeprom_read_block(void* dst, const void* src, size_t n);
+void    eeprom_update_block(const void* src, void* dst, size_t n);
+
+#endif
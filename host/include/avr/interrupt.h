@@ -0,0 +1,21 @@
+/* Host build: interrupts. The model in ../../mock.c calls the vectors
+ * itself, between two register accesses, while the I flag is set. */
+
+#ifndef _MOCK_AVR_INTERRUPT_H_
+#define _MOCK_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+#include <stdbool.h>
+
+extern volatile bool mock_sreg_i;
+
+#define sei()              do { mock_sreg_i = true; } while (0)
+#define cli()              do { mock_sreg_i = false; } while (0)
+#define reti()             return
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define ISR(vector, ...)   void vector(void); void vector(void)
+
+#endif
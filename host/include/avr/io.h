@@ -0,0 +1,234 @@
+/* Host build: ATmega16U2 (or 8U2/32U2) register file. Every access goes through
+ * mock_reg(), which lets the model in ../../mock.c see it, advance the
+ * clock and run the peripherals. Only what the firmware and LUFA use. */
+
+#ifndef _MOCK_AVR_IO_H_
+#define _MOCK_AVR_IO_H_
+
+#include <stdint.h>
+
+volatile uint8_t*  mock_reg(uint16_t addr);
+volatile uint16_t* mock_reg16(uint16_t addr);
+
+#if defined(__AVR_ATmega32U2__)
+#define RAMEND            0x4FF
+#define FLASHEND          0x7FFF
+#elif defined(__AVR_ATmega8U2__)
+#define RAMEND            0x2FF
+#define FLASHEND          0x1FFF
+#else
+#define RAMEND            0x2FF
+#define FLASHEND          0x3FFF
+#endif
+
+/* The SRAM the firmware addresses by number, i.e. the ring buffers. */
+extern uint8_t mock_sram[RAMEND + 1];
+
+#define _SFR_MEM8(a)      (*mock_reg(a))
+#define _SFR_MEM16(a)     (*mock_reg16(a))
+#define _SFR_IO8(a)       _SFR_MEM8((a) + 0x20)
+#define _SFR_MEM_ADDR(r)  0
+#define _SFR_IO_ADDR(r)   0
+#define _BV(b)            (1 << (b))
+
+#define PINB     _SFR_IO8(0x03)
+#define DDRB     _SFR_IO8(0x04)
+#define PORTB    _SFR_IO8(0x05)
+#define PINC     _SFR_IO8(0x06)
+#define DDRC     _SFR_IO8(0x07)
+#define PORTC    _SFR_IO8(0x08)
+#define PIND     _SFR_IO8(0x09)
+#define DDRD     _SFR_IO8(0x0A)
+#define PORTD    _SFR_IO8(0x0B)
+#define TIFR0    _SFR_IO8(0x15)
+#define TIFR1    _SFR_IO8(0x16)
+#define PCIFR    _SFR_IO8(0x1B)
+#define EIFR     _SFR_IO8(0x1C)
+#define EIMSK    _SFR_IO8(0x1D)
+#define GPIOR0   _SFR_IO8(0x1E)
+#define EECR     _SFR_IO8(0x1F)
+#define TCCR0A   _SFR_IO8(0x24)
+#define TCCR0B   _SFR_IO8(0x25)
+#define TCNT0    _SFR_IO8(0x26)
+#define OCR0A    _SFR_IO8(0x27)
+#define OCR0B    _SFR_IO8(0x28)
+#define PLLCSR   _SFR_IO8(0x29)
+#define GPIOR1   _SFR_IO8(0x2A)
+#define GPIOR2   _SFR_IO8(0x2B)
+#define ACSR     _SFR_IO8(0x30)
+#define MCUSR    _SFR_IO8(0x34)
+#define SPL      _SFR_IO8(0x3D)
+#define SPH      _SFR_IO8(0x3E)
+#define SREG     _SFR_IO8(0x3F)
+#define SP       _SFR_MEM16(0x5D)
+#define WDTCSR   _SFR_MEM8(0x60)
+#define CLKPR    _SFR_MEM8(0x61)
+#define REGCR    _SFR_MEM8(0x63)
+#define TIMSK0   _SFR_MEM8(0x6E)
+#define TIMSK1   _SFR_MEM8(0x6F)
+#define ACMUX    _SFR_MEM8(0x7D)
+#define TCCR1A   _SFR_MEM8(0x80)
+#define TCCR1B   _SFR_MEM8(0x81)
+#define TCCR1C   _SFR_MEM8(0x82)
+#define TCNT1    _SFR_MEM16(0x84)
+#define ICR1     _SFR_MEM16(0x86)
+#define OCR1A    _SFR_MEM16(0x88)
+#define OCR1B    _SFR_MEM16(0x8A)
+#define UCSR1A   _SFR_MEM8(0xC8)
+#define UCSR1B   _SFR_MEM8(0xC9)
+#define UCSR1C   _SFR_MEM8(0xCA)
+#define UCSR1D   _SFR_MEM8(0xCB)
+#define UBRR1    _SFR_MEM16(0xCC)
+#define UDR1     _SFR_MEM8(0xCE)
+#define USBCON   _SFR_MEM8(0xD8)
+#define UDCON    _SFR_MEM8(0xE0)
+#define UDINT    _SFR_MEM8(0xE1)
+#define UDIEN    _SFR_MEM8(0xE2)
+#define UDADDR   _SFR_MEM8(0xE3)
+#define UDFNUM   _SFR_MEM16(0xE4)
+#define UDFNUML  _SFR_MEM8(0xE4)
+#define UDFNUMH  _SFR_MEM8(0xE5)
+#define UDMFN    _SFR_MEM8(0xE6)
+#define UEINTX   _SFR_MEM8(0xE8)
+#define UENUM    _SFR_MEM8(0xE9)
+#define UERST    _SFR_MEM8(0xEA)
+#define UECONX   _SFR_MEM8(0xEB)
+#define UECFG0X  _SFR_MEM8(0xEC)
+#define UECFG1X  _SFR_MEM8(0xED)
+#define UESTA0X  _SFR_MEM8(0xEE)
+#define UESTA1X  _SFR_MEM8(0xEF)
+#define UEIENX   _SFR_MEM8(0xF0)
+#define UEDATX   _SFR_MEM8(0xF1)
+#define UEBCLX   _SFR_MEM8(0xF2)
+#define UEINT    _SFR_MEM8(0xF4)
+
+/* MCUSR */
+#define WDRF     3
+
+/* Timers */
+#define TOV0     0
+#define OCF0A    1
+#define OCF0B    2
+#define TOIE0    0
+#define OCIE0A   1
+#define OCIE0B   2
+#define TOV1     0
+#define OCF1A    1
+#define OCF1B    2
+#define ICF1     5
+#define TOIE1    0
+#define OCIE1A   1
+#define OCIE1B   2
+#define ICIE1    5
+#define CS00     0
+#define CS01     1
+#define CS02     2
+#define CS10     0
+#define CS11     1
+#define CS12     2
+#define WGM12    3
+#define WGM13    4
+#define ICES1    6
+#define ICNC1    7
+
+/* Analog comparator */
+#define ACIS0    0
+#define ACIS1    1
+#define ACIC     2
+#define ACIE     3
+#define ACI      4
+#define ACO      5
+#define ACBG     6
+#define ACD      7
+
+/* USART1 */
+#define MPCM1    0
+#define U2X1     1
+#define UPE1     2
+#define DOR1     3
+#define FE1      4
+#define UDRE1    5
+#define TXC1     6
+#define RXC1     7
+#define TXB81    0
+#define RXB81    1
+#define UCSZ12   2
+#define TXEN1    3
+#define RXEN1    4
+#define UDRIE1   5
+#define TXCIE1   6
+#define RXCIE1   7
+#define UCPOL1   0
+#define UCSZ10   1
+#define UCSZ11   2
+#define USBS1    3
+#define UPM10    4
+#define UPM11    5
+#define UMSEL10  6
+#define UMSEL11  7
+#define RTSEN    0
+#define CTSEN    1
+
+/* USB controller */
+#define REGDIS   0
+#define PLOCK    0
+#define PLLE     1
+#define PLLP0    2
+#define PLLP1    3
+#define PLLP2    4
+#define FRZCLK   5
+#define USBE     7
+#define DETACH   0
+#define RMWKUP   1
+#define RSTCPU   2
+#define SUSPI    0
+#define SOFI     2
+#define EORSTI   3
+#define WAKEUPI  4
+#define EORSMI   5
+#define UPRSMI   6
+#define SUSPE    0
+#define SOFE     2
+#define EORSTE   3
+#define WAKEUPE  4
+#define EORSME   5
+#define UPRSME   6
+#define ADDEN    7
+#define TXINI    0
+#define STALLEDI 1
+#define RXOUTI   2
+#define RXSTPI   3
+#define NAKOUTI  4
+#define RWAL     5
+#define NAKINI   6
+#define FIFOCON  7
+#define EPEN     0
+#define RSTDT    3
+#define STALLRQC 4
+#define STALLRQ  5
+#define EPDIR    0
+#define EPTYPE0  6
+#define EPTYPE1  7
+#define ALLOC    1
+#define EPBK0    2
+#define EPBK1    3
+#define EPSIZE0  4
+#define EPSIZE1  5
+#define EPSIZE2  6
+#define NBUSYBK0 0
+#define NBUSYBK1 1
+#define DTSEQ0   2
+#define DTSEQ1   3
+#define UNDERFI  5
+#define OVERFI   6
+#define CFGOK    7
+#define CTRLDIR  2
+#define TXINE    0
+#define STALLEDE 1
+#define RXOUTE   2
+#define RXSTPE   3
+#define NAKOUTE  4
+#define NAKINE   6
+#define FLERRE   7
+
+#endif
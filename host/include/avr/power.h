@@ -0,0 +1,8 @@
+/* Host build: clock prescaler and power reduction are not modelled. */
+
+#ifndef _MOCK_AVR_POWER_H_
+#define _MOCK_AVR_POWER_H_
+
+#define clock_prescale_set(x) do { } while (0)
+
+#endif
@@ -0,0 +1,10 @@
+/* Host build: there is no watchdog. */
+
+#ifndef _MOCK_AVR_WDT_H_
+#define _MOCK_AVR_WDT_H_
+
+#define wdt_disable()      do { } while (0)
+#define wdt_reset()        do { } while (0)
+#define wdt_enable(t)      do { } while (0)
+
+#endif
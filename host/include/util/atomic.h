@@ -0,0 +1,28 @@
+/* Host build: ATOMIC_BLOCK on the mock I flag. */
+
+#ifndef _MOCK_UTIL_ATOMIC_H_
+#define _MOCK_UTIL_ATOMIC_H_
+
+#include <avr/interrupt.h>
+
+static inline bool mock_atomic_enter(void)
+{
+	bool i = mock_sreg_i;
+	mock_sreg_i = false;
+	return i;
+}
+
+#define ATOMIC_RESTORESTATE  0
+#define ATOMIC_FORCEON       1
+#define NONATOMIC_RESTORESTATE 0
+#define NONATOMIC_FORCEOFF   1
+
+#define ATOMIC_BLOCK(type) \
+	for (bool __sreg = mock_atomic_enter(), __todo = true; __todo; \
+	     __todo = false, mock_sreg_i = ((type) == ATOMIC_FORCEON) ? true : __sreg)
+
+#define NONATOMIC_BLOCK(type) \
+	for (bool __sreg = mock_sreg_i, __todo = (mock_sreg_i = true); __todo; \
+	     __todo = false, mock_sreg_i = ((type) == NONATOMIC_FORCEOFF) ? false : __sreg)
+
+#endif
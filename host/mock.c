@@ -0,0 +1,996 @@
+/* Host build of fast-usbserial: register and peripheral model, see mock.h.
+ * Under the LUFA License, see ../fast-usbserial.c. */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "mock.h"
+
+/* Data space addresses. The register names themselves are accesses. */
+#define A_PIND     0x29
+#define A_TIFR0    0x35
+#define A_TIFR1    0x36
+#define A_TCCR0B   0x45
+#define A_TCNT0    0x46
+#define A_OCR0A    0x47
+#define A_OCR0B    0x48
+#define A_PLLCSR   0x49
+#define A_SREG     0x5F
+#define A_TIMSK0   0x6E
+#define A_TIMSK1   0x6F
+#define A_TCCR1A   0x80
+#define A_TCCR1B   0x81
+#define A_TCNT1    0x84
+#define A_OCR1A    0x88
+#define A_OCR1B    0x8A
+#define A_UCSR1A   0xC8
+#define A_UCSR1B   0xC9
+#define A_UCSR1C   0xCA
+#define A_UBRR1    0xCC
+#define A_UDR1     0xCE
+#define A_USBCON   0xD8
+#define A_UDCON    0xE0
+#define A_UDINT    0xE1
+#define A_UDIEN    0xE2
+#define A_UDADDR   0xE3
+#define A_UDFNUM   0xE4
+#define A_UEINTX   0xE8
+#define A_UENUM    0xE9
+#define A_UERST    0xEA
+#define A_UECONX   0xEB
+#define A_UECFG0X  0xEC
+#define A_UECFG1X  0xED
+#define A_UESTA0X  0xEE
+#define A_UESTA1X  0xEF
+#define A_UEIENX   0xF0
+#define A_UEDATX   0xF1
+#define A_UEBCLX   0xF2
+
+#define STEP_CYCLES 8
+#define BV(b) (1 << (b))
+
+/* Vectors the firmware may or may not have. */
+extern void USB_GEN_vect(void) __attribute__((weak));
+extern void USART1_RX_vect(void) __attribute__((weak));
+extern void USART1_UDRE_vect(void) __attribute__((weak));
+extern void TIMER0_OVF_vect(void) __attribute__((weak));
+extern void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern void TIMER0_COMPB_vect(void) __attribute__((weak));
+extern void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern void TIMER1_OVF_vect(void) __attribute__((weak));
+
+uint8_t mock_sram[RAMEND + 1];
+uint64_t mock_cycles;
+volatile bool mock_sreg_i;
+bool mock_uart_loopback;
+uint32_t mock_uart_line_baud;
+uint32_t mock_uart_overruns;
+uint8_t mock_usb_in_mask;
+uint32_t mock_usb_control_packets;
+
+static void default_hang(const char* why)
+{
+	fprintf(stderr, "mock: firmware hung (%s) at cycle %llu\n", why, (unsigned long long)mock_cycles);
+	abort();
+}
+void (*mock_hang)(const char* why) = default_hang;
+
+static uint8_t io[0x100] __attribute__((aligned(2)));
+
+static uint16_t io16(uint8_t a)
+{
+	return io[a] | (io[a + 1] << 8);
+}
+
+static void set_io16(uint8_t a, uint16_t v)
+{
+	io[a] = v;
+	io[a + 1] = v >> 8;
+}
+
+/* Registers whose write does more than store the value (write one to clear,
+ * FIFO strobes) hand out a scratch byte holding the current value. The next
+ * access tells whether it was written and how. */
+enum { PEND_NONE, PEND_TIFR, PEND_UCSR1A, PEND_UDR1, PEND_UERST, PEND_SREG };
+static uint8_t pend;
+static uint8_t pend_addr;
+static uint8_t pend_val;
+static bool pend_rxc;   /* UDR1: RXC1 as of the access, a byte may come in before it settles. */
+static volatile uint8_t pend_byte;
+
+/* What is running: the main loop or one of the UART vectors, so UDR1 knows
+ * whether it is read or written. */
+enum { CTX_MAIN, CTX_RX, CTX_UDRE, CTX_OTHER };
+static uint8_t ctx;
+
+static bool in_step;
+static uint64_t next_step;
+static jmp_buf stop_jmp;
+static void (*hook)(void);
+
+/* USB endpoints. */
+struct ep {
+	uint8_t ueintx, ueconx, uecfg0x, uecfg1x, uesta0x, uesta1x, ueienx, uebclx;
+	bool    alloc;
+	uint8_t size, banks;
+	bool    fw;            /* The firmware holds a bank: IN to fill, OUT to read. */
+	uint8_t cnt;           /* IN: bytes written. */
+	uint8_t pos, rem;      /* OUT: read position and bytes left. */
+	uint8_t ibuf[64];
+	uint8_t obuf[64];
+	uint8_t qn;            /* Banks waiting for the host (IN) or the firmware (OUT). */
+	uint8_t qlen[2];
+	uint8_t q[2][64];
+	bool    out_full;      /* Control: an OUT packet is in the bank. */
+};
+static struct ep ep[MOCK_ENDPOINTS + 1]; /* The last one soaks up bad UENUM values. */
+static struct ep* last_ep;
+
+enum { CTL_IDLE, CTL_SETUP, CTL_DATA_IN, CTL_DATA_OUT, CTL_STATUS_IN, CTL_STATUS_OUT, CTL_STATUS_OUT_WAIT };
+
+static struct {
+	bool     attached;
+	bool     ready;
+	uint64_t reset_at;
+	uint64_t next_sof;
+	uint64_t bus_free;
+	bool     ctl_last;  /* The control pipe had the bus last, bulk goes first next. */
+	uint8_t  next_in;
+	void   (*in_sink)(uint8_t epnum, const uint8_t* d, uint8_t n);
+
+	uint8_t  ctl;
+	uint8_t  status;
+	uint8_t  setup[8];
+	uint16_t len;
+	uint16_t done;
+	uint8_t  data[1024];
+	uint64_t started;
+} usb;
+
+static struct {
+	uint8_t  rx[2];
+	uint8_t  rx_err[2]; /* FE1 and UPE1 of each, UCSR1A shows the first one's. */
+	uint8_t  rxn;
+	bool     rx_busy;
+	uint64_t rx_start;
+	uint64_t rx_end;
+	uint8_t  src[4096];
+	uint8_t  src_err[4096];
+	size_t   src_head, src_n;
+
+	bool     tx_busy;
+	uint64_t tx_start;
+	uint64_t tx_end;
+	uint8_t  tx_shift;
+	bool     tx_full;
+	uint8_t  tx_buf;
+	void   (*sink)(uint8_t d);
+} uart;
+
+static uint64_t t0_base, t1_base;
+
+/* UART *****************************************************************/
+
+static uint32_t uart_bit_cycles(void)
+{
+	return ((io[A_UCSR1A] & BV(U2X1)) ? 8 : 16) * (uint32_t)((io16(A_UBRR1) & 0x0FFF) + 1);
+}
+
+static uint32_t uart_byte_cycles(void)
+{
+	uint8_t c = io[A_UCSR1C];
+	uint32_t bits = 1 + 5 + ((c >> UCSZ10) & 3) + ((c & BV(UPM11)) ? 1 : 0) + ((c & BV(USBS1)) ? 2 : 1);
+	return uart_bit_cycles() * bits;
+}
+
+/* A frame on the RX line: the USART's own, or 8N1 at mock_uart_line_baud. */
+static uint64_t uart_line_cycles(void)
+{
+	if (!mock_uart_line_baud) return uart_byte_cycles();
+	return (10 * (uint64_t)MOCK_F_CPU + mock_uart_line_baud / 2) / mock_uart_line_baud;
+}
+
+/* Level of the RX line now: start bit, data LSB first, then stop bit and idle. */
+static uint8_t uart_line_level(uint64_t now)
+{
+	if (!uart.rx_busy || (now < uart.rx_start)) return 1;
+	uint64_t bit = uart_line_cycles() / 10;
+	uint64_t i = (now - uart.rx_start) / (bit ? bit : 1);
+	if (!i) return 0;
+	if (i > 8) return 1;
+	return (uart.src[uart.src_head] >> (i - 1)) & 1;
+}
+
+static void uart_flags(void)
+{
+	uint8_t a = io[A_UCSR1A] & ~(BV(RXC1) | BV(UDRE1) | BV(FE1) | BV(UPE1));
+	if (uart.rxn) a |= BV(RXC1) | uart.rx_err[0];
+	if (!uart.tx_full) a |= BV(UDRE1);
+	io[A_UCSR1A] = a;
+}
+
+static void uart_rx_push(uint8_t d, uint8_t err)
+{
+	if (uart.src_n == sizeof(uart.src)) {
+		mock_uart_overruns++;
+		return;
+	}
+	size_t i = (uart.src_head + uart.src_n++) % sizeof(uart.src);
+	uart.src[i] = d;
+	uart.src_err[i] = err;
+}
+
+static void uart_receive(uint8_t d, uint8_t err)
+{
+	if (!(io[A_UCSR1B] & BV(RXEN1))) return;
+	if (uart.rxn < 2) {
+		uart.rx_err[uart.rxn] = err;
+		uart.rx[uart.rxn++] = d;
+	} else {
+		io[A_UCSR1A] |= BV(DOR1);
+		mock_uart_overruns++;
+	}
+	uart_flags();
+}
+
+static void uart_write(uint8_t d)
+{
+	if (!(io[A_UCSR1B] & BV(TXEN1)) || uart.tx_full) return;
+	uart.tx_buf = d;
+	uart.tx_full = true;
+	uart_flags();
+}
+
+static uint8_t uart_read(void)
+{
+	if (!uart.rxn) return 0;
+	uint8_t d = uart.rx[0];
+	uart.rx[0] = uart.rx[1];
+	uart.rx_err[0] = uart.rx_err[1];
+	uart.rxn--;
+	uart_flags();
+	return d;
+}
+
+static void uart_run(uint64_t now)
+{
+	uint32_t bc = uart_byte_cycles();
+
+	/* Transmitter: UDR1 moves to the shift register as soon as it is free. */
+	if (uart.tx_busy && (now >= uart.tx_end)) {
+		uart.tx_busy = false;
+		if (uart.sink) uart.sink(uart.tx_shift);
+		if (mock_uart_loopback) uart_receive(uart.tx_shift, 0); /* Shifted in while it went out. */
+		if (!uart.tx_full) io[A_UCSR1A] |= BV(TXC1);
+	}
+	if (!uart.tx_busy && uart.tx_full) {
+		uart.tx_shift = uart.tx_buf;
+		uart.tx_full = false;
+		uart.tx_busy = true;
+		uart.tx_start = now;
+		uart.tx_end = now + bc;
+		uart_flags();
+	}
+
+	/* Receiver: bytes on the line arrive back to back at the line rate. One
+	 * more than 4% off the USART's comes out garbled, with a framing error. */
+	uint64_t lc = uart_line_cycles();
+	if (uart.rx_busy && (now >= uart.rx_end)) {
+		uint8_t d = uart.src[uart.src_head];
+		uint8_t err = uart.src_err[uart.src_head];
+		uart.src_head = (uart.src_head + 1) % sizeof(uart.src);
+		uart.src_n--;
+		uart.rx_busy = false;
+		if (mock_uart_line_baud) {
+			uint64_t bit = uart_bit_cycles() * 10;
+			if ((((bit > lc) ? (bit - lc) : (lc - bit)) * 25) > lc) {
+				d = ~d;
+				err |= BV(FE1);
+			}
+		}
+		uart_receive(d, err);
+		if (uart.src_n) {
+			uart.rx_busy = true;
+			uart.rx_start = uart.rx_end;
+			uart.rx_end += lc;
+		}
+	}
+	if (!uart.rx_busy && uart.src_n) {
+		uart.rx_busy = true;
+		uart.rx_start = now;
+		uart.rx_end = now + lc;
+	}
+}
+
+size_t mock_uart_send(const uint8_t* d, size_t n)
+{
+	size_t room = sizeof(uart.src) - uart.src_n;
+	if (n > room) n = room;
+	for (size_t i = 0; i < n; i++) uart_rx_push(d[i], 0);
+	return n;
+}
+
+bool mock_uart_send_error(uint8_t d, uint8_t err)
+{
+	if (uart.src_n == sizeof(uart.src)) return false;
+	uart_rx_push(d, err & (BV(FE1) | BV(UPE1)));
+	return true;
+}
+
+size_t mock_uart_pending(void)
+{
+	return uart.src_n;
+}
+
+void mock_uart_set_sink(void (*sink)(uint8_t d))
+{
+	uart.sink = sink;
+}
+
+uint64_t mock_uart_tx_start(void)
+{
+	return uart.tx_start;
+}
+
+/* Timers ***************************************************************/
+
+static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+/* Whether a counter at t reaches v within n ticks, counting 0..top. */
+static bool timer_hits(uint32_t t, uint64_t n, uint32_t top, uint32_t v)
+{
+	uint64_t period = (uint64_t)top + 1;
+	uint64_t d = (v >= t) ? (v - t) : (v + period - t);
+	if (!d) d = period;
+	return (v <= top) && (n >= d);
+}
+
+static void timers_run(uint64_t now)
+{
+	uint16_t p = prescale[io[A_TCCR0B] & 7];
+	if (!p) {
+		t0_base = now;
+	} else if (now - t0_base >= p) {
+		uint64_t n = (now - t0_base) / p;
+		uint32_t t = io[A_TCNT0];
+		t0_base += n * p;
+		if (timer_hits(t, n, 0xFF, 0)) io[A_TIFR0] |= BV(TOV0); /* On the wrap to BOTTOM. */
+		if (timer_hits(t, n, 0xFF, io[A_OCR0A])) io[A_TIFR0] |= BV(OCF0A);
+		if (timer_hits(t, n, 0xFF, io[A_OCR0B])) io[A_TIFR0] |= BV(OCF0B);
+		io[A_TCNT0] = (t + n) & 0xFF;
+	}
+
+	p = prescale[io[A_TCCR1B] & 7];
+	if (!p) {
+		t1_base = now;
+	} else if (now - t1_base >= p) {
+		uint64_t n = (now - t1_base) / p;
+		uint32_t t = io16(A_TCNT1);
+		bool ctc = ((io[A_TCCR1B] & (BV(WGM12) | BV(WGM13))) == BV(WGM12));
+		uint32_t top = ctc ? io16(A_OCR1A) : 0xFFFF;
+		t1_base += n * p;
+		if (t > top) t = 0; /* Past TOP after a write, call it a wrap. */
+		if (timer_hits(t, n, top, io16(A_OCR1A))) io[A_TIFR1] |= BV(OCF1A);
+		if (timer_hits(t, n, top, io16(A_OCR1B))) io[A_TIFR1] |= BV(OCF1B);
+		if (!ctc && timer_hits(t, n, top, 0)) io[A_TIFR1] |= BV(TOV1);
+		set_io16(A_TCNT1, (t + n) % ((uint64_t)top + 1));
+	}
+}
+
+/* USB endpoints ********************************************************/
+
+static bool ep_is_control(const struct ep* e)
+{
+	return !(e->uecfg0x & (BV(EPTYPE1) | BV(EPTYPE0)));
+}
+
+static bool ep_is_in(const struct ep* e)
+{
+	return e->uecfg0x & BV(EPDIR);
+}
+
+static void ep_status(struct ep* e)
+{
+	uint8_t busy = e->qn + ((!ep_is_in(e) && e->fw) ? 1 : 0);
+	e->uesta0x = (e->uesta0x & ~(BV(NBUSYBK1) | BV(NBUSYBK0))) | (busy & 3);
+}
+
+/* DPRAM is handed out in endpoint order, as on the chip. */
+static bool ep_fits(void)
+{
+	unsigned used = 0;
+	for (int i = 0; i < MOCK_ENDPOINTS; i++) {
+		if (ep[i].alloc) used += ep[i].size * ep[i].banks;
+	}
+	return used <= MOCK_DPRAM;
+}
+
+static void ep_free(struct ep* e)
+{
+	e->alloc = false;
+	e->fw = e->out_full = false;
+	e->qn = e->cnt = e->pos = e->rem = 0;
+	e->uesta0x &= ~(BV(CFGOK) | BV(NBUSYBK1) | BV(NBUSYBK0));
+}
+
+static void ep_alloc(struct ep* e)
+{
+	e->alloc = true;
+	e->size = 8 << ((e->uecfg1x >> EPSIZE0) & 7);
+	if (e->size > 64) e->size = 64;
+	e->banks = (e->uecfg1x & (BV(EPBK1) | BV(EPBK0))) ? 2 : 1;
+	if (ep_fits()) e->uesta0x |= BV(CFGOK);
+	if (ep_is_control(e)) e->ueintx |= BV(TXINI);
+}
+
+static void ep_reset_all(void)
+{
+	for (int i = 0; i <= MOCK_ENDPOINTS; i++) {
+		memset(&ep[i], 0, sizeof(ep[i]));
+	}
+	last_ep = NULL;
+}
+
+static uint64_t usb_packet_cycles(uint8_t n);
+static bool ctl_bus_free(uint64_t now);
+static void ctl_in(const uint8_t* d, uint8_t n);
+static void settle(void);
+static void ctl_out_released(void);
+
+/* Catch up with what the firmware did to the endpoint registers. */
+static void ep_sync(struct ep* e)
+{
+	if ((e->uecfg1x & BV(ALLOC)) && !e->alloc) ep_alloc(e);
+	else if (!(e->uecfg1x & BV(ALLOC)) && e->alloc) ep_free(e);
+	if (e->ueconx & BV(STALLRQC)) e->ueconx &= ~(BV(STALLRQC) | BV(STALLRQ));
+	e->ueconx &= ~BV(RSTDT);
+	if (!e->alloc) return;
+
+	if (ep_is_control(e)) {
+		/* One bank both ways, the host takes an IN packet as soon as the bus is free. */
+		if (!(e->ueintx & BV(TXINI)) && ctl_bus_free(mock_cycles)) {
+			usb.bus_free = mock_cycles + usb_packet_cycles(e->cnt);
+			usb.ctl_last = true;
+			mock_usb_control_packets++;
+			ctl_in(e->ibuf, e->cnt);
+			e->cnt = 0;
+			e->ueintx |= BV(TXINI);
+		}
+		if (e->out_full && !(e->ueintx & BV(RXOUTI))) {
+			e->out_full = false;
+			ctl_out_released();
+		}
+		return;
+	}
+
+	if (ep_is_in(e)) {
+		if (e->fw && !(e->ueintx & BV(FIFOCON))) {
+			memcpy(e->q[e->qn], e->ibuf, e->cnt);
+			e->qlen[e->qn++] = e->cnt;
+			e->fw = false;
+			e->ueintx &= ~(BV(TXINI) | BV(RWAL));
+		}
+		if (!e->fw && (e->qn < e->banks)) {
+			e->fw = true;
+			e->cnt = 0;
+			e->ueintx |= BV(TXINI) | BV(FIFOCON) | BV(RWAL);
+		}
+	} else {
+		if (e->fw && !(e->ueintx & BV(FIFOCON))) {
+			e->fw = false;
+			e->ueintx &= ~(BV(RXOUTI) | BV(RWAL));
+		}
+		if (!e->fw && e->qn) {
+			memcpy(e->obuf, e->q[0], e->qlen[0]);
+			e->rem = e->qlen[0];
+			e->pos = 0;
+			if (--e->qn) {
+				memcpy(e->q[0], e->q[1], e->qlen[1]);
+				e->qlen[0] = e->qlen[1];
+			}
+			e->fw = true;
+			e->ueintx |= BV(RXOUTI) | BV(FIFOCON) | (e->rem ? BV(RWAL) : 0);
+		}
+	}
+	ep_status(e);
+}
+
+static struct ep* ep_selected(void)
+{
+	uint8_t n = io[A_UENUM] & 7;
+	return &ep[(n < MOCK_ENDPOINTS) ? n : MOCK_ENDPOINTS];
+}
+
+static volatile uint8_t* ep_data(struct ep* e)
+{
+	static uint8_t spill;
+	bool reading = ep_is_control(e) ? (e->ueintx & (BV(RXSTPI) | BV(RXOUTI))) : !ep_is_in(e);
+	if (reading) {
+		if (!e->rem) return &spill;
+		volatile uint8_t* p = &e->obuf[e->pos++];
+		if (!--e->rem) e->ueintx &= ~BV(RWAL);
+		return p;
+	}
+	if (e->cnt >= e->size) return &spill;
+	volatile uint8_t* p = &e->ibuf[e->cnt++];
+	if ((e->cnt == e->size) && !ep_is_control(e)) e->ueintx &= ~BV(RWAL);
+	return p;
+}
+
+static uint8_t ep_bytes(const struct ep* e)
+{
+	bool reading = ep_is_control(e) ? (e->ueintx & (BV(RXSTPI) | BV(RXOUTI))) : !ep_is_in(e);
+	return reading ? e->rem : e->cnt;
+}
+
+/* USB host *************************************************************/
+
+static uint64_t usb_packet_cycles(uint8_t n)
+{
+	/* Token, data and handshake packets at 12 Mbit/s. */
+	return ((uint64_t)(n + 13) * 8 * (MOCK_F_CPU / 1000000)) / 12;
+}
+
+/* The control pipe may take the bus: back to back control packets leave
+ * a step for bulk traffic in between, like a host alternating its queues. */
+static bool ctl_bus_free(uint64_t now)
+{
+	if (now < usb.bus_free) return false;
+	return !usb.ctl_last || (now >= usb.bus_free + STEP_CYCLES);
+}
+
+/* A SETUP or OUT packet into the control endpoint, it takes the bus for its bit time. */
+static void ctl_load(struct ep* e, const uint8_t* d, uint8_t n, uint8_t flag)
+{
+	usb.bus_free = mock_cycles + usb_packet_cycles(n);
+	usb.ctl_last = true;
+	mock_usb_control_packets++;
+	if (n) memcpy(e->obuf, d, n);
+	e->rem = n;
+	e->pos = 0;
+	e->ueintx |= BV(flag);
+}
+
+static void ctl_finish(uint8_t status)
+{
+	usb.ctl = CTL_IDLE;
+	usb.status = status;
+}
+
+static void ctl_in(const uint8_t* d, uint8_t n)
+{
+	switch (usb.ctl) {
+		case CTL_DATA_IN:
+			if (n > usb.len - usb.done) n = usb.len - usb.done;
+			memcpy(usb.data + usb.done, d, n);
+			usb.done += n;
+			if ((n < ep[0].size) || (usb.done == usb.len)) usb.ctl = CTL_STATUS_OUT;
+			break;
+		case CTL_DATA_OUT: /* Status stage before all the data, the device cut it short. */
+		case CTL_STATUS_IN:
+			ctl_finish(MOCK_CTL_ACK);
+			break;
+	}
+}
+
+static void ctl_out_released(void)
+{
+	if (usb.ctl == CTL_STATUS_OUT_WAIT) ctl_finish(MOCK_CTL_ACK);
+	else if ((usb.ctl == CTL_DATA_OUT) && (usb.done == usb.len)) usb.ctl = CTL_STATUS_IN;
+}
+
+static void ctl_run(uint64_t now)
+{
+	struct ep* e = &ep[0];
+	if ((usb.ctl == CTL_IDLE) || !e->alloc || !ctl_bus_free(now)) return;
+
+	if (usb.ctl == CTL_SETUP) {
+		e->ueconx &= ~BV(STALLRQ);
+		e->ueintx &= ~BV(RXOUTI);
+		e->out_full = false;
+		e->cnt = 0;
+		ctl_load(e, usb.setup, 8, RXSTPI);
+		usb.ctl = !usb.len ? CTL_STATUS_IN : (usb.setup[0] & 0x80) ? CTL_DATA_IN : CTL_DATA_OUT;
+		usb.started = now;
+		return;
+	}
+	if (now - usb.started > MOCK_CTL_TIMEOUT) {
+		ctl_finish(MOCK_CTL_IDLE);
+		mock_hang("control transfer");
+		return;
+	}
+	if (e->ueintx & BV(RXSTPI)) return;
+	if (e->ueconx & BV(STALLRQ)) {
+		ctl_finish(MOCK_CTL_STALL);
+		return;
+	}
+	switch (usb.ctl) {
+		case CTL_DATA_OUT:
+			if (!e->out_full && (usb.done < usb.len)) {
+				uint8_t n = (usb.len - usb.done > e->size) ? e->size : (usb.len - usb.done);
+				ctl_load(e, usb.data + usb.done, n, RXOUTI);
+				e->out_full = true;
+				usb.done += n;
+			}
+			break;
+		case CTL_STATUS_OUT:
+			if (!e->out_full) {
+				ctl_load(e, NULL, 0, RXOUTI);
+				e->out_full = true;
+				usb.ctl = CTL_STATUS_OUT_WAIT;
+			}
+			break;
+	}
+}
+
+static void usb_bus_reset(void)
+{
+	ep_reset_all();
+	io[A_UDADDR] = 0;
+	io[A_UDINT] |= BV(EORSTI);
+	usb.ctl = CTL_IDLE;
+	usb.status = MOCK_CTL_IDLE;
+	usb.ready = true;
+}
+
+static void usb_run(uint64_t now)
+{
+	bool up = (io[A_USBCON] & BV(USBE)) && !(io[A_USBCON] & BV(FRZCLK)) &&
+	          !(io[A_UDCON] & BV(DETACH)) && (io[A_PLLCSR] & BV(PLOCK));
+	if (up && !usb.attached) {
+		usb.attached = true;
+		usb.reset_at = now + MOCK_ATTACH_DELAY;
+	} else if (!up && usb.attached) {
+		usb.attached = usb.ready = false;
+		usb.reset_at = 0;
+	}
+	if (!usb.attached) return;
+	if (usb.reset_at && (now >= usb.reset_at)) {
+		usb.reset_at = 0;
+		usb.next_sof = now + (MOCK_F_CPU / 1000);
+		usb_bus_reset();
+	}
+	if (!usb.ready) return;
+
+	if (now >= usb.next_sof) {
+		usb.next_sof += MOCK_F_CPU / 1000;
+		set_io16(A_UDFNUM, (io16(A_UDFNUM) + 1) & 0x7FF);
+		io[A_UDINT] |= BV(SOFI);
+	}
+
+	for (int i = 0; i < MOCK_ENDPOINTS; i++) ep_sync(&ep[i]);
+	ctl_run(now);
+
+	/* Bulk IN, round robin over the endpoints the host is reading. */
+	if (now < usb.bus_free) return;
+	for (int k = 1; k < MOCK_ENDPOINTS; k++) {
+		uint8_t i = 1 + ((usb.next_in + k - 1) % (MOCK_ENDPOINTS - 1));
+		struct ep* e = &ep[i];
+		if (!e->alloc || ep_is_control(e) || !ep_is_in(e) || !e->qn || !(mock_usb_in_mask & BV(i)))
+		  continue;
+		if (e->ueconx & BV(STALLRQ)) continue;
+		uint8_t d[64];
+		uint8_t n = e->qlen[0];
+		memcpy(d, e->q[0], n);
+		if (--e->qn) {
+			memcpy(e->q[0], e->q[1], e->qlen[1]);
+			e->qlen[0] = e->qlen[1];
+		}
+		usb.bus_free = now + usb_packet_cycles(n);
+		usb.ctl_last = false;
+		usb.next_in = i;
+		ep_sync(e);
+		if (usb.in_sink) usb.in_sink(i, d, n);
+		break;
+	}
+}
+
+bool mock_usb_ready(void)
+{
+	return usb.ready && ep[0].alloc;
+}
+
+bool mock_usb_control(const uint8_t* setup, const uint8_t* data)
+{
+	if (usb.ctl != CTL_IDLE) return false;
+	memcpy(usb.setup, setup, 8);
+	usb.len = setup[6] | (setup[7] << 8);
+	if (usb.len > sizeof(usb.data)) usb.len = sizeof(usb.data);
+	usb.done = 0;
+	if (!(setup[0] & 0x80) && usb.len) {
+		if (data) memcpy(usb.data, data, usb.len);
+		else memset(usb.data, 0, usb.len);
+	}
+	usb.ctl = CTL_SETUP;
+	usb.status = MOCK_CTL_BUSY;
+	usb.started = mock_cycles;
+	return true;
+}
+
+uint8_t mock_usb_control_status(void)
+{
+	return usb.status;
+}
+
+const uint8_t* mock_usb_control_data(uint16_t* len)
+{
+	*len = usb.done;
+	return usb.data;
+}
+
+bool mock_usb_out(uint8_t epnum, const uint8_t* d, uint8_t n)
+{
+	if (!usb.ready || !epnum || (epnum >= MOCK_ENDPOINTS)) return false;
+	struct ep* e = &ep[epnum];
+	if (!e->alloc || ep_is_in(e) || (n > e->size) || (e->ueconx & BV(STALLRQ))) return false;
+	if (mock_cycles < usb.bus_free) return false;
+	if (e->qn + (e->fw ? 1 : 0) >= e->banks) return false; /* NAK */
+	memcpy(e->q[e->qn], d, n);
+	e->qlen[e->qn++] = n;
+	usb.bus_free = mock_cycles + usb_packet_cycles(n);
+	usb.ctl_last = false;
+	ep_sync(e);
+	return true;
+}
+
+void mock_usb_set_in_sink(void (*sink)(uint8_t epnum, const uint8_t* d, uint8_t n))
+{
+	usb.in_sink = sink;
+}
+
+/* Interrupts ***********************************************************/
+
+static void vector(void (*v)(void), uint8_t c)
+{
+	mock_sreg_i = false;
+	ctx = c;
+	mock_cycles += 4; /* Entry */
+	v();
+	settle();
+	mock_cycles += 4; /* reti */
+	ctx = CTX_MAIN;
+	mock_sreg_i = true;
+}
+
+/* One vector per step, in vector table order. The timer flags are cleared on
+ * entry, as the chip does. */
+static void irq_run(void)
+{
+	if (!mock_sreg_i) return;
+	if ((io[A_UDINT] & io[A_UDIEN] & 0x7D) && USB_GEN_vect) {
+		vector(USB_GEN_vect, CTX_OTHER);
+	} else if ((io[A_TIFR1] & io[A_TIMSK1] & BV(OCF1A)) && TIMER1_COMPA_vect) {
+		io[A_TIFR1] &= ~BV(OCF1A);
+		vector(TIMER1_COMPA_vect, CTX_OTHER);
+	} else if ((io[A_TIFR1] & io[A_TIMSK1] & BV(TOV1)) && TIMER1_OVF_vect) {
+		io[A_TIFR1] &= ~BV(TOV1);
+		vector(TIMER1_OVF_vect, CTX_OTHER);
+	} else if ((io[A_TIFR0] & io[A_TIMSK0] & BV(OCF0A)) && TIMER0_COMPA_vect) {
+		io[A_TIFR0] &= ~BV(OCF0A);
+		vector(TIMER0_COMPA_vect, CTX_OTHER);
+	} else if ((io[A_TIFR0] & io[A_TIMSK0] & BV(OCF0B)) && TIMER0_COMPB_vect) {
+		io[A_TIFR0] &= ~BV(OCF0B);
+		vector(TIMER0_COMPB_vect, CTX_OTHER);
+	} else if ((io[A_TIFR0] & io[A_TIMSK0] & BV(TOV0)) && TIMER0_OVF_vect) {
+		io[A_TIFR0] &= ~BV(TOV0);
+		vector(TIMER0_OVF_vect, CTX_OTHER);
+	} else if ((io[A_UCSR1B] & BV(RXCIE1)) && (io[A_UCSR1A] & BV(RXC1)) && USART1_RX_vect) {
+		vector(USART1_RX_vect, CTX_RX);
+	} else if ((io[A_UCSR1B] & BV(UDRIE1)) && (io[A_UCSR1A] & BV(UDRE1)) && USART1_UDRE_vect) {
+		vector(USART1_UDRE_vect, CTX_UDRE);
+	}
+}
+
+/* Register access ******************************************************/
+
+static void settle(void)
+{
+	if (last_ep) {
+		ep_sync(last_ep);
+		last_ep = NULL;
+	}
+	if (pend == PEND_NONE) return;
+
+	uint8_t v = pend_byte;
+	bool written = (v != pend_val);
+	switch (pend) {
+		case PEND_TIFR: /* Bit 7 is unused and loaded set, so any write shows. */
+			if (written) io[pend_addr] &= ~(v & 0x7F);
+			break;
+		case PEND_UCSR1A:
+			if (written) {
+				io[A_UCSR1A] = (io[A_UCSR1A] & ~(BV(U2X1) | BV(MPCM1))) | (v & (BV(U2X1) | BV(MPCM1)));
+				if (v & BV(TXC1)) io[A_UCSR1A] &= ~BV(TXC1);
+			}
+			break;
+		case PEND_UDR1:
+			/* The vectors only read or only write it. Polled code reads only
+			 * with RXC1 set and the RX vector off, and a write of the byte just
+			 * loaded looks like a read. */
+			if (ctx == CTX_UDRE) uart_write(v);
+			else if ((ctx == CTX_RX) || (!written && pend_rxc && !(io[A_UCSR1B] & BV(RXCIE1)))) uart_read();
+			else uart_write(v);
+			break;
+		case PEND_UERST:
+			for (int i = 0; i < MOCK_ENDPOINTS; i++) {
+				if (v & BV(i)) {
+					ep[i].qn = ep[i].cnt = ep[i].rem = 0;
+					ep[i].fw = false;
+					ep_sync(&ep[i]);
+				}
+			}
+			break;
+		case PEND_SREG:
+			if (written) mock_sreg_i = (v & 0x80);
+			break;
+	}
+	pend = PEND_NONE;
+}
+
+static void step(void)
+{
+	in_step = true;
+	uint64_t now = mock_cycles;
+	timers_run(now);
+	uart_run(now);
+	usb_run(now);
+	irq_run();
+	if (hook) {
+		hook();
+		settle();
+	}
+	next_step = mock_cycles + STEP_CYCLES;
+	in_step = false;
+}
+
+static inline void tick(void)
+{
+	settle();
+	mock_cycles += MOCK_ACCESS_CYCLES;
+	if ((mock_cycles >= next_step) && !in_step) step();
+}
+
+static volatile uint8_t* pending(uint8_t kind, uint8_t a, uint8_t v)
+{
+	pend = kind;
+	pend_addr = a;
+	pend_val = pend_byte = v;
+	return &pend_byte;
+}
+
+volatile uint8_t* mock_reg(uint16_t a)
+{
+	tick();
+	switch (a) {
+		case A_TIFR0:
+		case A_TIFR1:
+			return pending(PEND_TIFR, a, io[a] | 0x80);
+		case A_UCSR1A:
+			return pending(PEND_UCSR1A, a, io[a]);
+		case A_UDR1:
+			pend_rxc = (uart.rxn != 0);
+			return pending(PEND_UDR1, a, uart.rxn ? uart.rx[0] : 0);
+		case A_PIND:
+			/* RXD1 on PD2, the rest reads as written to PORTD. */
+			io[a] = (io[a + 2] & ~BV(2)) | (uart_line_level(mock_cycles) << 2);
+			return &io[a];
+		case A_UERST:
+			return pending(PEND_UERST, a, 0);
+		case A_SREG:
+			return pending(PEND_SREG, a, (io[a] & 0x7F) | (mock_sreg_i ? 0x80 : 0));
+		case A_PLLCSR:
+			if (io[a] & BV(PLLE)) io[a] |= BV(PLOCK);
+			return &io[a];
+		case A_UEINTX:
+		case A_UECONX:
+		case A_UECFG0X:
+		case A_UECFG1X:
+		case A_UESTA0X:
+		case A_UESTA1X:
+		case A_UEIENX:
+		case A_UEDATX:
+		case A_UEBCLX: {
+			struct ep* e = last_ep = ep_selected();
+			switch (a) {
+				case A_UEINTX:  return &e->ueintx;
+				case A_UECONX:  return &e->ueconx;
+				case A_UECFG0X: return &e->uecfg0x;
+				case A_UECFG1X: return &e->uecfg1x;
+				case A_UESTA0X: return &e->uesta0x;
+				case A_UESTA1X: return &e->uesta1x;
+				case A_UEIENX:  return &e->ueienx;
+				case A_UEDATX:  return ep_data(e);
+				default:
+					e->uebclx = ep_bytes(e);
+					return &e->uebclx;
+			}
+		}
+		default:
+			return &io[a & 0xFF];
+	}
+}
+
+volatile uint16_t* mock_reg16(uint16_t a)
+{
+	tick();
+	return (volatile uint16_t*)&io[a & 0xFE];
+}
+
+/* Model ****************************************************************/
+
+void mock_reset(void)
+{
+	memset(io, 0, sizeof(io));
+	memset(mock_sram, 0, sizeof(mock_sram));
+	memset(&uart, 0, sizeof(uart));
+	memset(&usb, 0, sizeof(usb));
+	ep_reset_all();
+	io[A_UCSR1A] = BV(UDRE1);
+	mock_cycles = 0;
+	mock_sreg_i = false;
+	mock_uart_overruns = 0;
+	mock_uart_line_baud = 0;
+	mock_usb_in_mask = 0xFE;
+	mock_usb_control_packets = 0;
+	t0_base = t1_base = 0;
+	next_step = 0;
+	pend = PEND_NONE;
+	ctx = CTX_MAIN;
+	in_step = false;
+}
+
+void mock_set_hook(void (*h)(void))
+{
+	hook = h;
+}
+
+void mock_run(void)
+{
+	if (!setjmp(stop_jmp)) firmware_main();
+	in_step = false;
+	ctx = CTX_MAIN;
+	pend = PEND_NONE;
+}
+
+void mock_stop(void)
+{
+	longjmp(stop_jmp, 1);
+}
+
+/* Memories *************************************************************/
+
+uint8_t eeprom_read_byte(const uint8_t* p)
+{
+	return *p;
+}
+
+void eeprom_update_byte(uint8_t* p, uint8_t v)
+{
+	*p = v;
+}
+
+void eeprom_write_byte(uint8_t* p, uint8_t v)
+{
+	*p = v;
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+uint8_t boot_signature_byte_get(uint16_t addr)
+{
+	/* Lot and wafer bytes of the serial number, anything stable will do. */
+	return (uint8_t)(0x5A ^ (addr * 37));
+}
@@ -0,0 +1,96 @@
+/* Host build of fast-usbserial: the ATmega16U2 the firmware runs on.
+ *
+ * The firmware and LUFA are compiled unchanged against include/, where every
+ * register is an access through mock_reg(). The model keeps the register
+ * file, gives the USB endpoint registers their banked, per endpoint meaning,
+ * runs USART1, Timer0 and Timer1 off a cycle counter and calls the interrupt
+ * vectors when they are enabled and the I flag is set. On the other side of
+ * the USB controller sits a full speed host with a control pipe and bulk
+ * pipes, driven by the program linked against the model (sim.c, fuzz.c).
+ *
+ * Time is approximate: every register access costs MOCK_ACCESS_CYCLES and the
+ * C in between is free. Byte order, ring buffer wrap, flow control and the
+ * USB handshakes are what the chip does, which is what the host build is for.
+ *
+ * Under the LUFA License, see ../fast-usbserial.c. */
+
+#ifndef _MOCK_H_
+#define _MOCK_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <stddef.h>
+
+	/* Macros: */
+		#define MOCK_F_CPU           16000000UL
+		#define MOCK_ACCESS_CYCLES   3
+		#define MOCK_ENDPOINTS       5
+		#define MOCK_DPRAM           176
+
+		/** Longest a control transfer may take before it counts as a hang, in cycles. */
+		#define MOCK_CTL_TIMEOUT     (MOCK_F_CPU / 10)
+
+		/** Bus reset this long after the firmware attaches, in cycles. */
+		#define MOCK_ATTACH_DELAY    (MOCK_F_CPU / 1000)
+
+		/* mock_usb_control_status() */
+		#define MOCK_CTL_IDLE        0
+		#define MOCK_CTL_BUSY        1
+		#define MOCK_CTL_ACK         2
+		#define MOCK_CTL_STALL       3
+
+	/* External Variables: */
+		/** CPU cycles since mock_reset(). */
+		extern uint64_t mock_cycles;
+
+		/** Called when the firmware stops making progress (a control transfer times
+		 *  out). Prints and aborts unless replaced. */
+		extern void (*mock_hang)(const char* why);
+
+		/** TX wired back to RX, like a loopback plug. */
+		extern bool mock_uart_loopback;
+
+		/** Rate of the device on the RX line, 8N1; 0 for that of the USART. */
+		extern uint32_t mock_uart_line_baud;
+
+		/** Bytes lost on RX because the firmware did not read UDR1 in time. */
+		extern uint32_t mock_uart_overruns;
+
+		/** Endpoints the host polls for IN data, bit n for endpoint n. */
+		extern uint8_t mock_usb_in_mask;
+
+		/** Packets on the control pipe, SETUP, data and status. Each one takes the bus for
+		 *  its bit time, a real host adds its own scheduling on top. */
+		extern uint32_t mock_usb_control_packets;
+
+	/* Function Prototypes: */
+		/* Model */
+		void mock_reset(void);
+		void mock_run(void);
+		void mock_stop(void);
+		void mock_set_hook(void (*hook)(void));
+
+		/* USART1, line side */
+		size_t mock_uart_send(const uint8_t* d, size_t n);
+
+		/** Puts d on the line with err, FE1 and/or UPE1 as UCSR1A shows them. */
+		bool mock_uart_send_error(uint8_t d, uint8_t err);
+		size_t mock_uart_pending(void);
+		void mock_uart_set_sink(void (*sink)(uint8_t d));
+
+		/** Cycle the start bit of the byte last given to the sink went out. */
+		uint64_t mock_uart_tx_start(void);
+
+		/* USB, host side */
+		bool mock_usb_ready(void);
+		bool mock_usb_control(const uint8_t* setup, const uint8_t* data);
+		uint8_t mock_usb_control_status(void);
+		const uint8_t* mock_usb_control_data(uint16_t* len);
+		bool mock_usb_out(uint8_t epnum, const uint8_t* d, uint8_t n);
+		void mock_usb_set_in_sink(void (*sink)(uint8_t epnum, const uint8_t* d, uint8_t n));
+
+		/* The firmware's main(), renamed by the host Makefile. */
+		int firmware_main(void);
+
+#endif
@@ -0,0 +1,1258 @@
+/* Traffic through the host build of fast-usbserial: enumerates the
+ * firmware like a host would, then streams a PRBS-15 pattern through the
+ * real ring buffers and ISRs and checks every byte. Modes as tools/bench.py:
+ *
+ *   loop  host -> OUT -> USART -> loopback plug -> USART -> IN -> host
+ *   tx    host -> OUT -> USART line
+ *   rx    USART line -> IN -> host
+ *   capture  as rx in SERIAL_MODE_CAPTURE (ENABLE_CAPTURE), also checks
+ *         that the byte and SOF timestamps match the line and the frames
+ *   cmd   single byte OUT packets through a loopback plug, each some time
+ *         after the one before it came back, like command traffic: prints
+ *         the latency from the OUT packet to its start bit on the line and
+ *         to its echo in an IN packet
+ *   enum  no traffic, the requests Linux sends from the bus reset to an
+ *         open port: prints how long after power-up the port was ready
+ *         and how many control packets it took
+ *   onewire  command packets in SERIAL_MODE_ONEWIRE (ENABLE_ONEWIRE), the
+ *         loopback plug echoing every slot; every 4th packet goes with it
+ *         pulled and has to come back as OW_ERR_NO_ECHO. At the end the
+ *         host stops reading, sends one more and sets SERIAL_MODE_UART,
+ *         which has to go through. -n counts packets
+ *   lin   LIN_CMD_FRAME packets in SERIAL_MODE_LIN (ENABLE_LIN) through a
+ *         loopback plug: each one's frame has to come back as one record,
+ *         published, with the enhanced checksum right. Then the slave table
+ *         answers a 10ms schedule for 100ms: 10 frames, give or take one.
+ *         -n counts the single frames, -c 2 runs the timing under the
+ *         latency configuration's flush timer
+ *   autobaud  as rx, but the host sets another rate and SERIAL_MODE_AUTOBAUD
+ *         (ENABLE_AUTOBAUD): the rate found must be within 2% of the line's,
+ *         and no byte after it garbled. Prints how long it took
+ *
+ * Prints simulated time and throughput, and how fast the simulation ran.
+ * With -p ms the host stops reading IN packets for that long at the start
+ * of every simulated second, a stall the USART to USB ring has to cover.
+ * What it drops must be a gap in the stream (the newest bytes) and match
+ * the device's count (VENDOR_REQ_GetDropped) and its notifications.
+ * With -e the EEPROM holds a fixed line coding at the test baud rate (see
+ * eeconfig.h) and the line starts at power-up, long before the host
+ * configures the device: no byte of it may be lost. -c picks the USB
+ * configuration (2 is the latency one of ENABLE_DUAL_CONFIG). -E n, in
+ * the rx mode, turns the error marking of ENABLE_PARMRK on and sends every
+ * nth byte with a framing error: the stream is unescaped as Linux does, and
+ * exactly those bytes must come out marked. -X, in the tx
+ * and rx modes, turns the XON/XOFF flow control of ENABLE_XONXOFF on and
+ * keeps 0x11 and 0x13 out of the pattern. In tx the target sends XOFF
+ * every 100 bytes and XON 2ms later: at most one byte may start after the
+ * XOFF is in. In rx the target stops on the device's XOFF, with -p nothing
+ * may be dropped. -D ms, in the rx mode, has an application open the port
+ * (DTR) but not read it, close it after half that time and the next one
+ * open it after all of it (ENABLE_HOST_PRESENCE). Of what the line sent
+ * before that open only the last few bytes may come in, none of the first
+ * application's. Unless they are held for the port (-e or -X), then all of
+ * it must.
+ *
+ * Under the LUFA License, see ../fast-usbserial.c. */
+
+#undef main
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "fast-usbserial.h"
+#include "mock.h"
+#include "eeconfig.h"
+#ifdef ENABLE_LATENCY_STATS
+#include "latency.h"
+#endif
+#ifdef ENABLE_TRACE
+#include "trace.h"
+#endif
+#ifdef ENABLE_PROFILE
+#include "profile.h"
+#endif
+#ifdef ENABLE_CAPTURE
+#include "capture.h"
+#endif
+#ifdef ENABLE_PASS_STATS
+#include "passtime.h"
+#endif
+#ifdef ENABLE_ONEWIRE
+#include "onewire.h"
+#endif
+#ifdef ENABLE_LIN
+#include "lin.h"
+#endif
+
+#define PRBS_PERIOD 32767
+
+enum { MODE_LOOP, MODE_TX, MODE_RX, MODE_CAPTURE, MODE_CMD, MODE_ENUM, MODE_AUTOBAUD, MODE_ONEWIRE, MODE_LIN };
+
+static uint8_t  Pattern[PRBS_PERIOD];
+static int      Mode = MODE_LOOP;
+static uint32_t Baud = 115200;
+static uint32_t HostBaud;    /* Line coding the host sets. */
+static uint64_t Total = 1000000;
+static bool     Quiet;
+static uint32_t PauseMs;
+static bool     Armed;       /* -e */
+static uint8_t  Config = CONFIG_THROUGHPUT; /* -c */
+static uint32_t ErrEvery;    /* -E */
+static bool     XonXoff;     /* -X */
+static uint32_t OpenMs;      /* -D */
+
+static int      Step;        /* Enumeration step, then streaming. */
+static uint64_t Sent;        /* Into the device (OUT) or onto the line (rx). */
+static uint64_t Received;    /* Out of the device, IN or line. */
+static uint64_t Skipped;     /* Gaps in what came out, dropped by the device. */
+static uint64_t Dropped;     /* What the device says it dropped. */
+static uint64_t Notified;    /* SERIAL_STATE overrun notifications, or VENDOR_STATUS_DROPPED packets. */
+static uint64_t Errors;
+static uint64_t BadSent;     /* Bytes put on the line with a framing error, -E. */
+static uint64_t Marked;      /* Bytes that came out marked. */
+static uint64_t SentAtOpen;  /* -D: onto the line when the host set DTR. */
+static uint64_t Configured;  /* Cycle the enumeration was through. */
+static int      OpenStep;    /* -D: requests of the close and the open, 4 once through. */
+static uint64_t XoffAt;      /* -X: cycle the target's XOFF was in, 0 while it is not stopping the device. */
+static uint64_t XoffDue;     /* ... or the cycle it goes on the line, at any point of a character. */
+static bool     XoffSent;    /* ... or is on the line. */
+static uint32_t Late;        /* Bytes that started after it, since the XOFF. */
+static uint32_t LateMax;
+static uint32_t Xoffs;       /* XOFFs the target sent (tx) or got (rx). */
+static bool     TargetHeld;  /* rx: the device sent XOFF. */
+static uint64_t LastProgress;
+static bool     Stalled;
+static bool     Failed;
+#ifdef ENABLE_VENDOR_BULK
+static int      Seq = -1;
+static uint64_t SeqErrors;
+#endif
+
+/* cmd mode */
+static uint64_t CmdSentAt;   /* Cycle the OUT packet went in. */
+static uint64_t CmdNext;     /* Cycle the next one may go. */
+static uint32_t* CmdLatency; /* Cycles to its start bit, one per byte. */
+static uint32_t* CmdEcho;    /* Cycles to its echo in an IN packet. */
+static uint64_t Echoed;
+
+/* enum mode */
+static uint64_t EnumStart;   /* Cycle of the first SETUP. */
+static uint64_t EnumDone;    /* Cycle the port was open. */
+static uint32_t EnumTransfers;
+
+/* autobaud mode */
+static uint64_t AutobaudStart; /* Cycle the mode was set. */
+static uint64_t AutobaudLock;  /* Cycle the firmware was back in SERIAL_MODE_UART. */
+static uint32_t AutobaudFound; /* VENDOR_REQ_GetAutobaud */
+
+/* onewire mode */
+static uint8_t  OwExpect[CDC_OUT_EPSIZE]; /* Reply to the packet in flight. */
+static uint8_t  OwExpectLen;
+static bool     OwWaiting;   /* For that reply. */
+static uint32_t OwNoEcho;    /* Packets sent with the plug pulled. */
+static bool     OwSwitched;  /* Back in SERIAL_MODE_UART with a reply unread. */
+
+#ifdef ENABLE_LIN
+/* lin mode */
+#define LIN_SIM_ID      0x12 /* Of the single frames. */
+#define LIN_SIM_SLOT_ID 0x21 /* Of the scheduled ones, the slave table answers it. */
+#define LIN_SIM_SLOT_MS 10
+#define LIN_SIM_SLOTS   10
+static const uint8_t LinSlave[2] = { 0xA5, 0x3C };
+static uint8_t  LinExpect[4]; /* Data of the single frame in flight. */
+static uint32_t LinAt;        /* Where in the pattern the next one's data starts. */
+static bool     LinWaiting;   /* For its record. */
+static uint64_t LinSchedAt;   /* Cycle the schedule was set, 0 before. */
+static uint64_t LinSchedEnd;  /* ... and stopped. */
+static uint32_t LinSlots;     /* Scheduled frames that came back right. */
+#endif
+
+static void prbs_init(void)
+{
+	uint16_t s = 0x7FFF;
+	for (int i = 0; i < PRBS_PERIOD; i++) {
+		uint8_t b = 0;
+		for (int k = 0; k < 8; k++) {
+			uint8_t bit = ((s >> 14) ^ (s >> 13)) & 1;
+			s = ((s << 1) | bit) & 0x7FFF;
+			b = (b << 1) | bit;
+		}
+		Pattern[i] = b;
+	}
+}
+
+/* Where d continues the pattern after a gap of up to a period, 0 if nowhere. */
+static uint32_t resync(const uint8_t* d, uint8_t n)
+{
+	if (n > 8) n = 8;
+	for (uint32_t gap = 1; gap < PRBS_PERIOD; gap++) {
+		uint64_t at = Received + Skipped + gap;
+		uint8_t k = 0;
+		while ((k < n) && (d[k] == Pattern[(at + k) % PRBS_PERIOD])) k++;
+		if (k == n) return gap;
+	}
+	return 0;
+}
+
+static void check(const uint8_t* d, uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++, Received++) {
+		if (d[i] == Pattern[(Received + Skipped) % PRBS_PERIOD]) continue;
+		uint32_t gap = ((Mode == MODE_RX) || (Mode == MODE_LOOP) || (Mode == MODE_AUTOBAUD)) ? resync(d + i, n - i) : 0;
+		if (gap) Skipped += gap;
+		else Errors++;
+	}
+	LastProgress = mock_cycles;
+}
+
+#ifdef ENABLE_CAPTURE
+static struct {
+	uint8_t  Rec[7];
+	uint8_t  Len;
+	uint8_t  Status;
+	uint32_t Time;
+	uint32_t First;       /* Time of the first byte. */
+	uint32_t Prev;        /* Time of the previous byte. */
+	uint32_t MinDelta, MaxDelta;
+	uint64_t Bytes, Sofs;
+	int32_t  SofFrame;    /* -1 before the first one */
+	uint32_t SofTime;
+	uint32_t SofJitter;   /* Largest error of a SOF time, against 1ms a frame. */
+	bool     Started;
+} Cap = { .MinDelta = UINT32_MAX, .SofFrame = -1 };
+
+/* Record length from its first byte. */
+static uint8_t capture_rec_len(uint8_t c)
+{
+	if (c < 0x80) return 2;
+	if (c < 0xC0) return 3;
+	if (c == CAPTURE_REC_TIME) return 5;
+	if (c == CAPTURE_REC_SOF) return 7;
+	if (c == CAPTURE_REC_STATUS) return 2;
+	return 1;
+}
+
+/* Decodes the capture stream, records may run over packet boundaries. */
+static void capture_decode(const uint8_t* d, uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		uint8_t* r = Cap.Rec;
+		r[Cap.Len++] = d[i];
+		if (Cap.Len < capture_rec_len(r[0])) continue;
+		Cap.Len = 0;
+		if (r[0] == CAPTURE_REC_TIME) {
+			Cap.Time = r[1] | (r[2] << 8) | (r[3] << 16) | ((uint32_t)r[4] << 24);
+			Cap.Started = true;
+		} else if (r[0] == CAPTURE_REC_SOF) {
+			int32_t f = r[1] | (r[2] << 8);
+			uint32_t t = r[3] | (r[4] << 8) | (r[5] << 16) | ((uint32_t)r[6] << 24);
+			if (Cap.SofFrame >= 0) {
+				int64_t err = (int64_t)(t - Cap.SofTime) - (int64_t)((f - Cap.SofFrame) & 0x7FF) * 1000;
+				if (err < 0) err = -err;
+				if (err > Cap.SofJitter) Cap.SofJitter = err;
+			}
+			Cap.SofFrame = f;
+			Cap.SofTime = t;
+			Cap.Sofs++;
+		} else if (r[0] == CAPTURE_REC_STATUS) {
+			Cap.Status = r[1];
+		} else if (r[0] < 0xC0) {
+			uint8_t b = (r[0] < 0x80) ? r[1] : r[2];
+			Cap.Time += (r[0] < 0x80) ? r[0] : (((r[0] & 0x3F) << 8) | r[1]);
+			if (!Cap.Started || Cap.Status) Errors++;
+			Cap.Status = 0;
+			if (Cap.Bytes) {
+				uint32_t delta = Cap.Time - Cap.Prev;
+				if (delta < Cap.MinDelta) Cap.MinDelta = delta;
+				if (delta > Cap.MaxDelta) Cap.MaxDelta = delta;
+			} else {
+				Cap.First = Cap.Time;
+			}
+			Cap.Prev = Cap.Time;
+			Cap.Bytes++;
+			check(&b, 1);
+		} else {
+			Errors++;
+		}
+	}
+}
+#endif
+
+/* Takes the PARMRK escapes out of an IN packet, they may run over packet boundaries. */
+static uint8_t unmark(uint8_t* d, uint8_t n)
+{
+	static uint8_t state; /* Bytes of an escape seen, 0xFF then 0x00. */
+	uint8_t k = 0;
+	for (uint8_t i = 0; i < n; i++) {
+		uint8_t b = d[i];
+		if ((state == 0) && (b == 0xFF)) {
+			state = 1;
+		} else if ((state == 1) && !b) {
+			state = 2;
+		} else {
+			if (state == 1) {
+				if (b != 0xFF) Errors++;
+			} else if (state == 2) {
+				Marked++;
+			}
+			state = 0;
+			d[k++] = b;
+		}
+	}
+	return k;
+}
+
+#ifdef ENABLE_LIN
+/* One frame record: published by the device, single or from the slave table, and whole. */
+static void lin_record(const uint8_t* d, uint8_t n)
+{
+	bool sched = (LinSchedAt != 0);
+	const uint8_t* data = sched ? LinSlave : LinExpect;
+	uint8_t len = sched ? sizeof(LinSlave) : sizeof(LinExpect);
+	if ((n != len + 4) || ((d[0] & ~LIN_FRAME_CLASSIC_OK) != (LIN_FRAME_PUBLISHED | LIN_FRAME_ENHANCED_OK)) ||
+	    ((d[1] & 0x3F) != (sched ? LIN_SIM_SLOT_ID : LIN_SIM_ID)) || (d[2] != len + 1) || memcmp(d + 3, data, len))
+	  Errors++;
+	else if (sched) LinSlots++;
+	else Received++;
+	LinWaiting = false;
+	LastProgress = mock_cycles;
+}
+#endif
+
+static void in_sink(uint8_t epnum, const uint8_t* d, uint8_t n)
+{
+#if !defined(ENABLE_VENDOR_BULK)
+	if (epnum == CDC_NOTIFICATION_EPNUM) {
+		/* SERIAL_STATE, the header and the state in two packets. */
+		static bool header;
+		if ((n == 8) && (d[1] == NOTIF_SerialState)) header = true;
+		else if (header && (n == 2) && (d[0] & CDC_CONTROL_LINE_IN_OVERRUNERROR)) Notified++;
+		else Errors++;
+		if (n != 8) header = false;
+		return;
+	}
+#else
+	(void)epnum;
+#endif
+	/* The modes' replies are whole packets of their own, without a vendor header. */
+	if (Mode == MODE_ONEWIRE) {
+		if (!OwWaiting || (n != OwExpectLen) || memcmp(d, OwExpect, n)) Errors++;
+		else Received++;
+		OwWaiting = false;
+		LastProgress = mock_cycles;
+		return;
+	}
+#ifdef ENABLE_LIN
+	if (Mode == MODE_LIN) {
+		lin_record(d, n);
+		return;
+	}
+#endif
+#ifdef ENABLE_VENDOR_BULK
+	if (n < VENDOR_HDR_LEN) {
+		Errors++;
+		return;
+	}
+	if ((Seq >= 0) && (d[0] != ((Seq + 1) & 0xFF))) SeqErrors++;
+	if (d[1] & VENDOR_STATUS_DROPPED) Notified++;
+	Seq = d[0];
+	d += VENDOR_HDR_LEN;
+	n -= VENDOR_HDR_LEN;
+#endif
+#ifdef ENABLE_PARMRK
+	uint8_t plain[256];
+	if (ErrEvery) {
+		memcpy(plain, d, n);
+		n = unmark(plain, n);
+		d = plain;
+	}
+#endif
+#ifdef ENABLE_CAPTURE
+	if (Mode == MODE_CAPTURE) {
+		capture_decode(d, n);
+		return;
+	}
+#endif
+	if (Mode == MODE_CMD) {
+		for (uint8_t i = 0; i < n; i++, Echoed++) {
+			if ((Echoed >= Sent) || (d[i] != Pattern[Echoed % PRBS_PERIOD])) Errors++;
+			else CmdEcho[Echoed] = mock_cycles - CmdSentAt;
+		}
+		return;
+	}
+	if (Mode != MODE_TX) check(d, n);
+}
+
+static void line_sink(uint8_t d)
+{
+	if (XonXoff && (Mode == MODE_RX)) {
+		/* The device's XOFF and XON, all it sends in this mode. */
+		if (d == 0x13) Xoffs++;
+		if ((d == 0x13) || (d == 0x11)) TargetHeld = (d == 0x13);
+		else Errors++;
+		return;
+	}
+	if (XonXoff && (Mode == MODE_TX)) {
+		if (XoffAt && (mock_uart_tx_start() > XoffAt)) Late++;
+		if (!XoffSent && !XoffDue && ((Received % 100) == 50))
+		  XoffDue = mock_cycles + 1 + rand() % (10 * MOCK_F_CPU / Baud);
+	}
+	if (Mode == MODE_CMD) {
+		CmdLatency[Received] = mock_uart_tx_start() - CmdSentAt;
+		/* Idle for 20us to 1ms, so the packets land anywhere in the main loop. */
+		CmdNext = mock_cycles + (20 + rand() % 1000) * (MOCK_F_CPU / 1000000);
+	}
+	if ((Mode == MODE_TX) || (Mode == MODE_CMD)) check(&d, 1);
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+
+/* Enumeration, as far as the firmware cares. */
+static uint8_t Setup[][8] = {
+	{ 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x12, 0x00 }, /* GET_DESCRIPTOR device */
+	{ 0x00, 0x05, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* SET_ADDRESS 1 */
+	{ 0x80, 0x06, 0x00, 0x02, 0x00, 0x00, 0xFF, 0x00 }, /* GET_DESCRIPTOR configuration */
+	{ 0x00, 0x09, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* SET_CONFIGURATION, -c */
+#ifdef ENABLE_VENDOR_BULK
+	{ 0x40, VENDOR_REQ_SetLineCoding, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00 },
+	{ 0x40, VENDOR_REQ_SetControlLines, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 },
+#else
+	{ 0x21, 0x20, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00 }, /* SET_LINE_CODING */
+	{ 0x21, 0x22, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* SET_CONTROL_LINE_STATE DTR RTS */
+#endif
+#ifdef ENABLE_PARMRK
+	{ 0x40, VENDOR_REQ_SetParmrk, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* -E */
+#endif
+#ifdef ENABLE_XONXOFF
+	{ 0x40, VENDOR_REQ_SetFlow, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },   /* -X */
+#endif
+};
+#define SETUP_COUNT (sizeof(Setup) / sizeof(Setup[0]))
+
+#ifdef ENABLE_LATENCY_STATS
+/* Reads VENDOR_REQ_GetLatency once the stream is through, true when printed. */
+static bool latency_done(void)
+{
+	static const uint8_t get[8] = { 0xC0, VENDOR_REQ_GetLatency, 0x00, 0x00, 0x00, 0x00,
+	                                LATENCY_BUCKETS * 4, 0x00 };
+	static bool sent, got;
+	static const char* const names[] = { "USART to USB", "USB to USART" };
+
+	if (got) return true; /* The requests after this one reuse the control pipe. */
+	if (!sent) {
+		mock_usb_control(get, NULL);
+		sent = true;
+		return false;
+	}
+	if (mock_usb_control_status() == MOCK_CTL_BUSY) return false;
+
+	got = true;
+	uint16_t len;
+	const uint8_t* d = mock_usb_control_data(&len);
+	if ((mock_usb_control_status() != MOCK_CTL_ACK) || (len != LATENCY_BUCKETS * 4)) {
+		printf("latency: request failed\n");
+		Failed = true;
+		return true;
+	}
+	if (Quiet) return true;
+	for (int dir = 0; dir < 2; dir++) {
+		printf("residence %s:", names[dir]);
+		for (int b = 0; b < LATENCY_BUCKETS; b++) {
+			uint16_t n = d[(dir * LATENCY_BUCKETS + b) * 2] | (d[(dir * LATENCY_BUCKETS + b) * 2 + 1] << 8);
+			if (!b) printf(" <32us %u", n);
+			else if (b < LATENCY_BUCKETS - 1) printf(", %uus %u", 16 << b, n);
+			else printf(", >=%uus %u", 16 << b, n);
+		}
+		printf("\n");
+	}
+	return true;
+}
+#endif
+
+#ifdef ENABLE_PROFILE
+/* Reads VENDOR_REQ_GetProfile once the stream is through, true when done.
+ * The host build samples no PC, this checks the sample clock and the reply. */
+static bool profile_done(void)
+{
+	static const uint8_t get[8] = { 0xC0, VENDOR_REQ_GetProfile, 0x00, 0x00, 0x00, 0x00,
+	                                5 + PROFILE_BUCKETS * 2, 0x00 };
+	static bool sent, got;
+
+	if (got) return true; /* The requests after this one reuse the control pipe. */
+	if (!sent) {
+		mock_usb_control(get, NULL);
+		sent = true;
+		return false;
+	}
+	if (mock_usb_control_status() == MOCK_CTL_BUSY) return false;
+
+	got = true;
+	uint16_t len;
+	const uint8_t* d = mock_usb_control_data(&len);
+	if ((mock_usb_control_status() != MOCK_CTL_ACK) || (len != 5 + PROFILE_BUCKETS * 2) ||
+	    (d[2] != PROFILE_DEFAULT_SHIFT)) {
+		printf("profile: request failed\n");
+		Failed = true;
+		return true;
+	}
+	uint64_t samples = d[3] | (d[4] << 8);
+	for (int b = 0; b < PROFILE_BUCKETS; b++) samples += d[5 + b * 2] | (d[6 + b * 2] << 8);
+	uint64_t expect = mock_cycles / (PROFILE_STEP * 256);
+	/* Sampling pauses during control requests, and counts stop at 0xFFFF. */
+	if ((samples > expect + 1) || ((samples < expect * 9 / 10) && (samples < 0xFFFF))) {
+		printf("profile: %llu samples, expected about %llu\n", (unsigned long long)samples,
+		       (unsigned long long)expect);
+		Failed = true;
+	} else if (!Quiet) {
+		printf("profile: %llu samples, one per %.1fus\n", (unsigned long long)samples,
+		       samples ? (double)mock_cycles / MOCK_F_CPU * 1e6 / samples : 0.0);
+	}
+	return true;
+}
+#endif
+
+#ifdef ENABLE_PASS_STATS
+/* Reads VENDOR_REQ_GetPassTime once the stream is through, true when done. The host build
+ * counts register accesses, not instructions, so the times are the model's. */
+static bool passtime_done(void)
+{
+	static const uint8_t get[8] = { 0xC0, VENDOR_REQ_GetPassTime, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00 };
+	static const char* const stages[] = { "IN", "OUT", "SETUP", "tick" };
+	static bool sent, got;
+
+	if (got) return true; /* The requests after this one reuse the control pipe. */
+	if (!sent) {
+		mock_usb_control(get, NULL);
+		sent = true;
+		return false;
+	}
+	if (mock_usb_control_status() == MOCK_CTL_BUSY) return false;
+
+	got = true;
+	uint16_t len;
+	const uint8_t* d = mock_usb_control_data(&len);
+	uint32_t passes = d[0] | (d[1] << 8) | (d[2] << 16) | ((uint32_t)d[3] << 24);
+	uint16_t longest = d[4] | (d[5] << 8);
+	if ((mock_usb_control_status() != MOCK_CTL_ACK) || (len != 8) || !passes || !longest) {
+		printf("pass time: request failed\n");
+		Failed = true;
+		return true;
+	}
+	if (Quiet) return true;
+	printf("passes %lu, longest %u cycles (%.1f us) serving", (unsigned long)passes, longest,
+	       longest * 1e6 / MOCK_F_CPU);
+	for (int i = 0; i < 4; i++)
+	  if (d[6] & (1 << i)) printf(" %s", stages[i]);
+	printf(", with a control request %u us\n", d[7] * 16);
+	return true;
+}
+#endif
+
+#ifdef ENABLE_TRACE
+static uint64_t TraceIn, TraceOut, TraceRecords, TraceLost;
+
+/* Drains the trace while streaming, a host polling VENDOR_REQ_GetTrace back
+ * to back. Once the stream is through, true when the ring is empty. */
+static bool trace_poll(bool final)
+{
+	static const uint8_t get[8] = { 0xC0, VENDOR_REQ_GetTrace, 0x00, 0x00, 0x00, 0x00,
+	                                TRACE_HDR_LEN + TRACE_LEN * TRACE_RECORD_LEN, 0x00 };
+	static bool sent;
+
+	if (sent) {
+		uint8_t st = mock_usb_control_status();
+		if (st == MOCK_CTL_BUSY) return false;
+		sent = false;
+		uint16_t len;
+		const uint8_t* d = mock_usb_control_data(&len);
+		if ((st != MOCK_CTL_ACK) || (len < TRACE_HDR_LEN) || (len != TRACE_HDR_LEN + d[1] * TRACE_RECORD_LEN)) {
+			printf("trace: bad reply\n");
+			Failed = true;
+			return true;
+		}
+		TraceLost += d[0];
+		for (uint8_t i = 0; i < d[1]; i++) {
+			const uint8_t* r = d + TRACE_HDR_LEN + i * TRACE_RECORD_LEN;
+			if ((r[0] == TRACE_EV_IN) || (r[0] == TRACE_EV_IN_FLUSH)) TraceIn += r[1];
+			if (r[0] == TRACE_EV_OUT) TraceOut += r[1];
+			TraceRecords++;
+		}
+		if (final && !d[1]) return true;
+	}
+	mock_usb_control(get, NULL);
+	sent = true;
+	return false;
+}
+#endif
+
+/* Reads VENDOR_REQ_GetDropped once the stream is through, true when done. */
+static bool dropped_done(void)
+{
+	static const uint8_t get[8] = { 0xC0, VENDOR_REQ_GetDropped, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00 };
+	static bool sent, got;
+
+	if (got) return true; /* The requests after this one reuse the control pipe. */
+	if (!sent) {
+		mock_usb_control(get, NULL);
+		sent = true;
+		return false;
+	}
+	if (mock_usb_control_status() == MOCK_CTL_BUSY) return false;
+
+	got = true;
+	uint16_t len;
+	const uint8_t* d = mock_usb_control_data(&len);
+	if ((mock_usb_control_status() != MOCK_CTL_ACK) || (len != 4)) {
+		printf("dropped: request failed\n");
+		Failed = true;
+		return true;
+	}
+	Dropped = d[0] | (d[1] << 8) | (d[2] << 16) | ((uint32_t)d[3] << 24);
+	return true;
+}
+
+#ifdef ENABLE_AUTOBAUD
+/* Reads VENDOR_REQ_GetAutobaud once the stream is through, true when done. */
+static bool autobaud_done(void)
+{
+	static const uint8_t get[8] = { 0xC0, VENDOR_REQ_GetAutobaud, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00 };
+	static bool sent, got;
+
+	if (got) return true;
+	if (!sent) {
+		mock_usb_control(get, NULL);
+		sent = true;
+		return false;
+	}
+	if (mock_usb_control_status() == MOCK_CTL_BUSY) return false;
+
+	got = true;
+	uint16_t len;
+	const uint8_t* d = mock_usb_control_data(&len);
+	if ((mock_usb_control_status() != MOCK_CTL_ACK) || (len != 4)) {
+		printf("autobaud: request failed\n");
+		Failed = true;
+		return true;
+	}
+	AutobaudFound = d[0] | (d[1] << 8) | (d[2] << 16) | ((uint32_t)d[3] << 24);
+	return true;
+}
+#endif
+
+/* Keeps the line busy in the modes that receive. */
+static void line_feed(void)
+{
+	while ((Sent < Total) && (mock_uart_pending() < 16) && !TargetHeld) {
+		uint8_t d = Pattern[Sent % PRBS_PERIOD];
+		if (ErrEvery && ((Sent % ErrEvery) == ErrEvery - 1)) {
+			mock_uart_send_error(d, _BV(FE1));
+			BadSent++;
+		} else {
+			mock_uart_send(&d, 1);
+		}
+		Sent++;
+	}
+}
+
+#ifdef ENABLE_ONEWIRE
+/* onewire mode: a reset, 4 bytes and a bit a packet. Through the plug the reset sees no
+ * presence pulse and the rest comes back as sent. */
+static void onewire_run(void)
+{
+	static int step;
+	static const uint8_t set_uart[8] = { 0x40, VENDOR_REQ_SetMode, SERIAL_MODE_UART, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+	if (mock_cycles - LastProgress > MOCK_F_CPU) {
+		Stalled = true;
+		mock_stop();
+		return;
+	}
+	if (step == 2) {
+		uint8_t s = mock_usb_control_status();
+		if (s == MOCK_CTL_BUSY) return;
+		OwSwitched = (s == MOCK_CTL_ACK) && (SerialMode == SERIAL_MODE_UART);
+		mock_stop();
+		return;
+	}
+	if (OwWaiting) {
+		/* The last packet: its reply waits for the host, the mode switch may not. */
+		if ((step == 1) && mock_usb_ready() && mock_usb_control(set_uart, NULL)) step = 2;
+		return;
+	}
+	if (Sent >= Total) {
+		mock_usb_in_mask = 0;
+		step = 1;
+	}
+	bool plug = (Sent % 4) != 3;
+	uint8_t d[CDC_OUT_EPSIZE];
+	uint8_t n = 0;
+	d[n++] = OW_CMD_RESET;
+	d[n++] = OW_CMD_TOUCH;
+	d[n++] = 4;
+	for (int i = 0; i < 4; i++) d[n++] = Pattern[(Sent * 4 + i) % PRBS_PERIOD];
+	d[n++] = OW_CMD_BIT;
+	d[n++] = 1;
+	if (!mock_usb_out(CDC_RX_EPNUM, d, n)) return;
+	mock_uart_loopback = plug;
+	OwExpectLen = 0;
+	if (plug) {
+		OwExpect[OwExpectLen++] = 0;
+		memcpy(&OwExpect[OwExpectLen], &d[3], 4);
+		OwExpectLen += 4;
+		OwExpect[OwExpectLen++] = 1;
+	} else {
+		OwExpect[OwExpectLen++] = OW_ERR_NO_ECHO;
+		OwNoEcho++;
+	}
+	OwWaiting = true;
+	if (step == 0) Sent++;
+	LastProgress = mock_cycles;
+}
+#endif
+
+#ifdef ENABLE_LIN
+static uint8_t lin_pid(uint8_t id)
+{
+	uint8_t p0 = (id ^ (id >> 1) ^ (id >> 2) ^ (id >> 4)) & 1;
+	uint8_t p1 = ~((id >> 1) ^ (id >> 3) ^ (id >> 4) ^ (id >> 5)) & 1;
+	return (id & 0x3F) | (p0 << 6) | (p1 << 7);
+}
+
+/* The next 4 bytes of the pattern for a frame. The mock takes a polled write of the byte still
+ * waiting in UDR1 for a read (see settle() in mock.c), through the plug that is the echo of the
+ * byte two before on the line: data where the sync, PID, data and checksum would do that is
+ * skipped. */
+static void lin_data(void)
+{
+	uint8_t w[2 + sizeof(LinExpect) + 1];
+	bool clean;
+	do {
+		w[0] = 0x55;
+		w[1] = lin_pid(LIN_SIM_ID);
+		uint16_t sum = w[1];
+		for (unsigned i = 0; i < sizeof(LinExpect); i++) {
+			w[2 + i] = Pattern[(LinAt + i) % PRBS_PERIOD];
+			sum += w[2 + i];
+			if (sum > 0xFF) sum -= 0xFF;
+		}
+		w[sizeof(w) - 1] = ~sum;
+		clean = true;
+		for (unsigned i = 2; i < sizeof(w); i++) clean = clean && (w[i] != w[i - 2]);
+		LinAt++;
+	} while (!clean);
+	memcpy(LinExpect, w + 2, sizeof(LinExpect));
+	LinAt += sizeof(LinExpect) - 1;
+}
+
+/* lin mode: single frames with 4 bytes of the pattern, one at a time, then the schedule. */
+static void lin_run(void)
+{
+	static const uint8_t stop[3] = { LIN_CMD_SCHEDULE, 0, 0 };
+	const uint64_t ms = MOCK_F_CPU / 1000;
+
+	if (mock_cycles - LastProgress > MOCK_F_CPU) {
+		Stalled = true;
+		mock_stop();
+		return;
+	}
+	if (LinSchedEnd) {
+		/* The frame of the last slot is through by now. */
+		if (mock_cycles - LinSchedEnd > 20 * ms) mock_stop();
+		return;
+	}
+	if (LinSchedAt) {
+		/* Stopped half way through the slot after the last one. */
+		if (mock_cycles - LinSchedAt < (LIN_SIM_SLOTS * 2 + 1) * LIN_SIM_SLOT_MS * ms / 2) return;
+		if (mock_usb_out(CDC_RX_EPNUM, stop, sizeof(stop))) LinSchedEnd = mock_cycles;
+		return;
+	}
+	if (LinWaiting) return;
+
+	uint8_t d[CDC_OUT_EPSIZE];
+	uint8_t n = 0;
+	if (Sent < Total) {
+		d[n++] = LIN_CMD_FRAME;
+		d[n++] = LIN_SIM_ID;
+		d[n++] = sizeof(LinExpect);
+		lin_data();
+		memcpy(&d[n], LinExpect, sizeof(LinExpect));
+		n += sizeof(LinExpect);
+		if (!mock_usb_out(CDC_RX_EPNUM, d, n)) return;
+		LinWaiting = true;
+		Sent++;
+	} else {
+		d[n++] = LIN_CMD_SLAVE_SET;
+		d[n++] = LIN_SIM_SLOT_ID;
+		d[n++] = sizeof(LinSlave);
+		for (unsigned i = 0; i < sizeof(LinSlave); i++) d[n++] = LinSlave[i];
+		d[n++] = LIN_CMD_SCHEDULE;
+		d[n++] = LIN_SIM_SLOT_MS;
+		d[n++] = 1;
+		d[n++] = LIN_SIM_SLOT_ID;
+		if (!mock_usb_out(CDC_RX_EPNUM, d, n)) return;
+		LinSchedAt = mock_cycles;
+	}
+	LastProgress = mock_cycles;
+}
+#endif
+
+/* A fixed line coding at the test baud rate in the EEPROM, see eeconfig.h. */
+static void eeconfig_arm(void)
+{
+	EEConfig_t* c = &EEConfig_Stored;
+	memset(c, 0, sizeof(*c));
+	c->Magic = EECONFIG_MAGIC;
+	c->Data.BaudRateBPS = Baud;
+	c->Data.DataBits = 8;
+	c->Data.Flags = EECONFIG_FLAG_FIXED;
+#ifdef ENABLE_XONXOFF
+	c->Data.Flow = XonXoff ? EECONFIG_FLOW_XONXOFF : EECONFIG_FLOW_NONE;
+#endif
+	for (uint8_t i = 0; i < sizeof(*c) - 1; i++) c->Check -= ((uint8_t*)c)[i];
+}
+
+/* enum mode: the transfers of a Linux host from the bus reset to cdc_acm opening the port,
+ * with the descriptor lengths it would use. True when through. */
+static bool enum_run(void)
+{
+	static int step;
+	static bool busy;
+	static uint8_t dev[18];
+	static uint16_t cfg_len;
+	uint8_t s[8] = { 0x80, 0x06, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00 }; /* GET_DESCRIPTOR */
+
+	if (!mock_usb_ready()) return false;
+	if (busy) {
+		uint8_t st = mock_usb_control_status();
+		if (st == MOCK_CTL_BUSY) return false;
+		busy = false;
+		if (st != MOCK_CTL_ACK) {
+			fprintf(stderr, "sim: enumeration step %d not acknowledged (%d)\n", step, st);
+			Failed = true;
+			return true;
+		}
+		uint16_t len;
+		const uint8_t* d = mock_usb_control_data(&len);
+		if ((step == 0) || (step == 2)) memcpy(dev, d, (len < sizeof(dev)) ? len : sizeof(dev));
+		if ((step == 3) && (len >= 4)) cfg_len = d[2] | (d[3] << 8);
+		step++;
+	}
+	switch (step) {
+		case 0: s[3] = 0x01; s[6] = 64; break;                 /* device, as much as fits EP0 */
+		case 1: memcpy(s, Setup[1], 8); break;                 /* SET_ADDRESS */
+		case 2: s[3] = 0x01; s[6] = 18; break;                 /* device */
+		case 3: s[3] = 0x02; s[6] = 9; break;                  /* configuration header */
+		case 4: s[3] = 0x02; s[6] = cfg_len; s[7] = cfg_len >> 8; break;
+		case 5: s[3] = 0x03; break;                            /* languages */
+		case 6: case 7: case 8:                                /* product, manufacturer, serial */
+			s[2] = dev[(step == 6) ? 15 : (step == 7) ? 14 : 16];
+			if (!s[2]) {
+				step++;
+				return false;
+			}
+			s[3] = 0x03;
+			s[4] = 0x09;
+			s[5] = 0x04;
+			break;
+		case 9: case 10: case 11:                              /* SET_CONFIGURATION, line coding, DTR */
+			memcpy(s, Setup[step - 6], 8);
+			break;
+		default:
+			EnumDone = mock_cycles;
+			return true;
+	}
+	const uint8_t coding[7] = { Baud, Baud >> 8, Baud >> 16, Baud >> 24, 0, 0, 8 };
+	if (!mock_usb_control(s, coding)) return false;
+	if (!EnumTransfers++) EnumStart = mock_cycles;
+	busy = true;
+	return false;
+}
+
+static void hook(void)
+{
+	if (Mode == MODE_ENUM) {
+		if (enum_run()) mock_stop();
+		return;
+	}
+
+	/* Armed: the line runs from power-up, the host comes along 100 bytes later. */
+	if (Armed) {
+		if (Mode == MODE_RX) line_feed();
+		if ((Step < (int)(SETUP_COUNT * 2)) && (mock_cycles < 1000ULL * MOCK_F_CPU / Baud)) return;
+	}
+	if (Step < (int)(SETUP_COUNT * 2)) {
+		if (!mock_usb_ready()) return;
+		if (!(Step & 1)) {
+			const uint8_t coding[7] = { HostBaud, HostBaud >> 8, HostBaud >> 16, HostBaud >> 24, 0, 0, 8 };
+			mock_usb_control(Setup[Step / 2], coding);
+			Step++;
+			return;
+		}
+		uint8_t s = mock_usb_control_status();
+		if (s == MOCK_CTL_BUSY) return;
+		if (s != MOCK_CTL_ACK) {
+			fprintf(stderr, "sim: setup %d not acknowledged (%d)\n", Step / 2, s);
+			Failed = true;
+			mock_stop();
+		}
+		if (++Step == (int)(SETUP_COUNT * 2)) LastProgress = Configured = mock_cycles;
+		return;
+	}
+
+#ifdef ENABLE_HOST_PRESENCE
+	/* -D: the first application closes the port half way, the next one opens it: the request of
+	 * the enumeration, with DTR clear and then set. Only that one reads. */
+	if (OpenMs && (OpenStep < 4) &&
+	    (mock_cycles - Configured >= (uint64_t)OpenMs * (MOCK_F_CPU / 1000) * (1 + OpenStep / 2) / 2)) {
+		uint8_t set[8];
+		memcpy(set, Setup[5], 8);
+		set[2] = (OpenStep < 2) ? 0x00 : 0x03;
+		if (!(OpenStep++ & 1)) {
+			mock_usb_control(set, NULL);
+			if (OpenStep == 3) SentAtOpen = Sent;
+		} else if (mock_usb_control_status() == MOCK_CTL_BUSY) {
+			OpenStep--;
+		} else if (mock_usb_control_status() != MOCK_CTL_ACK) {
+			fprintf(stderr, "sim: DTR not acknowledged\n");
+			Failed = true;
+			mock_stop();
+		}
+		LastProgress = mock_cycles;
+	}
+	if (OpenMs) mock_usb_in_mask = (OpenStep < 4) ? 0 : 0xFE;
+#endif
+
+#if defined(ENABLE_CAPTURE) || defined(ENABLE_AUTOBAUD) || defined(ENABLE_ONEWIRE) || defined(ENABLE_LIN)
+	static int mode_step;
+	if (((Mode == MODE_CAPTURE) || (Mode == MODE_AUTOBAUD) || (Mode == MODE_ONEWIRE) || (Mode == MODE_LIN)) &&
+	    (mode_step < 2)) {
+		uint8_t set[8] = { 0x40, VENDOR_REQ_SetMode, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+		set[2] = (Mode == MODE_CAPTURE) ? SERIAL_MODE_CAPTURE :
+		         (Mode == MODE_AUTOBAUD) ? SERIAL_MODE_AUTOBAUD :
+		         (Mode == MODE_LIN) ? SERIAL_MODE_LIN : SERIAL_MODE_ONEWIRE;
+		if (!mode_step++) {
+			mock_usb_control(set, NULL);
+		} else if (mock_usb_control_status() == MOCK_CTL_BUSY) {
+			mode_step--;
+		} else if (mock_usb_control_status() != MOCK_CTL_ACK) {
+			fprintf(stderr, "sim: serial mode not acknowledged\n");
+			Failed = true;
+			mock_stop();
+		}
+		AutobaudStart = LastProgress = mock_cycles;
+		return;
+	}
+#endif
+#ifdef ENABLE_AUTOBAUD
+	if ((Mode == MODE_AUTOBAUD) && !AutobaudLock && (SerialMode == SERIAL_MODE_UART)) AutobaudLock = mock_cycles;
+#endif
+#ifdef ENABLE_ONEWIRE
+	if (Mode == MODE_ONEWIRE) {
+		onewire_run();
+		return;
+	}
+#endif
+#ifdef ENABLE_LIN
+	if (Mode == MODE_LIN) {
+		lin_run();
+		return;
+	}
+#endif
+
+	if (PauseMs) {
+		bool paused = (mock_cycles % MOCK_F_CPU) < (uint64_t)PauseMs * (MOCK_F_CPU / 1000);
+		mock_usb_in_mask = paused ? 0 : 0xFE;
+	}
+
+	/* tx -X: the XOFF is in once the line is empty, XON 2ms later. */
+	if (XoffDue && (mock_cycles >= XoffDue)) {
+		const uint8_t xoff = 0x13;
+		mock_uart_send(&xoff, 1);
+		XoffDue = 0;
+		XoffSent = true;
+		Xoffs++;
+	}
+	if (XoffSent && !XoffAt && !mock_uart_pending()) XoffAt = mock_cycles;
+	if (XoffAt && (mock_cycles - XoffAt > MOCK_F_CPU / 500)) {
+		const uint8_t xon = 0x11;
+		mock_uart_send(&xon, 1);
+		if (Late > LateMax) LateMax = Late;
+		XoffAt = 0;
+		XoffSent = false;
+		Late = 0;
+		LastProgress = mock_cycles;
+	}
+
+	if ((Mode == MODE_RX) || (Mode == MODE_CAPTURE) || (Mode == MODE_AUTOBAUD)) {
+		line_feed();
+	} else if (Mode == MODE_CMD) {
+		if ((Sent == Received) && (Echoed == Sent) && (Sent < Total) && (mock_cycles >= CmdNext)) {
+			uint8_t d = Pattern[Sent % PRBS_PERIOD];
+			if (mock_usb_out(CDC_RX_EPNUM, &d, 1)) {
+				CmdSentAt = mock_cycles;
+				Sent++;
+			}
+		}
+	} else if (Sent < Total) {
+		uint8_t d[CDC_OUT_EPSIZE];
+		uint8_t n = ((Total - Sent) < CDC_OUT_EPSIZE) ? (Total - Sent) : CDC_OUT_EPSIZE;
+		for (uint8_t i = 0; i < n; i++) d[i] = Pattern[(Sent + i) % PRBS_PERIOD];
+		if (mock_usb_out(CDC_RX_EPNUM, d, n)) Sent += n;
+	}
+
+	/* All of it came out, or all of it went in and what is missing was dropped: once the line is
+	 * quiet for a few frames, and any host pause is over. */
+	uint64_t quiet = MOCK_F_CPU / 50 + (uint64_t)PauseMs * (MOCK_F_CPU / 1000) + 30 * MOCK_F_CPU / Baud;
+	bool done = (((Received + Skipped) >= Total) && ((Mode != MODE_CMD) || (Echoed >= Total))) ||
+	            ((Mode != MODE_TX) && (Mode != MODE_CMD) && (Sent >= Total) && (mock_cycles - LastProgress > quiet));
+	if (OpenMs && (OpenStep < 4)) done = false;
+
+#ifdef ENABLE_TRACE
+	static bool traced;
+	if (traced) {
+		/* Drained, the control pipe is free for the requests below. */
+	} else if (!trace_poll(done)) {
+		if (done) return;
+	} else {
+		traced = true;
+		if (!Failed && !Quiet)
+		  printf("trace: %llu records, %llu lost, %llu bytes IN, %llu bytes OUT\n",
+		         (unsigned long long)TraceRecords, (unsigned long long)TraceLost,
+		         (unsigned long long)TraceIn, (unsigned long long)TraceOut);
+	}
+#endif
+	if (done) {
+		if (!dropped_done()) return;
+#ifdef ENABLE_AUTOBAUD
+		if ((Mode == MODE_AUTOBAUD) && !autobaud_done()) return;
+#endif
+#ifdef ENABLE_LATENCY_STATS
+		if (!latency_done()) return;
+#endif
+#ifdef ENABLE_PROFILE
+		if (!profile_done()) return;
+#endif
+#ifdef ENABLE_PASS_STATS
+		if (!passtime_done()) return;
+#endif
+		mock_stop();
+	}
+	if (mock_cycles - LastProgress > MOCK_F_CPU + quiet) {
+		Stalled = true;
+		mock_stop();
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sim [-m loop|tx|rx|capture|cmd|enum|autobaud|onewire|lin] [-b baud] [-n bytes] [-p ms] [-e] [-c config] [-E n] [-X] [-D ms] [-q]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int c;
+	while ((c = getopt(argc, argv, "m:b:n:p:ec:E:XD:q")) != -1) {
+		switch (c) {
+			case 'm':
+				if (!strcmp(optarg, "loop")) Mode = MODE_LOOP;
+				else if (!strcmp(optarg, "tx")) Mode = MODE_TX;
+				else if (!strcmp(optarg, "rx")) Mode = MODE_RX;
+				else if (!strcmp(optarg, "cmd")) Mode = MODE_CMD;
+				else if (!strcmp(optarg, "enum")) Mode = MODE_ENUM;
+#ifdef ENABLE_CAPTURE
+				else if (!strcmp(optarg, "capture")) Mode = MODE_CAPTURE;
+#endif
+#ifdef ENABLE_AUTOBAUD
+				else if (!strcmp(optarg, "autobaud")) Mode = MODE_AUTOBAUD;
+#endif
+#ifdef ENABLE_ONEWIRE
+				else if (!strcmp(optarg, "onewire")) Mode = MODE_ONEWIRE;
+#endif
+#ifdef ENABLE_LIN
+				else if (!strcmp(optarg, "lin")) Mode = MODE_LIN;
+#endif
+				else usage();
+				break;
+			case 'b': Baud = strtoul(optarg, NULL, 0); break;
+			case 'n': Total = strtoull(optarg, NULL, 0); break;
+			case 'p':
+				PauseMs = strtoul(optarg, NULL, 0);
+				if (PauseMs >= 1000) usage(); /* Would look like a stall. */
+				break;
+			case 'e': Armed = true; break;
+			case 'c': Config = strtoul(optarg, NULL, 0); break;
+#ifdef ENABLE_PARMRK
+			case 'E':
+				ErrEvery = strtoul(optarg, NULL, 0);
+				if (!ErrEvery) usage();
+				break;
+#endif
+#ifdef ENABLE_XONXOFF
+			case 'X': XonXoff = true; break;
+#endif
+#ifdef ENABLE_HOST_PRESENCE
+			case 'D':
+				OpenMs = strtoul(optarg, NULL, 0);
+				if (!OpenMs || (OpenMs >= 500)) usage(); /* Would look like a stall. */
+				break;
+#endif
+			case 'q': Quiet = true; break;
+			default: usage();
+		}
+	}
+
+	if (ErrEvery && (Mode != MODE_RX)) usage();
+	if (XonXoff && (Mode != MODE_TX) && (Mode != MODE_RX)) usage();
+	if (OpenMs && (Mode != MODE_RX)) usage();
+	prbs_init();
+	if (XonXoff)
+	  for (int i = 0; i < PRBS_PERIOD; i++)
+	    if ((Pattern[i] == 0x11) || (Pattern[i] == 0x13)) Pattern[i] |= 0x80;
+	if (Mode == MODE_CMD) {
+		CmdLatency = calloc(Total + 1, sizeof(*CmdLatency));
+		CmdEcho = calloc(Total + 1, sizeof(*CmdEcho));
+		if (!CmdLatency || !CmdEcho) usage();
+	}
+	Setup[3][2] = Config;
+	for (unsigned i = 0; i < SETUP_COUNT; i++) {
+		if (Setup[i][0] != 0x40) continue;
+#ifdef ENABLE_PARMRK
+		if (Setup[i][1] == VENDOR_REQ_SetParmrk) Setup[i][2] = (ErrEvery != 0);
+#endif
+#ifdef ENABLE_XONXOFF
+		if (Setup[i][1] == VENDOR_REQ_SetFlow) Setup[i][2] = XonXoff ? EECONFIG_FLOW_XONXOFF : EECONFIG_FLOW_NONE;
+#endif
+	}
+	HostBaud = (Mode != MODE_AUTOBAUD) ? Baud : (Baud != 9600) ? 9600 : 19200;
+	mock_reset();
+	if (Armed) eeconfig_arm();
+	if (Mode == MODE_AUTOBAUD) mock_uart_line_baud = Baud;
+	mock_uart_loopback = (Mode == MODE_LOOP) || (Mode == MODE_CMD) || (Mode == MODE_LIN);
+	mock_uart_set_sink(line_sink);
+	mock_usb_set_in_sink(in_sink);
+	mock_set_hook(hook);
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	mock_run();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (Failed) return 1;
+
+	double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	double simt = (double)mock_cycles / MOCK_F_CPU;
+	static const char* const names[] = { "loop", "tx", "rx", "capture", "cmd", "enum", "autobaud", "onewire", "lin" };
+	bool ok = !Stalled && !Errors && (Received == Total) && !Dropped && !mock_uart_overruns;
+	if (Mode == MODE_CMD) ok = ok && (Echoed == Total);
+	ok = ok && (Marked == BadSent);
+	/* The byte in UDR1 when the XOFF came in still goes. */
+	ok = ok && (LateMax <= 1);
+	/* Dropped while closed, as it came: at most the bytes still on their way at the open (16 in
+	 * the line's queue, one in UDR1) and those of the last pass may come in. What the first
+	 * application did not read overflowed, and may not be reported to the next one. */
+	bool stale_ok = (Skipped <= SentAtOpen) && (Skipped + 20 >= SentAtOpen);
+	if (OpenMs && !Armed && !XonXoff)
+	  ok = !Stalled && !Errors && ((Received + Skipped) == Total) && stale_ok && !Notified && !mock_uart_overruns;
+#ifdef ENABLE_CAPTURE
+	/* A frame is 10 bits, the bytes go back to back. Polling may stamp one a few us late, and
+	 * the baud rate is off by the UBRR rounding, up to a few %. */
+	double frame_us = 1e7 / Baud;
+	double mean_us = (Cap.Bytes > 1) ? (double)(Cap.Prev - Cap.First) / (Cap.Bytes - 1) : 0;
+	bool cap_ok = (Mode != MODE_CAPTURE) ||
+	              ((Cap.MaxDelta - Cap.MinDelta <= 8) && (mean_us > frame_us * 0.97) &&
+	               (mean_us < frame_us * 1.03) && Cap.Sofs && (Cap.SofJitter <= 8));
+	ok = ok && cap_ok;
+#endif
+#ifdef ENABLE_VENDOR_BULK
+	ok = ok && !SeqErrors;
+#endif
+	/* The bytes on the line before the lock are lost, a few characters' worth. */
+	if (Mode == MODE_AUTOBAUD)
+	  ok = !Stalled && !Errors && ((Received + Skipped) == Total) && (Skipped <= 16) && !Dropped &&
+	       (AutobaudFound * 50 >= Baud * 49) && (AutobaudFound * 50 <= Baud * 51);
+
+	/* The reply to the last packet stays unread. */
+	if (Mode == MODE_ONEWIRE)
+	  ok = !Stalled && !Errors && (Received == Total) && OwSwitched;
+
+#ifdef ENABLE_LIN
+	if (Mode == MODE_LIN) {
+		ok = !Stalled && !Errors && (Received == Total) &&
+		     (LinSlots + 1 >= LIN_SIM_SLOTS) && (LinSlots <= LIN_SIM_SLOTS + 1);
+		if (!Quiet || !ok)
+		  printf("lin at %lu baud: %llu of %llu frames right, %lu scheduled ones in %d slots of %d ms, "
+		         "%llu bad records%s\n", (unsigned long)Baud, (unsigned long long)Received,
+		         (unsigned long long)Total, (unsigned long)LinSlots, LIN_SIM_SLOTS, LIN_SIM_SLOT_MS,
+		         (unsigned long long)Errors, Stalled ? ", stalled" : "");
+	} else
+#endif
+	if (Mode == MODE_ONEWIRE) {
+		if (!Quiet || !ok)
+		  printf("onewire: %llu of %llu replies right, %lu of them without the echo, %s\n",
+		         (unsigned long long)Received, (unsigned long long)Total, (unsigned long)OwNoEcho,
+		         OwSwitched ? "back to the bridge with a reply unread" : "stuck with a reply unread");
+	} else if (Mode == MODE_ENUM) {
+		ok = EnumDone;
+		if (!Quiet || !ok)
+		  printf("enum: port open %.3f ms after power-up, %.3f ms after the first request, "
+		         "%lu transfers in %lu control packets\n", EnumDone * 1e3 / MOCK_F_CPU,
+		         (EnumDone - EnumStart) * 1e3 / MOCK_F_CPU, (unsigned long)EnumTransfers,
+		         (unsigned long)mock_usb_control_packets);
+	} else if (!Quiet || !ok) {
+		printf("%s at %lu baud: %llu of %llu bytes in %.3f s simulated, %.0f B/s (%.1f%% of line rate)\n",
+		       names[Mode], (unsigned long)Baud, (unsigned long long)Received, (unsigned long long)Total,
+		       simt, Received / simt, 100.0 * Received / simt / (Baud / 10.0));
+		printf("wall %.3f s, %.2f MB/s simulated traffic, %.1f simulated MHz\n",
+		       wall, Received / wall / 1e6, mock_cycles / wall / 1e6);
+		printf("errors %llu, overruns %lu%s\n", (unsigned long long)Errors,
+		       (unsigned long)mock_uart_overruns, Stalled ? ", stalled" : "");
+		if (ErrEvery)
+		  printf("marked %llu of the %llu bytes sent with a framing error\n",
+		         (unsigned long long)Marked, (unsigned long long)BadSent);
+		if (XonXoff && (Mode == MODE_TX))
+		  printf("xon/xoff: %lu XOFFs from the target, at most %lu bytes started after one\n",
+		         (unsigned long)Xoffs, (unsigned long)LateMax);
+		if (XonXoff && (Mode == MODE_RX))
+		  printf("xon/xoff: the device sent %lu XOFFs\n", (unsigned long)Xoffs);
+		if (OpenMs)
+		  printf("host presence: %llu bytes sent before the open, %llu of them skipped\n",
+		         (unsigned long long)SentAtOpen, (unsigned long long)Skipped);
+		if (Dropped || (Received != Total))
+		  printf("missing %llu, the device dropped %llu and reported it %llu times\n",
+		         (unsigned long long)(Total - Received), (unsigned long long)Dropped,
+		         (unsigned long long)Notified);
+#ifdef ENABLE_VENDOR_BULK
+		printf("sequence errors %llu\n", (unsigned long long)SeqErrors);
+#endif
+		if ((Mode == MODE_CMD) && Received) {
+			qsort(CmdLatency, Received, sizeof(*CmdLatency), cmp_u32);
+			double us = 1e6 / MOCK_F_CPU;
+			printf("OUT packet to start bit: min %.1f us, median %.1f, p99 %.1f, max %.1f\n",
+			       CmdLatency[0] * us, CmdLatency[Received / 2] * us,
+			       CmdLatency[Received * 99 / 100] * us, CmdLatency[Received - 1] * us);
+			qsort(CmdEcho, Echoed, sizeof(*CmdEcho), cmp_u32);
+			if (Echoed)
+			  printf("OUT packet to its echo IN: min %.1f us, median %.1f, p99 %.1f, max %.1f\n",
+			         CmdEcho[0] * us, CmdEcho[Echoed / 2] * us,
+			         CmdEcho[Echoed * 99 / 100] * us, CmdEcho[Echoed - 1] * us);
+		}
+		if (Mode == MODE_AUTOBAUD)
+		  printf("autobaud: found %lu baud, back to the bridge %.3f ms after the mode was set, %llu bytes lost\n",
+		         (unsigned long)AutobaudFound, (AutobaudLock - AutobaudStart) * 1e3 / MOCK_F_CPU,
+		         (unsigned long long)Skipped);
+#ifdef ENABLE_CAPTURE
+		if (Mode == MODE_CAPTURE)
+		  printf("byte deltas %lu..%lu us, mean %.2f (frame %.1f us), %llu SOF records, SOF times within %lu us\n",
+		         (unsigned long)Cap.MinDelta, (unsigned long)Cap.MaxDelta, mean_us, frame_us,
+		         (unsigned long long)Cap.Sofs, (unsigned long)Cap.SofJitter);
+#endif
+	}
+	return ok ? 0 : 1;
+}
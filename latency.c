@@ -0,0 +1,84 @@
+/* Device residence time histograms of fast-usbserial, see latency.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_LATENCY_STATS
+
+#include "latency.h"
+
+/** Batches of bytes in one ring buffer that have not left yet, oldest first. */
+typedef struct {
+	uint8_t   Count;
+	RingPos_t End;                  /**< Ring position after the last stamped byte. */
+	RingPos_t Pos[LATENCY_MARKS];   /**< Ring position of the first byte of each batch. */
+	uint16_t  Time[LATENCY_MARKS];
+} Latency_Ring_t;
+
+static Latency_Ring_t LatencyRing[2];
+static uint16_t LatencyHist[2][LATENCY_BUCKETS];
+
+/** Forgets the batches in flight, the loop starts from the given ring positions. */
+void Latency_Start(const RingPos_t USARTtoUSB_wrp, const uint8_t USBtoUSART_wrp)
+{
+	LatencyRing[LATENCY_USART_TO_USB].Count = 0;
+	LatencyRing[LATENCY_USART_TO_USB].End = USARTtoUSB_wrp;
+	LatencyRing[LATENCY_USB_TO_USART].Count = 0;
+	LatencyRing[LATENCY_USB_TO_USART].End = USBtoUSART_wrp;
+}
+
+/** Stamps the bytes up to Wrp that were not seen before as a new batch. */
+void Latency_Arrived(const uint8_t Dir, const RingPos_t Wrp)
+{
+	Latency_Ring_t* r = &LatencyRing[Dir];
+	if (Wrp == r->End) return;
+	if (r->Count < LATENCY_MARKS) {
+		r->Pos[r->Count] = r->End;
+		r->Time[r->Count] = Ticks_Now();
+		r->Count++;
+	}
+	r->End = Wrp;
+}
+
+/** Everything before Rdp has left the ring: a sample for every batch that is now gone. */
+void Latency_Left(const uint8_t Dir, const RingPos_t Rdp)
+{
+	Latency_Ring_t* r = &LatencyRing[Dir];
+	const RingPos_t mask = (Dir == LATENCY_USART_TO_USB) ? (USART2USB_BUFLEN-1) : (USB2USART_BUFLEN-1);
+	if (!r->Count) return;
+
+	uint16_t now = Ticks_Now();
+	while (r->Count) {
+		RingPos_t next = (r->Count > 1) ? r->Pos[1] : r->End;
+		if (((RingPos_t)(Rdp - r->Pos[0]) & mask) < ((RingPos_t)(next - r->Pos[0]) & mask)) break;
+
+		uint16_t t = (now - r->Time[0]) >> 1;
+		uint8_t b = 0;
+		while (t && (b < LATENCY_BUCKETS-1)) {
+			t >>= 1;
+			b++;
+		}
+		if (LatencyHist[Dir][b] != 0xFFFF) LatencyHist[Dir][b]++;
+
+		r->Count--;
+		for (uint8_t i = 0; i < r->Count; i++) {
+			r->Pos[i] = r->Pos[i + 1];
+			r->Time[i] = r->Time[i + 1];
+		}
+	}
+}
+
+/** Handles VENDOR_REQ_GetLatency. */
+void Latency_ProcessControlRequest(void)
+{
+	if (USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+	  return;
+
+	Endpoint_ClearSETUP();
+	Endpoint_Write_Control_Stream_LE(LatencyHist, sizeof(LatencyHist));
+	Endpoint_ClearOUT();
+	if (USB_ControlRequest.wValue & 1)
+	  memset(LatencyHist, 0, sizeof(LatencyHist));
+}
+
+#endif
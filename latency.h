@@ -0,0 +1,49 @@
+/* Device residence time of fast-usbserial's data, an instrumentation build
+ * (ENABLE_LATENCY_STATS) that tells the latency of the device apart from
+ * that of the host.
+ *
+ * The main loop stamps bytes when it first sees them in a ring buffer and
+ * again when they leave it: USART to USB bytes leave with the
+ * Endpoint_ClearIN() that ships them, USB to USART bytes when the UDRE ISR
+ * has taken them for UDR1 (the first byte of a packet that finds the ring
+ * empty goes to UDR1 straight away and is not counted). The ISRs are not
+ * touched, so every stamp is late by up to one pass of the main loop. Bytes the loop sees arrive in the
+ * same pass are a batch, and each batch adds one sample, its residence
+ * time, to a log2 histogram of its direction once its last byte has left.
+ *
+ * Time is Ticks_Now(), Timer0 (16us ticks at 16MHz) extended to 16 bits.
+ * Bucket 0 counts residence times under 2 ticks, bucket n (1..
+ * LATENCY_BUCKETS-2) 2^n to 2^(n+1) ticks and the last one everything
+ * longer, so with 10 buckets: <32us, 32us, 64us, ..., 4ms, >=8ms. A full
+ * packet at 115200 baud takes 5.5ms. Counts stop at 0xFFFF. This costs 63
+ * bytes of the 128 that the ring buffers leave for variables and stack.
+ *
+ * VENDOR_REQ_GetLatency returns the LATENCY_BUCKETS counts of the USART to
+ * USB direction, then those of the USB to USART direction, 16 bits little
+ * endian each. wValue 1 clears them after the read.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		#define LATENCY_BUCKETS          10
+		#define LATENCY_USART_TO_USB     0
+		#define LATENCY_USB_TO_USART     1
+
+		/** Batches in flight per direction, later ones are merged into the last (their time is
+		 *  then over-estimated). */
+		#define LATENCY_MARKS            3
+
+	/* Function Prototypes: */
+		void Latency_Start(const RingPos_t USARTtoUSB_wrp, const uint8_t USBtoUSART_wrp);
+		void Latency_Arrived(const uint8_t Dir, const RingPos_t Wrp);
+		void Latency_Left(const uint8_t Dir, const RingPos_t Rdp);
+		void Latency_ProcessControlRequest(void);
+
+#endif
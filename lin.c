@@ -0,0 +1,313 @@
+/* LIN bus mode for fast-usbserial.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_LIN
+
+#include "lin.h"
+#ifdef ENABLE_AUX_CDC
+#include "auxcdc.h"
+#endif
+
+/* The ring buffers are not used by this mode, so the scratch lives there:
+ * the OUT command copy and the frame being received in the USART to USB
+ * ring, the slave responses and schedule in the USB to USART ring. */
+#define LinCommand     (USARTtoUSB_BUFFER)
+#define LinFrame       (USARTtoUSB_BUFFER + 64) /* flags, pid, n, response bytes */
+#define LinTxQueue     (USARTtoUSB_BUFFER + 96)
+#define LinSlaveTable  (USBtoUSART_BUFFER) /* id (0xFF = free), len, 8 data bytes */
+#define LinSchedule    (USBtoUSART_BUFFER + 96)
+
+#define LIN_SLAVE_ENTRY_SIZE 10
+
+/** Timer1 matches every 0.5ms, whatever flush timeout the configuration or the EEPROM set. */
+#define LIN_OCR1A      ((F_CPU / 2000) - 1)
+
+enum {
+	LIN_IDLE = 0,
+	LIN_SYNC,
+	LIN_PID,
+	LIN_DATA
+};
+
+static struct {
+	uint8_t  State;
+	uint8_t  Idle;       /* Timer1 ticks (0.5ms) since the last byte. */
+	uint8_t  Timeout;    /* Ticks of silence that end a frame, ~2 byte times. */
+	uint8_t  TxPos;
+	uint8_t  TxLen;
+	uint8_t  Lost;
+	uint8_t  Sent;       /* TXC1 tracks our last byte, it stays clear until one went out. */
+	uint8_t  SchedLen;
+	uint8_t  SchedPos;
+	uint16_t SchedSlot;  /* Ticks per slot. */
+	uint16_t SchedLeft;
+} Lin;
+
+static uint8_t Lin_Pid(uint8_t id)
+{
+	id &= 0x3F;
+	uint8_t p0 = (id ^ (id >> 1) ^ (id >> 2) ^ (id >> 4)) & 1;
+	uint8_t p1 = ~((id >> 1) ^ (id >> 3) ^ (id >> 4) ^ (id >> 5)) & 1;
+	return id | (p0 << 6) | (p1 << 7);
+}
+
+/* Classic checksum with sum = 0, enhanced with sum = PID. */
+static uint8_t Lin_Checksum(uint8_t sum, const uint8_t* d, uint8_t n)
+{
+	uint16_t s = sum;
+	while (n--) {
+		s += *d++;
+		if (s > 0xFF) s -= 0xFF;
+	}
+	return ~s;
+}
+
+/* 13 bit times of dominant: a zero byte (start + 8 bits) at 9/13 of the bit rate. */
+static void Lin_SendBreak(void)
+{
+	uint16_t brr = UBRR1;
+	/* UDRE1 only says the last byte moved on to the shift register, a new UBRR1 would garble
+	 * the rest of it. */
+	if (Lin.Sent)
+	  while (!(UCSR1A & _BV(TXC1)));
+	else
+	  while (!(UCSR1A & _BV(UDRE1)));
+	UCSR1A = (UCSR1A & _BV(U2X1)) | _BV(TXC1);
+	UBRR1 = (((brr + 1) * 13) / 9) - 1;
+	UDR1 = 0;
+	while (!(UCSR1A & _BV(TXC1)));
+	UBRR1 = brr;
+	Lin.Sent = 1;
+	/* Our own break, already handled. */
+	while (UCSR1A & _BV(RXC1)) (void)UDR1;
+}
+
+static void Lin_Begin(void)
+{
+	uint8_t* f = LinFrame;
+	uint32_t baud = VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS;
+	f[0] = 0;
+	f[2] = 0;
+	Lin.State = LIN_SYNC;
+	Lin.Idle = 0;
+	Lin.TxPos = Lin.TxLen = 0;
+	Lin.Timeout = (baud < 200) ? 0xFF : (2 + (40000UL / baud));
+}
+
+/* Hand the frame to the host as one IN packet, or remember that we lost it. */
+static void Lin_Finish(void)
+{
+	uint8_t* f = LinFrame;
+	uint8_t n = f[2];
+	if (Lin.State != LIN_DATA) {
+		f[0] |= LIN_FRAME_ERROR;
+	} else if (!n) {
+		f[0] |= LIN_FRAME_NO_RESPONSE;
+	} else if (n > 1) {
+		uint8_t* d = f + 3;
+		if (Lin_Checksum(0, d, n - 1) == d[n - 1]) f[0] |= LIN_FRAME_CLASSIC_OK;
+		if (Lin_Checksum(f[1], d, n - 1) == d[n - 1]) f[0] |= LIN_FRAME_ENHANCED_OK;
+	}
+	Lin.State = LIN_IDLE;
+	Lin.TxPos = Lin.TxLen = 0;
+
+	Endpoint_SelectEndpoint(CDC_TX_EPNUM);
+	if (!Endpoint_IsINReady()) {
+		Lin.Lost = LIN_FRAME_LOST;
+		return;
+	}
+	f[0] |= Lin.Lost;
+	Lin.Lost = 0;
+	n += 3;
+	do {
+		Endpoint_Write_Byte(*f++);
+	} while (--n);
+	Endpoint_ClearIN();
+	LEDs_TurnOnLEDs(LEDMASK_TX);
+}
+
+/* Queue a response and its checksum behind whatever is queued already. */
+static void Lin_Publish(uint8_t idf, const uint8_t* d, uint8_t len)
+{
+	uint8_t* q = LinTxQueue + Lin.TxLen;
+	if (len > (LIN_MAX_RESPONSE - 1)) len = LIN_MAX_RESPONSE - 1;
+	for (uint8_t i = 0; i < len; i++) q[i] = d[i];
+	q[len] = Lin_Checksum((idf & LIN_ID_CLASSIC) ? 0 : Lin_Pid(idf), d, len);
+	Lin.TxLen += len + 1;
+	LinFrame[0] |= LIN_FRAME_PUBLISHED;
+}
+
+static void Lin_StartHeader(uint8_t idf)
+{
+	Lin_SendBreak();
+	Lin_Begin();
+	LinTxQueue[0] = 0x55;
+	LinTxQueue[1] = Lin_Pid(idf);
+	Lin.TxLen = 2;
+	LEDs_TurnOnLEDs(LEDMASK_RX);
+}
+
+static uint8_t* Lin_FindSlave(uint8_t id)
+{
+	uint8_t* e = LinSlaveTable;
+	for (uint8_t i = 0; i < LIN_SLAVE_ENTRIES; i++, e += LIN_SLAVE_ENTRY_SIZE) {
+		if ((e[0] != 0xFF) && ((e[0] & 0x3F) == id)) return e;
+	}
+	return NULL;
+}
+
+static void Lin_Rx(uint8_t status, uint8_t d)
+{
+	uint8_t* f = LinFrame;
+	Lin.Idle = 0;
+	if (status & _BV(FE1)) {
+		if (Lin.State != LIN_IDLE) {
+			if (d) f[0] |= LIN_FRAME_ERROR;
+			Lin_Finish();
+		}
+		if (!d) Lin_Begin(); /* A break. */
+		return;
+	}
+	switch (Lin.State) {
+		case LIN_SYNC:
+			if (d != 0x55) {
+				Lin_Finish();
+				break;
+			}
+			Lin.State = LIN_PID;
+			break;
+		case LIN_PID:
+			f[1] = d;
+			if (Lin_Pid(d) != d) {
+				Lin_Finish();
+				break;
+			}
+			Lin.State = LIN_DATA;
+			/* Answer as a slave, unless we are publishing this one ourselves. */
+			if (Lin.TxPos == Lin.TxLen) {
+				uint8_t* e = Lin_FindSlave(d & 0x3F);
+				if (e) Lin_Publish(e[0], e + 2, e[1]);
+			}
+			break;
+		case LIN_DATA:
+			f[3 + f[2]++] = d;
+			if (f[2] == LIN_MAX_RESPONSE) Lin_Finish();
+			break;
+	}
+}
+
+/* Run the commands of one OUT packet. A header or frame command starts bus
+ * traffic, so it ends the packet. */
+static void Lin_Execute(const uint8_t* cmd, uint8_t len)
+{
+	const uint8_t* end = cmd + len;
+	while (cmd < end) {
+		uint8_t c = *cmd++;
+		uint8_t left = end - cmd;
+		switch (c) {
+			case LIN_CMD_HEADER:
+				if (left) Lin_StartHeader(cmd[0]);
+				return;
+			case LIN_CMD_FRAME:
+				if ((left < 2) || (left - 2 < cmd[1])) return;
+				Lin_StartHeader(cmd[0]);
+				Lin_Publish(cmd[0], cmd + 2, cmd[1]);
+				return;
+			case LIN_CMD_SLAVE_SET: {
+				if ((left < 2) || (left - 2 < cmd[1]) || (cmd[1] > 8)) return;
+				uint8_t* e = Lin_FindSlave(cmd[0] & 0x3F);
+				if (!e) {
+					e = LinSlaveTable;
+					for (uint8_t i = 0; (i < LIN_SLAVE_ENTRIES) && (e[0] != 0xFF); i++)
+					  e += LIN_SLAVE_ENTRY_SIZE;
+					if (e == (LinSlaveTable + (LIN_SLAVE_ENTRIES * LIN_SLAVE_ENTRY_SIZE))) return;
+				}
+				e[0] = cmd[1] ? cmd[0] : 0xFF;
+				for (uint8_t i = 0; i < cmd[1] + 1; i++) e[1 + i] = cmd[1 + i];
+				cmd += cmd[1] + 2;
+				break;
+			}
+			case LIN_CMD_SLAVE_CLEAR:
+				for (uint8_t i = 0; i < LIN_SLAVE_ENTRIES; i++)
+				  LinSlaveTable[i * LIN_SLAVE_ENTRY_SIZE] = 0xFF;
+				break;
+			case LIN_CMD_SCHEDULE: {
+				if ((left < 2) || (left - 2 < cmd[1]) || (cmd[1] > LIN_SCHEDULE_MAX)) return;
+				Lin.SchedLen = cmd[0] ? cmd[1] : 0;
+				Lin.SchedPos = 0;
+				Lin.SchedSlot = Lin.SchedLeft = cmd[0] * 2;
+				for (uint8_t i = 0; i < cmd[1]; i++) LinSchedule[i] = cmd[2 + i];
+				cmd += cmd[1] + 2;
+				break;
+			}
+			default:
+				return;
+		}
+	}
+}
+
+/** Main loop of the LIN mode, returns when the device is unconfigured or the
+ *  host selects another mode. */
+void Lin_Task(void)
+{
+	/* Bit rate of the host, but polled: the UART modes only get the ring ISRs. */
+	EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+	memset(&Lin, 0, sizeof(Lin));
+	for (uint8_t i = 0; i < LIN_SLAVE_ENTRIES; i++)
+	  LinSlaveTable[i * LIN_SLAVE_ENTRY_SIZE] = 0xFF;
+	uint16_t ocr = OCR1A;
+	OCR1A = LIN_OCR1A;
+	TCNT1 = 0;
+	TIFR1 = _BV(OCF1A);
+
+	do {
+		if (UCSR1A & _BV(RXC1)) {
+			uint8_t status = UCSR1A;
+			Lin_Rx(status, UDR1);
+		}
+		if ((Lin.TxPos != Lin.TxLen) && (UCSR1A & _BV(UDRE1))) {
+			UCSR1A = (UCSR1A & _BV(U2X1)) | _BV(TXC1);
+			UDR1 = LinTxQueue[Lin.TxPos++];
+			Lin.Sent = 1;
+		}
+
+		if (TIFR1 & _BV(OCF1A)) {
+			TIFR1 = _BV(OCF1A);
+			if ((Lin.State != LIN_IDLE) && (++Lin.Idle >= Lin.Timeout))
+			  Lin_Finish();
+			if (Lin.SchedLen && !(--Lin.SchedLeft)) {
+				Lin.SchedLeft = Lin.SchedSlot;
+				if (Lin.State != LIN_IDLE) Lin_Finish();
+				Lin_StartHeader(LinSchedule[Lin.SchedPos]);
+				if (++Lin.SchedPos == Lin.SchedLen) Lin.SchedPos = 0;
+			}
+			if (Lin.State == LIN_IDLE) LEDs_TurnOffLEDs(LEDMASK_TX | LEDMASK_RX);
+#ifdef ENABLE_AUX_CDC
+			AuxCDC_Task();
+#endif
+		}
+
+		if (Lin.State == LIN_IDLE) {
+			uint8_t len = CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface);
+			if (len) {
+				uint8_t* cmd = LinCommand;
+				for (uint8_t i = 0; i < len; i++) cmd[i] = Endpoint_Read_Byte();
+				Endpoint_ClearOUT();
+				Lin_Execute(cmd, len);
+			}
+		}
+
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		if (Endpoint_IsSETUPReceived())
+		  USB_Device_ProcessControlRequest();
+	} while ((USB_DeviceState == DEVICE_STATE_Configured) && (SerialMode == SERIAL_MODE_LIN));
+
+	OCR1A = ocr;
+	LEDs_TurnOffLEDs(LEDMASK_TX | LEDMASK_RX);
+	if (SerialMode == SERIAL_MODE_UART)
+	  EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+}
+
+#endif
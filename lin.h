@@ -0,0 +1,57 @@
+/* LIN bus mode for fast-usbserial. The firmware generates the break and
+ * sync itself, parses headers and responses off the bus and hands the
+ * host one complete, checksum verified frame per IN packet. Headers can
+ * also be sent from an on-device schedule table, so slot timing does
+ * not depend on the USB round trip.
+ *
+ * The bit rate is the host line coding (8N1), the USART runs polled.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _LIN_H_
+#define _LIN_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		/* OUT packet commands, several may be batched in one packet. The frame ID
+		 * byte takes the 6-bit frame ID; set LIN_ID_CLASSIC to use the classic
+		 * (LIN 1.x) checksum for a published response instead of the enhanced one. */
+
+		/** <id>: send a header, someone else (or the slave table) responds. */
+		#define LIN_CMD_HEADER           0x01
+
+		/** <id> <len> <len data bytes>: send a header and publish the response. */
+		#define LIN_CMD_FRAME            0x02
+
+		/** <id> <len> <len data bytes>: answer headers for id with this response as a
+		 *  slave, len 0 removes the entry. */
+		#define LIN_CMD_SLAVE_SET        0x03
+
+		/** Remove all slave responses. */
+		#define LIN_CMD_SLAVE_CLEAR      0x04
+
+		/** <slot ms> <n> <n ids>: send the headers cyclically, one per slot. n = 0 stops. */
+		#define LIN_CMD_SCHEDULE         0x05
+
+		#define LIN_ID_CLASSIC           0x80
+
+		/* IN packets carry one frame record each:
+		 * <flags> <pid> <n> <n response bytes, the last one being the checksum>. */
+		#define LIN_FRAME_CLASSIC_OK     (1 << 0) /**< Classic checksum matches. */
+		#define LIN_FRAME_ENHANCED_OK    (1 << 1) /**< Enhanced checksum matches. */
+		#define LIN_FRAME_NO_RESPONSE    (1 << 2) /**< Header only, nobody responded. */
+		#define LIN_FRAME_ERROR          (1 << 3) /**< Bad sync or PID parity, or a framing error. */
+		#define LIN_FRAME_PUBLISHED      (1 << 4) /**< The response came from us. */
+		#define LIN_FRAME_LOST           (1 << 5) /**< Frames before this one were dropped, the host was not reading. */
+
+		#define LIN_MAX_RESPONSE         9 /**< 8 data bytes and the checksum. */
+		#define LIN_SLAVE_ENTRIES        8
+		#define LIN_SCHEDULE_MAX         32
+
+	/* Function Prototypes: */
+		void Lin_Task(void);
+
+#endif
@@ -0,0 +1,201 @@
+/* 1-Wire bus master mode for fast-usbserial.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_ONEWIRE
+
+#include "onewire.h"
+#ifdef ENABLE_AUX_CDC
+#include "auxcdc.h"
+#endif
+
+/** Set once a character did not come back, see OW_ERR_NO_ECHO. */
+static uint8_t OneWire_NoEcho;
+
+/* Send a byte and return what the bus made of it. Without its echo within
+ * OW_ECHO_TICKS it sets OneWire_NoEcho, and from then on sends nothing. */
+static uint8_t OneWire_Touch(uint8_t d)
+{
+	if (OneWire_NoEcho) return 0xFF;
+	UDR1 = d;
+	uint8_t start = TCNT0;
+	while (!(UCSR1A & _BV(RXC1))) {
+		if ((uint8_t)(TCNT0 - start) > OW_ECHO_TICKS) {
+			OneWire_NoEcho = 1;
+			return 0xFF;
+		}
+	}
+	return UDR1;
+}
+
+static uint8_t OneWire_Reset(void)
+{
+	UBRR1 = OW_UBRR_RESET;
+	uint8_t r = OneWire_Touch(0xF0);
+	UBRR1 = OW_UBRR_SLOT;
+	return (r != 0xF0);
+}
+
+static uint8_t OneWire_Bit(uint8_t b)
+{
+	/* Anything but 0xFF coming back means a slave held the slot low. */
+	return (OneWire_Touch(b ? 0xFF : 0x00) == 0xFF);
+}
+
+static uint8_t OneWire_Byte(uint8_t d)
+{
+	uint8_t r = 0;
+	for (uint8_t i = 0; i < 8; i++) {
+		r >>= 1;
+		if (OneWire_Bit(d & 1)) r |= 0x80;
+		d >>= 1;
+	}
+	return r;
+}
+
+/* One search pass over the ROM in place, returns the new last discrepancy. */
+static uint8_t OneWire_Search(uint8_t last, uint8_t* rom)
+{
+	uint8_t last_zero = 0;
+	uint8_t mask = 1;
+	for (uint8_t n = 1; n <= 64; n++) {
+		uint8_t id = OneWire_Bit(1);
+		uint8_t cmp = OneWire_Bit(1);
+		uint8_t dir;
+		if (id && cmp) return OW_SEARCH_FAILED;
+		if (id != cmp) {
+			dir = id;
+		} else {
+			if (n < last) dir = (*rom & mask) ? 1 : 0;
+			else dir = (n == last);
+			if (!dir) last_zero = n;
+		}
+		if (dir) *rom |= mask;
+		else *rom &= ~mask;
+		OneWire_Bit(dir);
+		mask <<= 1;
+		if (!mask) {
+			mask = 1;
+			rom++;
+		}
+	}
+	return last_zero;
+}
+
+/* Run one OUT packet worth of commands, results go to res. Returns the result length.
+ * A command cut short by the end of the packet is dropped. One that lost its echo ends
+ * the results with OW_ERR_NO_ECHO instead of its own. */
+static uint8_t OneWire_Execute(const uint8_t* cmd, uint8_t len, uint8_t* res)
+{
+	const uint8_t* end = cmd + len;
+	uint8_t* r = res;
+	while (cmd < end) {
+		if (OneWire_NoEcho) break;
+		uint8_t* first = r;
+		uint8_t c = *cmd++;
+		uint8_t left = end - cmd;
+		switch (c) {
+			case OW_CMD_RESET:
+				*r++ = OneWire_Reset();
+				break;
+			case OW_CMD_TOUCH: {
+				if (!left) return r - res;
+				uint8_t n = *cmd++;
+				if (n > --left) n = left;
+				while (n--) *r++ = OneWire_Byte(*cmd++);
+				break;
+			}
+			case OW_CMD_BIT:
+				if (!left) return r - res;
+				*r++ = OneWire_Bit(*cmd++ & 1);
+				break;
+			case OW_CMD_SEARCH: {
+				if (left < 9) return r - res;
+				uint8_t* rom = r;
+				for (uint8_t i = 1; i < 9; i++) *r++ = cmd[i];
+				*r++ = OneWire_Search(cmd[0], rom);
+				cmd += 9;
+				break;
+			}
+			default: /* Unknown command, nothing sensible left to do with the packet. */
+				return r - res;
+		}
+		if (OneWire_NoEcho) r = first;
+	}
+	if (OneWire_NoEcho) {
+		*r++ = OW_ERR_NO_ECHO;
+		OneWire_NoEcho = 0;
+		/* Whatever came back late is not the echo of the next packet's first slot. */
+		while (UCSR1A & _BV(RXC1)) (void)UDR1;
+	}
+	return r - res;
+}
+
+/* Waits for the IN endpoint, serving the control endpoint meanwhile so that a host
+ * that stops reading can still switch modes. False if the device was unconfigured
+ * or the host picked another mode, the IN endpoint is selected otherwise. */
+static bool OneWire_WaitIN(void)
+{
+	for (;;) {
+		Endpoint_SelectEndpoint(CDC_TX_EPNUM);
+		if (Endpoint_IsINReady()) return true;
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		if (Endpoint_IsSETUPReceived())
+		  USB_Device_ProcessControlRequest();
+#ifdef ENABLE_AUX_CDC
+		AuxCDC_Task();
+#endif
+		if ((USB_DeviceState != DEVICE_STATE_Configured) || (SerialMode != SERIAL_MODE_ONEWIRE))
+		  return false;
+	}
+}
+
+/** Main loop of the 1-Wire mode. The UART is run polled, without the ring ISRs, so
+ *  both ring buffers are free to use for the command and result packets. Returns when
+ *  the device is unconfigured or the host selects another mode. */
+void OneWire_Task(void)
+{
+	UCSR1B = 0;
+	UCSR1A = _BV(U2X1);
+	UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+	UBRR1 = OW_UBRR_SLOT;
+	UCSR1B = _BV(TXEN1) | _BV(RXEN1);
+	while (UCSR1A & _BV(RXC1)) (void)UDR1;
+
+	do {
+		uint8_t len = CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface);
+		if (len) {
+			uint8_t* cmd = USBtoUSART_BUFFER;
+			for (uint8_t i = 0; i < len; i++) cmd[i] = Endpoint_Read_Byte();
+			Endpoint_ClearOUT();
+			LEDs_TurnOnLEDs(LEDMASK_BUSY);
+			uint8_t rlen = OneWire_Execute(cmd, len, USARTtoUSB_BUFFER);
+			LEDs_TurnOffLEDs(LEDMASK_BUSY);
+			/* Results never exceed the command packet, so one IN packet is enough. A full
+			 * one needs a zero length packet after it to end the host's read. */
+			if (rlen && OneWire_WaitIN()) {
+				uint8_t* r = USARTtoUSB_BUFFER;
+				bool full = (rlen == CDC_IN_EPSIZE);
+				do {
+					Endpoint_Write_Byte(*r++);
+				} while (--rlen);
+				Endpoint_ClearIN();
+				if (full && OneWire_WaitIN())
+				  Endpoint_ClearIN();
+			}
+		}
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		if (Endpoint_IsSETUPReceived())
+		  USB_Device_ProcessControlRequest();
+#ifdef ENABLE_AUX_CDC
+		AuxCDC_Task();
+#endif
+	} while ((USB_DeviceState == DEVICE_STATE_Configured) && (SerialMode == SERIAL_MODE_ONEWIRE));
+
+	/* Back to being a UART: restore the line coding of the host. */
+	if (SerialMode == SERIAL_MODE_UART)
+	  EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+}
+
+#endif
@@ -0,0 +1,57 @@
+/* 1-Wire bus master mode for fast-usbserial, by the same UART trick the
+ * host side tools use: TX and RX tied together on the bus (open drain),
+ * resets at 9600 baud and time slots at 115200 baud. Doing the baud
+ * switching here instead of with SET_LINE_CODING round trips makes a
+ * bus operation cost a few UART characters instead of milliseconds.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _ONEWIRE_H_
+#define _ONEWIRE_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		/* Commands are batched in the OUT packets, the results of a whole
+		 * packet are returned in one IN packet, in command order. */
+
+		/** Reset pulse. Result: 1 if a presence pulse was seen, 0 if not. */
+		#define OW_CMD_RESET             0x01
+
+		/** Followed by a count and that many bytes, which are written to the bus
+		 *  LSB first. Result: the bytes read back, write 0xFF to read a byte. */
+		#define OW_CMD_TOUCH             0x02
+
+		/** Followed by one byte, whose bit 0 is written to the bus as a single
+		 *  time slot. Result: the bit read back (0 or 1). */
+		#define OW_CMD_BIT               0x03
+
+		/** One ROM search pass (Maxim AN187), after the host has issued a reset and
+		 *  the search command of its choice (0xF0 or 0xEC). Followed by the last
+		 *  discrepancy of the previous pass (0 to start) and the previous ROM (8 bytes).
+		 *  Result: the found ROM (8 bytes) and the new last discrepancy, which is 0
+		 *  after the last device and \ref OW_SEARCH_FAILED when nothing responded. */
+		#define OW_CMD_SEARCH            0x04
+
+		#define OW_SEARCH_FAILED         0xFF
+
+		/** Ends the results of a packet in which a time slot or reset did not come back
+		 *  on RX (the bus not wired to TX and RX, or held low): in place of the result of
+		 *  that command, the ones after it are not run. The reply is then shorter than
+		 *  the host expects, which tells it from a data byte. */
+		#define OW_ERR_NO_ECHO           0xEE
+
+		/** Longest wait for a character to come back, in 16us Timer0 ticks: twice
+		 *  that of the 9600 baud reset. */
+		#define OW_ECHO_TICKS            130
+
+		/** UBRR1 values (with U2X1) for the reset pulse and the time slots. */
+		#define OW_UBRR_RESET            SERIAL_2X_UBBRVAL(9600)
+		#define OW_UBRR_SLOT             SERIAL_2X_UBBRVAL(115200)
+
+	/* Function Prototypes: */
+		void OneWire_Task(void);
+
+#endif
@@ -0,0 +1,67 @@
+/* Main loop pass time of fast-usbserial, see passtime.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_PASS_STATS
+
+#include "passtime.h"
+
+uint16_t PassStart;
+uint16_t PassSoFar;
+uint8_t PassStartTicks;
+
+/** What VENDOR_REQ_GetPassTime returns. */
+static struct {
+	uint32_t Passes;
+	uint16_t Longest;          /**< Cycles, passes without a control request. */
+	uint8_t  LongestEvents;
+	uint8_t  LongestSetup;     /**< Timer0 ticks, passes with one. */
+} PassTime;
+
+/** Cycles since PassStart, which TCNT1 may have run past OCR1A and wrapped since. */
+static uint16_t PassTime_Since(void)
+{
+	uint16_t t = TCNT1;
+	uint16_t d = t - PassStart;
+	if (t < PassStart) d += OCR1A + 1;
+	return d;
+}
+
+/** Call before TCNT1 is cleared, keeps what the pass took so far. */
+void PassTime_Restart(void)
+{
+	PassSoFar += PassTime_Since();
+	PassStart = 0;
+}
+
+/** Ends the pass started by PassTime_Start(), Events are the PASS_EV_* stages it ran. */
+void PassTime_End(const uint8_t Events)
+{
+	PassTime.Passes++;
+	if (Events & PASS_EV_SETUP) {
+		uint8_t ticks = TCNT0 - PassStartTicks;
+		if (ticks > PassTime.LongestSetup) PassTime.LongestSetup = ticks;
+		return;
+	}
+	uint16_t t = PassSoFar + PassTime_Since();
+	if (t > PassTime.Longest) {
+		PassTime.Longest = t;
+		PassTime.LongestEvents = Events;
+	}
+}
+
+/** Handles VENDOR_REQ_GetPassTime. */
+void PassTime_ProcessControlRequest(void)
+{
+	if (USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+	  return;
+
+	Endpoint_ClearSETUP();
+	Endpoint_Write_Control_Stream_LE(&PassTime, sizeof(PassTime));
+	Endpoint_ClearOUT();
+	if (USB_ControlRequest.wValue & 1)
+	  memset(&PassTime, 0, sizeof(PassTime));
+}
+
+#endif
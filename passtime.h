@@ -0,0 +1,53 @@
+/* Main loop pass time of fast-usbserial (ENABLE_PASS_STATS): how long the
+ * UART loop can take to come back to the USART to USB ring, the worst case
+ * the ring has to cover on top of the host.
+ *
+ * Every pass is timed on Timer1, the flush timer (clk/1, TCNT1 runs up to
+ * OCR1A), from where it looks at TIFR1 to its end. Restarts of the flush
+ * timeout and a match within a pass are accounted for, so passes shorter
+ * than the 0.5ms timer period are exact to the cycle. The longest pass is kept along with the
+ * PASS_EV_* stages it ran. Passes that served a control request wait on
+ * the host inside LUFA for as long as the transfer takes, they are timed
+ * apart on Timer0 (16us ticks at 16MHz, up to 4ms). This costs 13 bytes
+ * of RAM and about 40 cycles a pass.
+ *
+ * VENDOR_REQ_GetPassTime returns the passes so far (32 bits), the longest
+ * pass without a control request in cycles (16 bits), its PASS_EV_* stages
+ * (8 bits) and the longest pass with one in Timer0 ticks (8 bits), little
+ * endian. wValue 1 clears them after the read.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _PASSTIME_H_
+#define _PASSTIME_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		#define PASS_EV_IN               (1 << 0) /**< Sent an IN packet from the USART to USB ring. */
+		#define PASS_EV_OUT              (1 << 1) /**< Took an OUT packet into the USB to USART ring. */
+		#define PASS_EV_SETUP            (1 << 2) /**< Served a control request. */
+		#define PASS_EV_TICK             (1 << 3) /**< Ran the LED tick. */
+
+	/* External Variables: */
+		extern uint16_t PassStart;
+		extern uint16_t PassSoFar;
+		extern uint8_t PassStartTicks;
+
+	/* Inline Functions: */
+		/** Starts timing a pass. */
+		static inline void PassTime_Start(void)
+		{
+			PassStart = TCNT1;
+			PassSoFar = 0;
+			PassStartTicks = TCNT0;
+		}
+
+	/* Function Prototypes: */
+		void PassTime_Restart(void);
+		void PassTime_End(const uint8_t Events);
+		void PassTime_ProcessControlRequest(void);
+
+#endif
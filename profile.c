@@ -0,0 +1,137 @@
+/* Statistical profiler of fast-usbserial, see profile.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_PROFILE
+
+#include "profile.h"
+
+/** The reply of VENDOR_REQ_GetProfile, sent as is. */
+static struct {
+	uint16_t Base;
+	uint8_t  Shift;
+	uint16_t Outside;
+	uint16_t Count[PROFILE_BUCKETS];
+} Profile;
+
+/** Starts sampling with the default window. */
+void Profile_Init(void)
+{
+	Profile.Shift = PROFILE_DEFAULT_SHIFT;
+	OCR0B = TCNT0 + PROFILE_STEP;
+	TIFR0 = _BV(OCF0B);
+	TIMSK0 |= _BV(OCIE0B);
+}
+
+/** Handles VENDOR_REQ_GetProfile and VENDOR_REQ_SetProfile. Sampling stops while they run, so
+ *  the counts are not torn and the readout does not show up in them. */
+void Profile_ProcessControlRequest(void)
+{
+	if (USB_ControlRequest.bRequest == VENDOR_REQ_GetProfile) {
+		if (USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+		  return;
+
+		TIMSK0 &= ~_BV(OCIE0B);
+		Endpoint_ClearSETUP();
+		Endpoint_Write_Control_Stream_LE(&Profile, sizeof(Profile));
+		Endpoint_ClearOUT();
+		if (USB_ControlRequest.wValue & 1) {
+			Profile.Outside = 0;
+			memset(Profile.Count, 0, sizeof(Profile.Count));
+		}
+	} else {
+		if ((USB_ControlRequest.bmRequestType != (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) ||
+		    (USB_ControlRequest.wIndex > 15))
+		  return;
+
+		TIMSK0 &= ~_BV(OCIE0B);
+		Endpoint_ClearSETUP();
+		Profile.Base = USB_ControlRequest.wValue;
+		Profile.Shift = USB_ControlRequest.wIndex;
+		Profile.Outside = 0;
+		memset(Profile.Count, 0, sizeof(Profile.Count));
+		Endpoint_ClearStatusStage();
+	}
+
+	TIFR0 = _BV(OCF0B);
+	TIMSK0 |= _BV(OCIE0B);
+}
+
+#ifdef HOST_BUILD
+/* What the ISR below does, for the host build. There is no program counter
+ * to sample, every sample counts at word address 0. */
+ISR(TIMER0_COMPB_vect)
+{
+	OCR0B += PROFILE_STEP;
+	uint16_t pc = 0;
+	uint16_t i = (uint16_t)(pc - Profile.Base) >> Profile.Shift;
+	if ((pc >= Profile.Base) && (i < PROFILE_BUCKETS)) {
+		if (Profile.Count[i] != 0xFFFF) Profile.Count[i]++;
+	} else if (Profile.Outside != 0xFFFF) {
+		Profile.Outside++;
+	}
+}
+#else
+ISR(TIMER0_COMPB_vect, ISR_NAKED)
+{
+	/* The return address is on the stack high byte first, above the
+	 * 5 bytes pushed here. */
+	asm volatile (
+	"push r24\n\t"
+	"in r24, __SREG__\n\t"
+	"push r24\n\t"
+	"push r25\n\t"
+	"push r30\n\t"
+	"push r31\n\t"
+	"in r24, %[ocr]\n\t"
+	"subi r24, %[negstep]\n\t"
+	"out %[ocr], r24\n\t"
+	"in r30, __SP_L__\n\t"
+	"in r31, __SP_H__\n\t"
+	"ldd r25, Z+6\n\t"
+	"ldd r24, Z+7\n\t"
+	"lds r30, %[base]\n\t"
+	"lds r31, %[base]+1\n\t"
+	"sub r24, r30\n\t"
+	"sbc r25, r31\n\t"
+	"brcs 3f\n\t" // Below the window.
+	"lds r30, %[shift]\n\t"
+	"rjmp 2f\n\t"
+	"1: lsr r25\n\t"
+	"ror r24\n\t"
+	"2: dec r30\n\t"
+	"brpl 1b\n\t"
+	"tst r25\n\t" // r1 is not necessarily zero here.
+	"brne 3f\n\t"
+	"cpi r24, %[buckets]\n\t"
+	"brsh 3f\n\t"
+	"lsl r24\n\t"
+	"ldi r30, lo8(%[count])\n\t"
+	"ldi r31, hi8(%[count])\n\t"
+	"add r30, r24\n\t"
+	"adc r31, r25\n\t"
+	"rjmp 4f\n\t"
+	"3: ldi r30, lo8(%[outside])\n\t"
+	"ldi r31, hi8(%[outside])\n\t"
+	"4: ld r24, Z\n\t"
+	"ldd r25, Z+1\n\t"
+	"adiw r24, 1\n\t"
+	"breq 5f\n\t" // Stop at 0xFFFF.
+	"st Z, r24\n\t"
+	"std Z+1, r25\n\t"
+	"5: pop r31\n\t"
+	"pop r30\n\t"
+	"pop r25\n\t"
+	"pop r24\n\t"
+	"out __SREG__, r24\n\t"
+	"pop r24\n\t"
+	"reti\n\t"
+	:: [ocr] "I" (_SFR_IO_ADDR(OCR0B)), [negstep] "M" (256 - PROFILE_STEP),
+	   [base] "i" (&Profile.Base), [shift] "i" (&Profile.Shift), [outside] "i" (&Profile.Outside),
+	   [count] "i" (Profile.Count), [buckets] "M" (PROFILE_BUCKETS)
+	);
+}
+#endif
+
+#endif
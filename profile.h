@@ -0,0 +1,48 @@
+/* Statistical profiler of fast-usbserial (ENABLE_PROFILE), to find out where
+ * the cycles of the main loop go under load.
+ *
+ * The Timer0 compare B interrupt fires every PROFILE_STEP ticks of the LED
+ * timer (112us at 16MHz, an odd period so it does not lock onto the loop)
+ * and counts the address it interrupted in a histogram of PROFILE_BUCKETS
+ * buckets, each 2^Shift words wide, starting at word address Base. Samples
+ * outside of that window are counted apart. A window over all of the flash
+ * (the default) finds the hot functions, a narrow one over a function tells
+ * its instructions apart, tools/profile.py maps the buckets to symbols and
+ * source lines with fast-usbserial.lss. Time spent in other ISRs is counted
+ * at the address they interrupted, the profiler itself costs about 3% of the
+ * CPU.
+ *
+ * VENDOR_REQ_GetProfile returns Base (16 bits), Shift (8 bits), the samples
+ * outside the window (16 bits), then the PROFILE_BUCKETS counts, 16 bits
+ * little endian each, stopping at 0xFFFF. wValue 1 clears them after the
+ * read. VENDOR_REQ_SetProfile (no data stage) clears them and moves the
+ * window to word address wValue with a Shift of wIndex (at most 15).
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		#define PROFILE_BUCKETS          24
+
+		/** Timer0 ticks (16us) between samples. */
+		#define PROFILE_STEP             7
+
+		/** Default window, all of the application flash (24 buckets of 512 bytes cover the 16KB
+		 *  parts, of 2KB the 32KB ones). */
+		#if defined(FLASHEND) && (FLASHEND > 0x3FFF)
+			#define PROFILE_DEFAULT_SHIFT    10
+		#else
+			#define PROFILE_DEFAULT_SHIFT    8
+		#endif
+
+	/* Function Prototypes: */
+		void Profile_Init(void);
+		void Profile_ProcessControlRequest(void);
+
+#endif
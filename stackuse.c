@@ -0,0 +1,71 @@
+/* Stack high-water mark of fast-usbserial, see stackuse.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_STACK_STATS
+
+#include "stackuse.h"
+
+#ifndef HOST_BUILD
+/** First byte after .bss, from the linker. */
+extern uint8_t _end;
+
+/** First byte the stack may use. */
+#ifdef STACK_BOTTOM
+	#define STACK_START              ((const uint8_t*)STACK_BOTTOM)
+#else
+	#define STACK_START              (&_end)
+#endif
+
+void StackUse_Paint(void) __attribute__((naked, used, section(".init1")));
+
+/** Paints STACK_START..RAMEND, in .init1 so before the stack is used at all. Not a function, the init
+ *  sections run into each other. */
+void StackUse_Paint(void)
+{
+	asm volatile (
+#ifdef STACK_BOTTOM
+	"ldi r30, lo8(%[bottom])\n\t"
+	"ldi r31, hi8(%[bottom])\n\t"
+#else
+	"ldi r30, lo8(_end)\n\t"
+	"ldi r31, hi8(_end)\n\t"
+#endif
+	"ldi r24, %[canary]\n\t"
+	"ldi r25, hi8(%[ramend])\n\t"
+	"rjmp 2f\n\t"
+	"1: st Z+, r24\n\t"
+	"2: cpi r30, lo8(%[ramend])\n\t"
+	"cpc r31, r25\n\t"
+	"brlo 1b\n\t"
+	"breq 1b\n\t"
+	:: [canary] "M" (STACK_CANARY), [ramend] "i" (RAMEND)
+#ifdef STACK_BOTTOM
+	 , [bottom] "i" (STACK_BOTTOM)
+#endif
+	);
+}
+#endif
+
+/** Handles VENDOR_REQ_GetStackUse. */
+void StackUse_ProcessControlRequest(void)
+{
+	if (USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+	  return;
+
+	uint16_t Use[2] = { 0, 0 };
+#ifndef HOST_BUILD
+	const uint8_t* p = STACK_START;
+	Use[0] = (RAMEND + 1) - (uint16_t)p;
+	while ((p <= (const uint8_t*)RAMEND) && (*p == STACK_CANARY))
+	  p++;
+	Use[1] = (RAMEND + 1) - (uint16_t)p;
+#endif
+
+	Endpoint_ClearSETUP();
+	Endpoint_Write_Control_Stream_LE(Use, sizeof(Use));
+	Endpoint_ClearOUT();
+}
+
+#endif
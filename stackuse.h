@@ -0,0 +1,31 @@
+/* Stack high-water mark of fast-usbserial (ENABLE_STACK_STATS), to know how
+ * much of the RAM that the ring buffers, .data and .bss leave the stack
+ * really needs before a feature or a buffer takes more of it.
+ *
+ * Code in .init1, before anything else runs, fills the RAM from the end of
+ * .bss (STACK_BOTTOM on the ATmega32U4, .data/.bss sit below its ring) up
+ * to RAMEND with STACK_CANARY. Whatever the stack ever reaches is
+ * overwritten, so the canaries still in place from the bottom up are the
+ * bytes it never needed. Costs no RAM.
+ *
+ * VENDOR_REQ_GetStackUse returns the size of that region and the deepest
+ * the stack has been into it so far, 16 bits little endian each. The host
+ * build has no stack to look at and returns zeros. tools/memmap.py prints
+ * it along with the RAM map of the build.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _STACKUSE_H_
+#define _STACKUSE_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		#define STACK_CANARY             0xC5
+
+	/* Function Prototypes: */
+		void StackUse_ProcessControlRequest(void);
+
+#endif
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Finds the baud rate of the target with an ENABLE_AUTOBAUD build of fast-usbserial.
+
+Switches the firmware to the autobaud mode (VENDOR_REQ_SetMode through
+pyusb, alongside cdc_acm) and waits for the rate it finds on the RX line,
+see autobaud.h. The target has to send something with a single bit pulse
+in it, 'U' or '\\r' will do; reset it or make it print once the mode is on.
+The firmware then goes back to the plain bridge at that rate, so a terminal
+already open on the port carries on without setting it: the host's own
+line coding reads the new rate only after GET_LINE_CODING.
+
+Example:
+  tools/autobaud.py 2341:0043 --timeout 10
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+VENDOR_REQ_SetMode = 0x01
+VENDOR_REQ_GetMode = 0x02
+VENDOR_REQ_GetAutobaud = 0x11
+SERIAL_MODE_UART = 0
+SERIAL_MODE_AUTOBAUD = 4
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("usb", metavar="VID:PID", help="the ENABLE_AUTOBAUD build")
+    ap.add_argument("--timeout", type=float, default=30, help="give up after this many seconds")
+    args = ap.parse_args()
+
+    import usb.core
+    vid, pid = (int(x, 16) for x in args.usb.split(":"))
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("no device %s" % args.usb)
+
+    dev.ctrl_transfer(0x40, VENDOR_REQ_SetMode, SERIAL_MODE_AUTOBAUD, 0, None)
+    end = time.monotonic() + args.timeout
+    try:
+        while dev.ctrl_transfer(0xC0, VENDOR_REQ_GetMode, 0, 0, 1)[0] == SERIAL_MODE_AUTOBAUD:
+            if time.monotonic() > end:
+                print("no rate found in %gs" % args.timeout)
+                return 1
+            time.sleep(0.05)
+    except KeyboardInterrupt:
+        print("interrupted")
+        return 1
+    finally:
+        # Back to the bridge, at the old rate if none was found.
+        dev.ctrl_transfer(0x40, VENDOR_REQ_SetMode, SERIAL_MODE_UART, 0, None)
+
+    baud, = struct.unpack("<I", bytes(dev.ctrl_transfer(0xC0, VENDOR_REQ_GetAutobaud, 0, 0, 4)))
+    print(baud if baud else "no rate found")
+    return 0 if baud else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,548 @@
+#!/usr/bin/env python3
+"""Throughput and latency benchmark for fast-usbserial.
+
+Streams PRBS-15 data through the firmware and checks every byte that comes
+back, so a run gives MB/s, byte-accurate loss/corruption counts and
+round-trip latency percentiles for each baud rate and write burst size.
+
+Test modes (--mode):
+  loop  host -> USB -> UART TX -> loopback -> UART RX -> USB -> host.
+        Needs TX tied to RX (jumper on the 328 side with it held in reset,
+        or a sketch that echoes). Also measures round-trip latency.
+  tx    host -> UART only, timed until the tty reports it drained.
+  rx    UART -> host only, the target sends PRBS-15 (see prbs15_byte()
+        below for the generator) and the checker locks on to it.
+
+The port is a tty (/dev/ttyACM0) by default, or with --usb VID:PID the
+ENABLE_VENDOR_BULK build through pyusb, which also checks the sequence
+numbers of the IN packets.
+
+With --device-latency VID:PID (an ENABLE_LATENCY_STATS build, pyusb) the
+device residence time histograms are read and cleared after every test and
+printed under its row, so the device's share of p50/p99 is visible.
+With --pass-time VID:PID (an ENABLE_PASS_STATS build) the longest main
+loop pass of every test is printed the same way.
+
+Example:
+  tools/bench.py /dev/ttyACM0 --baud 115200,1000000,2000000 --burst 1,63,64,512
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import threading
+import time
+import tty
+
+# PRBS-15, x^15 + x^14 + 1, seeded with all ones, 8 bits per byte MSB first.
+# The byte stream repeats every 32767 bytes. A target side generator is:
+#   uint16_t s = 0x7FFF;
+#   uint8_t prbs15_byte(void) {
+#       uint8_t b = 0;
+#       for (uint8_t i = 0; i < 8; i++) {
+#           uint8_t bit = ((s >> 14) ^ (s >> 13)) & 1;
+#           s = ((s << 1) | bit) & 0x7FFF;
+#           b = (b << 1) | bit;
+#       }
+#       return b;
+#   }
+PRBS_PERIOD = 32767
+
+
+def _prbs15_period():
+    s = 0x7FFF
+    out = bytearray(PRBS_PERIOD)
+    for i in range(PRBS_PERIOD):
+        b = 0
+        for _ in range(8):
+            bit = ((s >> 14) ^ (s >> 13)) & 1
+            s = ((s << 1) | bit) & 0x7FFF
+            b = (b << 1) | bit
+        out[i] = b
+    return bytes(out)
+
+
+PRBS = _prbs15_period()
+PRBS2 = PRBS + PRBS
+
+
+def prbs(pos, n):
+    """n bytes of the stream starting at byte pos."""
+    out = bytearray()
+    pos %= PRBS_PERIOD
+    while n:
+        k = min(n, PRBS_PERIOD)
+        out += PRBS2[pos:pos + k]
+        pos = (pos + k) % PRBS_PERIOD
+        n -= k
+    return bytes(out)
+
+
+class Checker:
+    """Follows a received PRBS stream and counts what went missing or wrong.
+
+    Bytes are matched against the expected stream. On a mismatch the next
+    SYNC bytes decide between a corrupted byte (the stream continues right
+    after it), lost bytes (the stream continues further on) and an inserted
+    byte (neither). Losses of a whole PRBS period or more cannot be told
+    apart from smaller ones.
+    """
+
+    SYNC = 8
+    BLOCK = 256
+
+    def __init__(self, aligned=True):
+        self.pos = 0          # Index in the expected stream of buf[0].
+        self.locked = aligned
+        self.good = 0
+        self.lost = 0
+        self.bad = 0          # Corrupted or inserted bytes.
+        self.buf = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+        self._run(final=False)
+
+    def finish(self, sent=None):
+        """Checks the tail, sent is the number of bytes the stream should have had."""
+        self._run(final=True)
+        if sent is not None and self.locked and self.pos < sent:
+            self.lost += sent - self.pos
+            self.pos = sent
+
+    def _run(self, final):
+        buf = self.buf
+        i = 0
+        while True:
+            left = len(buf) - i
+            if not left or (left < self.SYNC and not final):
+                break
+            if not self.locked:
+                if left < self.SYNC:
+                    break
+                k = PRBS.find(bytes(buf[i:i + self.SYNC]))
+                if k < 0:
+                    self.bad += 1
+                    i += 1
+                    continue
+                self.pos = k
+                self.locked = True
+            n = min(left, self.BLOCK)
+            exp = prbs(self.pos, n + self.SYNC)
+            if buf[i:i + n] == exp[:n]:
+                self.good += n
+                self.pos += n
+                i += n
+                continue
+            # Walk up to the first bad byte.
+            j = 0
+            while buf[i + j] == exp[j]:
+                j += 1
+            self.good += j
+            self.pos += j
+            i += j
+            if len(buf) - i < self.SYNC + 1:
+                if not final:
+                    break
+                self.bad += 1
+                self.pos += 1
+                i += 1
+                continue
+            ahead = bytes(buf[i:i + self.SYNC])
+            if buf[i + 1:i + 1 + self.SYNC] == prbs(self.pos + 1, self.SYNC):
+                self.bad += 1
+                self.pos += 1
+                i += 1
+                continue
+            k = prbs(self.pos, PRBS_PERIOD + self.SYNC).find(ahead)
+            if k > 0:
+                self.lost += k
+                self.pos += k
+                continue
+            self.bad += 1
+            i += 1
+        del buf[:i]
+
+
+class TtyPort:
+    def __init__(self, path, baud, settle):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        tty.setraw(self.fd)
+        attr = termios.tcgetattr(self.fd)
+        speed = getattr(termios, "B%d" % baud, None)
+        if speed is None:
+            raise SystemExit("%d baud has no termios constant on this host" % baud)
+        attr[4] = attr[5] = speed
+        attr[2] |= termios.CLOCAL | termios.CREAD
+        attr[2] &= ~termios.CRTSCTS
+        termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+        time.sleep(settle)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+
+    def write(self, data):
+        try:
+            return os.write(self.fd, data)
+        except BlockingIOError:
+            return 0
+
+    def read(self, timeout):
+        r, w, _ = select.select([self.fd], [], [], timeout)
+        if not r:
+            return b""
+        try:
+            return os.read(self.fd, 65536)
+        except BlockingIOError:
+            return b""
+
+    def wait_writable(self, timeout):
+        select.select([], [self.fd], [], timeout)
+
+    def drain(self):
+        termios.tcdrain(self.fd)
+
+    def close(self):
+        os.close(self.fd)
+
+
+class UsbPort:
+    """ENABLE_VENDOR_BULK build: strips the IN packet headers and checks their sequence numbers."""
+
+    VENDOR_REQ_SetLineCoding = 0x05
+    VENDOR_REQ_SetControlLines = 0x07
+    HDR_LEN = 2
+
+    def __init__(self, vidpid, baud, settle):
+        import usb.core
+        import usb.util
+        self.usb = usb
+        vid, pid = (int(x, 16) for x in vidpid.split(":"))
+        self.dev = usb.core.find(idVendor=vid, idProduct=pid)
+        if self.dev is None:
+            raise SystemExit("no device %s" % vidpid)
+        self.dev.set_configuration()
+        usb.util.claim_interface(self.dev, 0)
+        self.dev.ctrl_transfer(0x40, self.VENDOR_REQ_SetLineCoding, 0, 0,
+                               struct.pack("<IBBB", baud, 0, 0, 8))
+        self.dev.ctrl_transfer(0x40, self.VENDOR_REQ_SetControlLines, 0x0003, 0)
+        time.sleep(settle)
+        self.seq = None
+        self.seq_errors = 0
+        self.lock = threading.Lock()
+        self.rx = bytearray()
+        self.stop = False
+        self.thread = threading.Thread(target=self._reader, daemon=True)
+        self.thread.start()
+        time.sleep(0.05)
+        with self.lock:
+            self.rx.clear()
+        self.seq_errors = 0
+
+    def _reader(self):
+        while not self.stop:
+            try:
+                pkt = self.dev.read(0x83, 64, timeout=50)
+            except self.usb.core.USBTimeoutError:
+                continue
+            except self.usb.core.USBError:
+                if self.stop:
+                    return
+                raise
+            if len(pkt) < self.HDR_LEN:
+                continue
+            if self.seq is not None and pkt[0] != ((self.seq + 1) & 0xFF):
+                self.seq_errors += 1
+            self.seq = pkt[0]
+            with self.lock:
+                self.rx += bytes(pkt[self.HDR_LEN:])
+
+    def write(self, data):
+        return self.dev.write(0x04, data, timeout=1000)
+
+    def read(self, timeout):
+        end = time.monotonic() + timeout
+        while True:
+            with self.lock:
+                if self.rx:
+                    data = bytes(self.rx)
+                    self.rx.clear()
+                    return data
+            if time.monotonic() >= end:
+                return b""
+            time.sleep(0.0002)
+
+    def wait_writable(self, timeout):
+        pass
+
+    def drain(self):
+        pass
+
+    def close(self):
+        self.stop = True
+        self.thread.join()
+        self.usb.util.dispose_resources(self.dev)
+
+
+def pump(port, total, burst, check, idle):
+    """Writes total PRBS bytes (if any) in burst sized writes while feeding the checker
+    with what comes back. Returns (first byte time, last byte time)."""
+    sent = 0
+    t_first = t_last = None
+    t0 = time.perf_counter()
+    last_rx = t0
+    while True:
+        if sent < total:
+            n = port.write(prbs(sent, min(burst, total - sent)))
+            if t_first is None and n:
+                t_first = time.perf_counter()
+            sent += n
+            timeout = 0 if n else 0.001
+            if not n:
+                port.wait_writable(0.001)
+        else:
+            timeout = 0.05
+        data = port.read(timeout)
+        now = time.perf_counter()
+        if data:
+            if t_first is None:
+                t_first = now
+            t_last = last_rx = now
+            if check is not None:
+                check.feed(data)
+        elif sent >= total and now - last_rx > idle:
+            break
+        if check is not None and check.pos >= total > 0:
+            break
+    return t_first, t_last
+
+
+def percentile(sorted_vals, p):
+    if not sorted_vals:
+        return float("nan")
+    k = min(len(sorted_vals) - 1, int(round(p / 100.0 * (len(sorted_vals) - 1))))
+    return sorted_vals[k]
+
+
+def run_loop(port, baud, burst, seconds, iterations):
+    total = max(burst, int(baud / 10 * seconds))
+    check = Checker()
+    t_first, t_last = pump(port, total, burst, check, idle=1.0)
+    check.finish(total)
+    elapsed = (t_last - t_first) if t_first and t_last and t_last > t_first else float("nan")
+    res = {
+        "bytes": total,
+        "MBps": check.good / elapsed / 1e6,
+        "lost": check.lost,
+        "bad": check.bad,
+    }
+
+    # Round trips of one burst at a time, continuing the stream.
+    rtt = []
+    check = Checker()
+    pos = 0
+    timeout = 0.5 + burst * 10.0 / baud * 2
+    for _ in range(iterations):
+        data = prbs(pos, burst)
+        t0 = time.perf_counter()
+        off = 0
+        while off < burst:
+            off += port.write(data[off:])
+        deadline = t0 + timeout
+        while check.pos < pos + burst and time.perf_counter() < deadline:
+            got = port.read(max(0, deadline - time.perf_counter()))
+            if got:
+                check.feed(got)
+        t1 = time.perf_counter()
+        check.finish()
+        if check.pos >= pos + burst:
+            rtt.append((t1 - t0) * 1e6)
+        else:
+            check.lost += pos + burst - check.pos
+            check.pos = pos + burst
+        pos += burst
+    rtt.sort()
+    res.update({
+        "rtt_lost": check.lost,
+        "rtt_bad": check.bad,
+        "p50_us": percentile(rtt, 50),
+        "p99_us": percentile(rtt, 99),
+        "p999_us": percentile(rtt, 99.9),
+    })
+    return res
+
+
+def run_tx(port, baud, burst, seconds):
+    total = max(burst, int(baud / 10 * seconds))
+    sent = 0
+    t0 = time.perf_counter()
+    while sent < total:
+        n = port.write(prbs(sent, min(burst, total - sent)))
+        if not n:
+            port.wait_writable(0.01)
+        sent += n
+    port.drain()
+    elapsed = time.perf_counter() - t0
+    return {"bytes": total, "MBps": total / elapsed / 1e6}
+
+
+def run_rx(port, baud, seconds):
+    check = Checker(aligned=False)
+    end = time.perf_counter() + seconds
+    t_first = t_last = None
+    while time.perf_counter() < end:
+        data = port.read(0.05)
+        if data:
+            now = time.perf_counter()
+            t_first = t_first or now
+            t_last = now
+            check.feed(data)
+    check.finish()
+    elapsed = (t_last - t_first) if t_first and t_last and t_last > t_first else float("nan")
+    return {"bytes": check.good + check.lost, "MBps": check.good / elapsed / 1e6,
+            "lost": check.lost, "bad": check.bad}
+
+
+COLUMNS = ["mode", "baud", "burst", "bytes", "MBps", "lost", "bad",
+           "rtt_lost", "rtt_bad", "p50_us", "p99_us", "p999_us", "seq_errors"]
+
+
+class DeviceLatency:
+    """VENDOR_REQ_GetLatency of an ENABLE_LATENCY_STATS build, see latency.h."""
+
+    VENDOR_REQ_GetLatency = 0x08
+    BUCKETS = 10
+    TICK_US = 16
+
+    def __init__(self, vidpid):
+        import usb.core
+        vid, pid = (int(x, 16) for x in vidpid.split(":"))
+        self.dev = usb.core.find(idVendor=vid, idProduct=pid)
+        if self.dev is None:
+            raise SystemExit("no device %s" % vidpid)
+
+    def read(self, clear=True):
+        """Returns the USART to USB and the USB to USART histogram."""
+        d = bytes(self.dev.ctrl_transfer(0xC0, self.VENDOR_REQ_GetLatency, 1 if clear else 0, 0,
+                                         self.BUCKETS * 4))
+        counts = struct.unpack("<%dH" % (self.BUCKETS * 2), d)
+        return counts[:self.BUCKETS], counts[self.BUCKETS:]
+
+    def labels(self):
+        out = ["<%dus" % (2 * self.TICK_US)]
+        out += ["%dus" % (self.TICK_US << b) for b in range(1, self.BUCKETS - 1)]
+        out.append(">=%dus" % (self.TICK_US << (self.BUCKETS - 1)))
+        return out
+
+    def show(self, hist, name):
+        if not any(hist):
+            return
+        cells = ["%s:%d" % (l, n) for l, n in zip(self.labels(), hist) if n]
+        print("    device %s: %s" % (name, " ".join(cells)))
+
+
+class DevicePassTime:
+    """VENDOR_REQ_GetPassTime of an ENABLE_PASS_STATS build, see passtime.h."""
+
+    VENDOR_REQ_GetPassTime = 0x0E
+    STAGES = ("IN", "OUT", "SETUP", "tick")
+    F_CPU = 16000000
+    TICK_US = 16
+
+    def __init__(self, vidpid):
+        import usb.core
+        vid, pid = (int(x, 16) for x in vidpid.split(":"))
+        self.dev = usb.core.find(idVendor=vid, idProduct=pid)
+        if self.dev is None:
+            raise SystemExit("no device %s" % vidpid)
+
+    def read(self, clear=True):
+        """Returns (passes, longest in cycles, its PASS_EV_* stages, longest with a control request in us)."""
+        d = bytes(self.dev.ctrl_transfer(0xC0, self.VENDOR_REQ_GetPassTime, 1 if clear else 0, 0, 8))
+        passes, longest, events, setup = struct.unpack("<IHBB", d)
+        return passes, longest, events, setup * self.TICK_US
+
+    def show(self, stats):
+        passes, longest, events, setup_us = stats
+        stages = "+".join(s for i, s in enumerate(self.STAGES) if events & (1 << i)) or "idle"
+        print("    device passes %d, longest %d cycles (%.1fus, %s), with a control request %dus"
+              % (passes, longest, longest * 1e6 / self.F_CPU, stages, setup_us))
+
+
+def fmt(v):
+    if isinstance(v, float):
+        return "%.3f" % v if v < 100 else "%.0f" % v
+    return str(v)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("port", nargs="?", default="/dev/ttyACM0", help="tty of the board")
+    ap.add_argument("--usb", metavar="VID:PID", help="use the ENABLE_VENDOR_BULK interface through pyusb")
+    ap.add_argument("--mode", choices=["loop", "tx", "rx"], default="loop")
+    ap.add_argument("--baud", default="115200,500000,1000000,2000000", help="comma separated list")
+    ap.add_argument("--burst", default="1,16,63,64,256", help="write sizes, comma separated list")
+    ap.add_argument("--seconds", type=float, default=2.0, help="stream length per test, in line time")
+    ap.add_argument("--iterations", type=int, default=1000, help="round trips per latency test")
+    ap.add_argument("--settle", type=float, default=2.0,
+                    help="seconds to wait after opening (DTR resets the target)")
+    ap.add_argument("--csv", help="also write the results to this file")
+    ap.add_argument("--device-latency", metavar="VID:PID",
+                    help="print the ENABLE_LATENCY_STATS histograms after every test")
+    ap.add_argument("--pass-time", metavar="VID:PID",
+                    help="print the ENABLE_PASS_STATS longest main loop pass after every test")
+    args = ap.parse_args()
+    latency = DeviceLatency(args.device_latency) if args.device_latency else None
+    passtime = DevicePassTime(args.pass_time) if args.pass_time else None
+
+    bauds = [int(b) for b in args.baud.split(",")]
+    bursts = [int(b) for b in args.burst.split(",")]
+    rows = []
+    print("  ".join("%9s" % c for c in COLUMNS))
+    for baud in bauds:
+        if args.usb:
+            port = UsbPort(args.usb, baud, args.settle)
+        else:
+            port = TtyPort(args.port, baud, args.settle)
+        try:
+            if latency:
+                latency.read()
+            if passtime:
+                passtime.read()
+            for burst in (bursts if args.mode != "rx" else [0]):
+                if args.mode == "loop":
+                    res = run_loop(port, baud, burst, args.seconds, args.iterations)
+                elif args.mode == "tx":
+                    res = run_tx(port, baud, burst, args.seconds)
+                else:
+                    res = run_rx(port, baud, args.seconds)
+                res.update({"mode": args.mode, "baud": baud, "burst": burst})
+                if args.usb:
+                    res["seq_errors"] = port.seq_errors
+                    port.seq_errors = 0
+                rows.append(res)
+                print("  ".join("%9s" % fmt(res.get(c, "")) for c in COLUMNS))
+                if latency:
+                    to_usb, to_usart = latency.read()
+                    latency.show(to_usb, "USART->USB")
+                    latency.show(to_usart, "USB->USART")
+                if passtime:
+                    passtime.show(passtime.read())
+                sys.stdout.flush()
+        finally:
+            port.close()
+
+    if args.csv:
+        with open(args.csv, "w") as f:
+            f.write(",".join(COLUMNS) + "\n")
+            for r in rows:
+                f.write(",".join(fmt(r.get(c, "")) for c in COLUMNS) + "\n")
+
+    if any(r.get("lost") or r.get("bad") or r.get("rtt_lost") or r.get("rtt_bad") for r in rows):
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Timestamped sniffing with an ENABLE_CAPTURE build of fast-usbserial.
+
+Opens the port at the given line coding, switches the firmware to the
+capture mode (VENDOR_REQ_SetMode through pyusb, alongside cdc_acm) and
+decodes the record stream of capture.h into one line per received byte:
+
+      time_us   delta_us  byte  flags
+     1234.000     86.000  0x55
+
+Times are the device's, in microseconds since the capture started, taken
+as the USART had the byte (the middle of its stop bit). --sof also prints
+the USB frame records, which tie the device time to the host's frames.
+The port goes back to the plain bridge on exit.
+
+Example:
+  tools/capture.py /dev/ttyACM0 2341:0043 --baud 19200 --csv bus.csv
+"""
+
+import argparse
+import sys
+import time
+
+VENDOR_REQ_SetMode = 0x01
+SERIAL_MODE_UART = 0
+SERIAL_MODE_CAPTURE = 3
+
+REC_TIME = 0xC0
+REC_SOF = 0xC1
+REC_STATUS = 0xC2
+
+STATUS = ((0x01, "lost"), (0x04, "parity"), (0x08, "overrun"), (0x10, "framing"))
+
+
+class Decoder:
+    """Turns the byte stream into (kind, time_us, value, flags) events,
+    records may be split over reads."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.time = None
+        self.status = 0
+
+    @staticmethod
+    def length(c):
+        if c < 0x80:
+            return 2
+        if c < 0xC0:
+            return 3
+        return {REC_TIME: 5, REC_SOF: 7, REC_STATUS: 2}.get(c, 1)
+
+    def feed(self, data):
+        self.buf += data
+        out = []
+        while self.buf and len(self.buf) >= self.length(self.buf[0]):
+            c = self.buf[0]
+            r = self.buf[:self.length(c)]
+            del self.buf[:len(r)]
+            if c == REC_TIME:
+                self.time = int.from_bytes(r[1:5], "little")
+            elif c == REC_SOF:
+                out.append(("sof", int.from_bytes(r[3:7], "little"), int.from_bytes(r[1:3], "little"), 0))
+            elif c == REC_STATUS:
+                self.status = r[1]
+            elif c < 0xC0 and self.time is not None:
+                self.time += c if c < 0x80 else ((c & 0x3F) << 8) | r[1]
+                out.append(("byte", self.time, r[-1], self.status))
+                self.status = 0
+            # Anything else is a stream we joined in the middle of, skip until a time record.
+        return out
+
+
+def set_mode(dev, mode):
+    dev.ctrl_transfer(0x40, VENDOR_REQ_SetMode, mode, 0, None)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("port", help="the board's serial port")
+    ap.add_argument("usb", metavar="VID:PID", help="the ENABLE_CAPTURE build")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--parity", choices="NEO", default="N")
+    ap.add_argument("--seconds", type=float, help="stop after this long, default is until ^C")
+    ap.add_argument("--sof", action="store_true", help="also print the USB frame records")
+    ap.add_argument("--csv", help="also write the bytes to this file")
+    args = ap.parse_args()
+
+    import serial
+    import usb.core
+    vid, pid = (int(x, 16) for x in args.usb.split(":"))
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("no device %s" % args.usb)
+
+    ser = serial.Serial(args.port, args.baud, parity=args.parity, timeout=0.05)
+    set_mode(dev, SERIAL_MODE_CAPTURE)
+    csv = open(args.csv, "w") if args.csv else None
+    if csv:
+        csv.write("time_us,byte,flags\n")
+    dec = Decoder()
+    prev = None
+    end = time.monotonic() + args.seconds if args.seconds else None
+    print("%12s  %9s  %-4s  %s" % ("time_us", "delta_us", "byte", "flags"))
+    try:
+        while end is None or time.monotonic() < end:
+            for kind, t, v, status in dec.feed(ser.read(4096)):
+                if kind == "sof":
+                    if args.sof:
+                        print("%12d  %9s  frame %d" % (t, "", v))
+                    continue
+                flags = ",".join(name for bit, name in STATUS if status & bit)
+                delta = "" if prev is None else "%d" % (t - prev)
+                print("%12d  %9s  0x%02x  %s" % (t, delta, v, flags))
+                if csv:
+                    csv.write("%d,%d,%s\n" % (t, v, flags))
+                prev = t
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        set_mode(dev, SERIAL_MODE_UART)
+        ser.close()
+        if csv:
+            csv.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
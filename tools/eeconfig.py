@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Reads or writes the default configuration of fast-usbserial in its EEPROM.
+
+With a baud rate stored the port is armed at power-up: the USART runs with
+that line coding and buffers what it receives until a host opens the port
+(see eeconfig.h). --fixed keeps that coding whatever the host asks for.
+The new configuration takes effect at the next reset. Without options
+this prints the stored one, --clear removes it.
+
+Example:
+  tools/eeconfig.py 2341:0043 --baud 115200 --fixed
+"""
+
+import argparse
+import struct
+import sys
+
+VENDOR_REQ_GetConfig = 0x0F
+VENDOR_REQ_SetConfig = 0x10
+
+FLAG_FIXED = 0x01
+MODES = {"uart": 0, "onewire": 1, "lin": 2, "capture": 3, "autobaud": 4}
+FLOWS = {"none": 0, "xonxoff": 1}
+LAYOUT = "<IBBBHBBB"
+FIELDS = ("baud", "stop", "parity", "bits", "flush_us", "flags", "mode", "flow")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("usb", metavar="VID:PID")
+    ap.add_argument("--baud", type=int, help="arm the port at this baud rate, 0 to disarm")
+    ap.add_argument("--format", default="8N1", help="data bits, parity (N, O, E) and stop bits (1, 2), default 8N1")
+    ap.add_argument("--flush-us", type=int, help="flush timeout, 0 for the default 500us")
+    ap.add_argument("--fixed", action="store_true", help="ignore the host's line coding")
+    ap.add_argument("--mode", choices=sorted(MODES), help="serial mode to start in")
+    ap.add_argument("--flow", choices=sorted(FLOWS), help="flow control, xonxoff needs a firmware built with it")
+    ap.add_argument("--clear", action="store_true", help="back to the firmware defaults")
+    args = ap.parse_args()
+
+    import usb.core
+    vid, pid = (int(x, 16) for x in args.usb.split(":"))
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("no device %s" % args.usb)
+
+    size = struct.calcsize(LAYOUT)
+    cfg = dict(zip(FIELDS, struct.unpack(LAYOUT, bytes(dev.ctrl_transfer(0xC0, VENDOR_REQ_GetConfig, 0, 0, size)))))
+    change = args.clear or any(v is not None for v in (args.baud, args.flush_us, args.mode, args.flow)) or args.fixed
+    if change:
+        if args.clear:
+            cfg = dict.fromkeys(FIELDS, 0)
+        if args.baud is not None:
+            fmt = args.format.upper()
+            if len(fmt) != 3 or fmt[0] not in "5678" or fmt[1] not in "NOE" or fmt[2] not in "12":
+                raise SystemExit("bad --format %s" % args.format)
+            cfg.update(baud=args.baud, bits=int(fmt[0]), parity="NOE".index(fmt[1]), stop=0 if fmt[2] == "1" else 2)
+        if args.flush_us is not None:
+            cfg["flush_us"] = args.flush_us
+        if args.mode is not None:
+            cfg["mode"] = MODES[args.mode]
+        if args.flow is not None:
+            cfg["flow"] = FLOWS[args.flow]
+        if args.baud is not None:
+            cfg["flags"] = FLAG_FIXED if args.fixed and args.baud else 0
+        elif args.fixed:
+            cfg["flags"] |= FLAG_FIXED
+        try:
+            dev.ctrl_transfer(0x40, VENDOR_REQ_SetConfig, 0, 0, struct.pack(LAYOUT, *(cfg[f] for f in FIELDS)))
+        except usb.core.USBError:
+            raise SystemExit("the device refused the configuration")
+        print("stored, takes effect at the next reset")
+
+    if not cfg["baud"]:
+        print("not armed, flush %dus, mode %d%s" % (
+            cfg["flush_us"] or 500, cfg["mode"], ", xon/xoff" if cfg["flow"] else ""))
+    else:
+        print("armed at %d %d%s%d%s, flush %dus, mode %d%s" % (
+            cfg["baud"], cfg["bits"], "NOE"[cfg["parity"]], 2 if cfg["stop"] == 2 else 1,
+            ", fixed" if cfg["flags"] & FLAG_FIXED else "", cfg["flush_us"] or 500, cfg["mode"],
+            ", xon/xoff" if cfg["flow"] else ""))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
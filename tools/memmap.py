@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""RAM map of a fast-usbserial build ("make memcheck").
+
+The ring buffers sit at fixed addresses (see fast-usbserial.h), .data is
+moved past them in LDFLAGS and the stack gets what is left up to RAMEND
+(on the ATmega32U4 .data goes below its 1KB ring, the stack above it).
+Nothing checks that at link time, so this reads the symbols of the ELF
+with avr-nm, prints the map and the biggest variables, and fails when
+.data or .bss run into a ring buffer or past RAMEND, or leave the stack
+less than --stack bytes.
+
+With --usb VID:PID (an ENABLE_STACK_STATS build, pyusb) it also reads the
+deepest the stack has been since reset (VENDOR_REQ_GetStackUse, see
+stackuse.h), so the reserve can be set from a measurement: run the
+device through enumeration and a test first.
+
+Example:
+  tools/memmap.py fast-usbserial.elf --mcu atmega16u2 --stack 40
+"""
+
+import argparse
+import struct
+import subprocess
+import sys
+
+VENDOR_REQ_GetStackUse = 0x0C
+RAM_OFFSET = 0x800000
+
+RAMEND = {
+    "at90usb82": 0x2FF, "at90usb162": 0x2FF,
+    "atmega8u2": 0x2FF, "atmega16u2": 0x2FF, "atmega32u2": 0x4FF,
+    "atmega32u4": 0xAFF,
+}
+
+# Fixed regions of fast-usbserial.h by RAMEND: (start, size, name). Which
+# direction each one carries on the 512 byte parts depends on
+# BIG_UART_TX_RING.
+RINGS = {
+    0x2FF: [(0x100, 256, "256 byte ring"), (0x200, 128, "128 byte ring")],
+    0x4FF: [(0x100, 256, "USB to USART ring"), (0x200, 512, "USART to USB ring")],
+    0xAFF: [(0x100, 256, "USB to USART ring"), (0x400, 1024, "USART to USB ring")],
+}
+
+# Where the stack starts when .data/.bss are not right below it: on the
+# ATmega32U4 they sit in the hole below the 1KB ring.
+STACK_BOTTOM = {0xAFF: 0x800}
+
+# SRAM starts past the registers and I/O space on all of them.
+RAMSTART = 0x100
+
+
+def symbols(nm, elf):
+    """{name: (address, size)} of the RAM symbols, addresses without the 0x800000 offset."""
+    out = subprocess.run([nm, "-n", "-S", "--defined-only", elf], check=True,
+                         capture_output=True, text=True).stdout
+    syms = {}
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) == 4:
+            addr, size, _, name = int(f[0], 16), int(f[1], 16), f[2], f[3]
+        elif len(f) == 3:
+            addr, size, name = int(f[0], 16), 0, f[2]
+        else:
+            continue
+        if RAM_OFFSET <= addr < RAM_OFFSET + 0x10000:
+            syms[name] = (addr - RAM_OFFSET, size)
+    return syms
+
+
+def stack_use(vidpid):
+    import usb.core
+    vid, pid = (int(x, 16) for x in vidpid.split(":"))
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("no device %s" % vidpid)
+    return struct.unpack("<HH", bytes(dev.ctrl_transfer(0xC0, VENDOR_REQ_GetStackUse, 0, 0, 4)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("elf")
+    ap.add_argument("--mcu", default="atmega16u2", choices=sorted(RAMEND))
+    ap.add_argument("--nm", default="avr-nm")
+    ap.add_argument("--stack", type=int, default=40, help="bytes the stack needs at least, default 40")
+    ap.add_argument("--usb", metavar="VID:PID", help="also read the stack high-water mark of this device")
+    args = ap.parse_args()
+
+    syms = symbols(args.nm, args.elf)
+    ramend = RAMEND[args.mcu]
+    get = lambda name: syms[name][0] if name in syms else None
+    data = (get("__data_start"), get("__data_end"))
+    bss = (get("__bss_start"), get("__bss_end"))
+    end = get("_end") or bss[1]
+    stack = STACK_BOTTOM.get(RAMEND[args.mcu], end)
+    if None in data + bss:
+        raise SystemExit("%s: no __data_start/__bss_end, not an avr-libc ELF?" % args.elf)
+
+    rings = RINGS[ramend]
+    regions = [(s, s + n, name) for s, n, name in rings]
+    regions += [(data[0], data[1], ".data"), (bss[0], bss[1], ".bss"), (stack, ramend + 1, "stack")]
+    print("%-6s %-6s %5s  %s" % ("start", "end", "bytes", "region"))
+    at = RAMSTART
+    for s, e, name in sorted(regions):
+        if s > at:
+            print("0x%04x 0x%04x %5d  (unused)" % (at, s - 1, s - at))
+        print("0x%04x 0x%04x %5d  %s" % (s, e - 1, e - s, name))
+        at = max(at, e)
+
+    variables = sorted(((size, name, addr) for name, (addr, size) in syms.items()
+                        if size and data[0] <= addr < bss[1]), reverse=True)
+    if variables:
+        print("\nlargest variables:")
+        for size, name, addr in variables[:10]:
+            print("  0x%04x %5d  %s" % (addr, size, name))
+
+    errors = []
+    for s, n, name in rings:
+        for lo, hi, sect in ((data[0], data[1], ".data"), (bss[0], bss[1], ".bss")):
+            if lo < s + n and s < hi:
+                errors.append("%s overlaps the %s" % (sect, name))
+        if s + n > ramend + 1:
+            errors.append("the %s ends past RAMEND" % name)
+    free = ramend + 1 - stack
+    if free < args.stack:
+        errors.append("%d bytes left for the stack, less than %d" % (free, args.stack))
+    else:
+        print("\nstack: %d bytes, %d more than the %d reserved" % (free, free - args.stack, args.stack))
+
+    if args.usb:
+        size, deepest = stack_use(args.usb)
+        if size != free:
+            print("the device runs another build (%d bytes of stack)" % size, file=sys.stderr)
+        print("stack on the device: deepest %d of %d bytes, %d never touched" % (deepest, size, size - deepest))
+
+    for e in errors:
+        print("memcheck: " + e, file=sys.stderr)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
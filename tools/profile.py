@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""Where the cycles of an ENABLE_PROFILE build of fast-usbserial go.
+
+Samples the firmware's PC histogram (VENDOR_REQ_GetProfile, see profile.h)
+through pyusb while the port is in use, e.g. under tools/bench.py, and maps
+it back to the code with the extended listing the Makefile makes from
+fast-usbserial.elf (fast-usbserial.lss, "make lss"). The per object .lst
+listings are no help there, with -flto they hold no code.
+
+Without --function the window spans all of the code in the listing, 512
+bytes a bucket on the 16KB parts, 2KB on the 32KB ones, and the samples are shared out over the symbols in each
+bucket by size; "~" marks symbols that share a bucket, their counts are
+estimates. --function NAME moves the window over one function, which gives
+a bucket for every instruction word of functions up to 48 bytes, and for
+bigger ones prints the source line each bucket starts in.
+
+The histogram is read and cleared every second, so counts do not stop at
+0xFFFF, and a sample is worth PROFILE_STEP * 16us (112us).
+
+Example:
+  tools/profile.py 2341:0043 --seconds 10
+  tools/profile.py 2341:0043 --function main --lss fast-usbserial.lss
+"""
+
+import argparse
+import re
+import struct
+import sys
+import time
+
+VENDOR_REQ_GetProfile = 0x0A
+VENDOR_REQ_SetProfile = 0x0B
+BUCKETS = 24
+REPLY = "<HBH%dH" % BUCKETS
+
+
+class Listing:
+    """Symbols, instructions and source lines of a .lss file, byte addresses."""
+
+    SYMBOL = re.compile(r"^([0-9a-f]{8}) <(.+)>:$")
+    INSN = re.compile(r"^\s*([0-9a-f]+):\t(?:[0-9a-f]{2} )+\s*\t?(.*)$")
+
+    def __init__(self, path):
+        self.symbols = []       # (start, name), sorted
+        self.insns = []         # (addr, text, source line)
+        source = ""
+        in_text = False
+        with open(path, errors="replace") as f:
+            for line in f:
+                line = line.rstrip("\n")
+                if line.startswith("Disassembly of section"):
+                    in_text = line.startswith("Disassembly of section .text")
+                    continue
+                if not in_text:
+                    continue
+                m = self.SYMBOL.match(line)
+                if m:
+                    self.symbols.append((int(m.group(1), 16), m.group(2)))
+                    continue
+                m = self.INSN.match(line)
+                if m:
+                    text = m.group(2).split(";")[0].strip().replace("\t", " ")
+                    self.insns.append((int(m.group(1), 16), text, source))
+                elif line.strip() and line.strip() != "...":
+                    source = line.strip()
+        self.symbols.sort()
+        self.end = self.insns[-1][0] + 2 if self.insns else 0
+
+    def symbol(self, name):
+        for i, (start, n) in enumerate(self.symbols):
+            if n == name:
+                end = self.symbols[i + 1][0] if i + 1 < len(self.symbols) else self.end
+                return start, end
+        raise SystemExit("no symbol %s in the listing" % name)
+
+    def overlap(self, lo, hi):
+        """[(name, bytes of [lo, hi) it covers)] of the symbols there."""
+        out = []
+        for i, (start, name) in enumerate(self.symbols):
+            end = self.symbols[i + 1][0] if i + 1 < len(self.symbols) else self.end
+            n = min(end, hi) - max(start, lo)
+            if n > 0:
+                out.append((name, n))
+        return out
+
+    def first_insn(self, lo, hi):
+        for addr, text, source in self.insns:
+            if lo <= addr < hi:
+                return addr, text, source
+        return None
+
+
+def set_window(dev, base_word, shift):
+    dev.ctrl_transfer(0x40, VENDOR_REQ_SetProfile, base_word, shift, None)
+
+
+def read(dev):
+    """Returns (base word, shift, outside, counts) and clears the counts."""
+    d = bytes(dev.ctrl_transfer(0xC0, VENDOR_REQ_GetProfile, 1, 0, struct.calcsize(REPLY)))
+    v = struct.unpack(REPLY, d)
+    return v[0], v[1], v[2], list(v[3:])
+
+
+def sample(dev, seconds):
+    read(dev)
+    outside = 0
+    counts = [0] * BUCKETS
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        time.sleep(min(1.0, max(end - time.monotonic(), 0)))
+        base, shift, o, c = read(dev)
+        outside += o
+        counts = [a + b for a, b in zip(counts, c)]
+    return base, shift, outside, counts
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("usb", metavar="VID:PID", help="the ENABLE_PROFILE build")
+    ap.add_argument("--lss", default="fast-usbserial.lss", help="listing of the running firmware")
+    ap.add_argument("--seconds", type=float, default=5, help="how long to sample, default 5")
+    ap.add_argument("--function", help="profile the instructions of this function")
+    args = ap.parse_args()
+
+    lss = Listing(args.lss)
+    import usb.core
+    vid, pid = (int(x, 16) for x in args.usb.split(":"))
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("no device %s" % args.usb)
+
+    if args.function:
+        lo, hi = lss.symbol(args.function)
+        words = (hi - lo + 1) // 2
+        shift = 0
+        while (BUCKETS << shift) < words:
+            shift += 1
+        set_window(dev, lo // 2, shift)
+    else:
+        shift = 8
+        while (BUCKETS << shift) * 2 < lss.end:
+            shift += 1
+        set_window(dev, 0, shift)
+
+    base, shift, outside, counts = sample(dev, args.seconds)
+    total = outside + sum(counts)
+    if not total:
+        raise SystemExit("no samples")
+    pct = lambda n: 100.0 * n / total
+
+    print("%d samples, %.1f%% outside the window" % (total, pct(outside)))
+    if not args.function:
+        per_symbol = {}
+        shared = set()
+        for b, n in enumerate(counts):
+            lo = (base + (b << shift)) * 2
+            syms = lss.overlap(lo, lo + (2 << shift))
+            size = sum(s for _, s in syms)
+            for name, s in syms:
+                per_symbol[name] = per_symbol.get(name, 0) + n * s / size
+                if len(syms) > 1:
+                    shared.add(name)
+        for name, n in sorted(per_symbol.items(), key=lambda x: -x[1]):
+            if n >= 0.5:
+                print("%6.1f%%  %s%s" % (pct(n), "~" if name in shared else " ", name))
+        return 0
+
+    for b, n in enumerate(counts):
+        lo = (base + (b << shift)) * 2
+        insn = lss.first_insn(lo, lo + (2 << shift))
+        if insn is None:
+            continue
+        addr, text, source = insn
+        where = text if shift == 0 else source
+        print("%6.1f%%  %5x  %s" % (pct(n), addr, where))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#!/bin/sh
+# End to end test without hardware: the firmware in simavr, USB/IP into
+# vhci-hcd, the kernel's cdc_acm on top and tools/bench.py through it with
+# USART1 looped back. Needs root (or a privileged container) for the
+# vhci-hcd module and usbip attach. Exits non-zero on any lost or bad byte.
+#
+#   ./cdc-test.sh [fast-usbserial.elf] [bench.py options]
+#
+# MCU=atmega32u2 in the environment for an ELF built for that part.
+
+set -e
+
+ELF=${1:-../../fast-usbserial.elf}
+[ $# -gt 0 ] && shift
+HERE=$(dirname "$0")
+PORT=3240
+
+modprobe vhci-hcd
+
+"$HERE/usbip-board" -l -m "${MCU:-atmega16u2}" -p $PORT "$ELF" &
+BOARD=$!
+trap 'usbip detach -p 0 >/dev/null 2>&1 || true; kill $BOARD 2>/dev/null || true' EXIT
+
+# The server is up once it lists the device.
+for i in $(seq 50); do
+	usbip list -r 127.0.0.1 2>/dev/null | grep -q "1-1:" && break
+	sleep 0.2
+done
+BEFORE=$(ls /dev/ttyACM* 2>/dev/null || true)
+usbip attach -r 127.0.0.1 -b 1-1
+
+TTY=
+for i in $(seq 100); do
+	for t in /dev/ttyACM*; do
+		[ -e "$t" ] || continue
+		echo "$BEFORE" | grep -qx "$t" || TTY=$t
+	done
+	[ -n "$TTY" ] && break
+	sleep 0.1
+done
+if [ -z "$TTY" ]; then
+	echo "cdc-test: no ttyACM appeared" >&2
+	exit 1
+fi
+echo "cdc-test: $TTY"
+
+# Simulated time runs slower than the wall clock, so keep the runs short.
+"$HERE/../bench.py" "$TTY" --mode loop --baud 115200,1000000 --burst 1,64 \
+	--seconds 0.2 --iterations 50 --settle 0.5 "$@"
@@ -0,0 +1,771 @@
+/* fast-usbserial.elf in simavr, exported to Linux over USB/IP.
+ *
+ * simavr has no ATmega16U2, but the AT90USB162 it does have is the same
+ * part as far as the firmware is concerned (same USB controller, USART1,
+ * timers, 512 bytes of SRAM at 0x100), so the ELF runs on that core. The
+ * ATmega32U2 is the same again with 1KB of SRAM and 32KB of flash, -m
+ * atmega32u2 widens the core to that before it is set up. The 32U4 has the
+ * other USB controller, which simavr does not model. Its
+ * USB controller model is driven from here as the host side of a USB/IP
+ * server, so the kernel's vhci-hcd and cdc_acm talk to the firmware as if
+ * the board were plugged in:
+ *
+ *   ./usbip-board -l ../../fast-usbserial.elf &
+ *   sudo modprobe vhci-hcd
+ *   sudo usbip attach -r 127.0.0.1 -b 1-1
+ *   ../bench.py /dev/ttyACM0 --baud 115200,1000000
+ *
+ * The other end of USART1 is a loopback plug (-l), or a pty (default)
+ * whose name is printed, for a test to play the 328. Everything runs in
+ * one thread: the AVR runs in slices and the USB transactions and the pty
+ * are serviced in between, in simulated time. The simulation does not
+ * wait for the wall clock, so MB/s seen by the host is simavr's speed,
+ * while the UART and USB pacing the firmware sees is the real one.
+ *
+ * Once the host has configured the device it prints the simulated time
+ * since power-up and the packets the control pipe took to get there. The
+ * packet count is the firmware's (descriptor lengths, control endpoint
+ * size), the time also depends on how quickly the kernel got to it.
+ *
+ * Under the LUFA License, see ../../fast-usbserial.c. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "avr_uart.h"
+#include "avr_usb.h"
+
+#define F_CPU            16000000
+#define SIM_CORE         "at90usb162"
+
+/* Parts the SIM_CORE stands in for, with their memory sizes. */
+static const struct {
+	const char* mcu;
+	uint16_t    ramend;
+	uint32_t    flashend;
+} sim_parts[] = {
+	{ "atmega8u2",  0x2FF, 0x1FFF },
+	{ "atmega16u2", 0x2FF, 0x3FFF },
+	{ "atmega32u2", 0x4FF, 0x7FFF },
+};
+
+/* AVR cycles between two rounds of USB transactions, about a dozen
+ * full speed packet times. */
+#define USB_SLICE        256
+
+/* Sockets and pty are looked at this often, in AVR cycles. */
+#define IO_SLICE         (F_CPU / 2000)
+
+#define USBIP_PORT       3240
+#define USBIP_VERSION    0x0111
+#define USBIP_BUSID      "1-1"
+
+#define OP_REQ_DEVLIST   0x8005
+#define OP_REP_DEVLIST   0x0005
+#define OP_REQ_IMPORT    0x8003
+#define OP_REP_IMPORT    0x0003
+
+#define USBIP_CMD_SUBMIT 1
+#define USBIP_CMD_UNLINK 2
+#define USBIP_RET_SUBMIT 3
+#define USBIP_RET_UNLINK 4
+
+#define USBIP_DIR_OUT    0
+#define USBIP_DIR_IN     1
+
+#define URB_ZERO_PACKET  0x0040
+
+#define MAX_EP           5
+#define MAX_PACKET       64
+#define MAX_IFACES       8
+
+/* USB/IP on the wire, all big endian. */
+struct usbip_device {
+	char     path[256];
+	char     busid[32];
+	uint32_t busnum;
+	uint32_t devnum;
+	uint32_t speed;
+	uint16_t idVendor;
+	uint16_t idProduct;
+	uint16_t bcdDevice;
+	uint8_t  bDeviceClass;
+	uint8_t  bDeviceSubClass;
+	uint8_t  bDeviceProtocol;
+	uint8_t  bConfigurationValue;
+	uint8_t  bNumConfigurations;
+	uint8_t  bNumInterfaces;
+} __attribute__((packed));
+
+struct usbip_header {
+	uint32_t command;
+	uint32_t seqnum;
+	uint32_t devid;
+	uint32_t direction;
+	uint32_t ep;
+	union {
+		struct {
+			uint32_t transfer_flags;
+			int32_t  transfer_buffer_length;
+			int32_t  start_frame;
+			int32_t  number_of_packets;
+			int32_t  interval;
+			uint8_t  setup[8];
+		} __attribute__((packed)) submit;
+		struct {
+			int32_t  status;
+			int32_t  actual_length;
+			int32_t  start_frame;
+			int32_t  number_of_packets;
+			int32_t  error_count;
+			uint8_t  setup[8];
+		} __attribute__((packed)) ret_submit;
+		struct {
+			uint32_t seqnum;
+			uint8_t  pad[24];
+		} __attribute__((packed)) unlink;
+		struct {
+			int32_t  status;
+			uint8_t  pad[24];
+		} __attribute__((packed)) ret_unlink;
+	} u;
+} __attribute__((packed));
+
+/* One transfer the kernel submitted, worked through a packet at a time. */
+enum { STAGE_SETUP, STAGE_DATA, STAGE_STATUS };
+
+struct urb {
+	struct urb* next;
+	uint32_t    seqnum;
+	uint8_t     ep;
+	bool        in;
+	bool        zlp;         /* OUT: end with a zero length packet. */
+	uint8_t     stage;
+	uint8_t     setup[8];
+	int32_t     len;
+	int32_t     done;
+	uint8_t*    buf;
+};
+
+static avr_t*      avr;
+static avr_irq_t*  uart_in;
+static bool        usb_attached;
+static bool        uart_xoff;
+static bool        loopback;
+static int         pty = -1;
+static int         listen_fd = -1;
+static int         conn = -1;
+static bool        imported;
+static bool        verbose;
+static unsigned long ctl_packets;            /* Control pipe packets until configured. */
+static bool        configured;
+
+/* USART1 input not yet taken by the simulated UART. */
+static uint8_t     uart_buf[4096];
+static unsigned    uart_head, uart_tail;
+static unsigned long uart_dropped;
+
+static uint8_t     ep_size[MAX_EP][2];   /* [ep][in], from the configuration descriptor */
+static struct urb* queue[MAX_EP][2];
+static struct usbip_device dev;
+static uint8_t     ifaces[MAX_IFACES][3];
+
+/* AVR side **************************************************************/
+
+static void usb_attach_hook(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+	(void)irq; (void)param;
+	usb_attached = !!value;
+}
+
+static void uart_out_hook(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+	(void)irq; (void)param;
+	uint8_t c = value;
+	if (loopback) {
+		if (((uart_head + 1) % sizeof(uart_buf)) != uart_tail) {
+			uart_buf[uart_head] = c;
+			uart_head = (uart_head + 1) % sizeof(uart_buf);
+		} else {
+			uart_dropped++;
+		}
+	} else if (write(pty, &c, 1) != 1) {
+		uart_dropped++;
+	}
+}
+
+static void uart_xon_hook(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+	(void)irq; (void)value; (void)param;
+	uart_xoff = false;
+}
+
+static void uart_xoff_hook(struct avr_irq_t* irq, uint32_t value, void* param)
+{
+	(void)irq; (void)value; (void)param;
+	uart_xoff = true;
+}
+
+static void uart_feed(void)
+{
+	while (!uart_xoff && (uart_tail != uart_head)) {
+		avr_raise_irq(uart_in, uart_buf[uart_tail]);
+		uart_tail = (uart_tail + 1) % sizeof(uart_buf);
+	}
+}
+
+static void avr_step(avr_cycle_count_t cycles)
+{
+	avr_cycle_count_t end = avr->cycle + cycles;
+	while (avr->cycle < end) {
+		int state = avr_run(avr);
+		if ((state == cpu_Done) || (state == cpu_Crashed)) {
+			fprintf(stderr, "usbip-board: AVR %s at pc 0x%04x\n",
+			        (state == cpu_Done) ? "stopped" : "crashed", avr->pc);
+			exit(1);
+		}
+	}
+}
+
+/* USB transactions ******************************************************/
+
+static int usb_packet(uint32_t ioctl, uint8_t ep, uint8_t* buf, uint32_t* sz)
+{
+	struct avr_io_usb pkt = { .pipe = ep, .sz = *sz, .buf = buf };
+	int ret = avr_ioctl(avr, ioctl, &pkt);
+	*sz = pkt.sz;
+	return ret;
+}
+
+/* One packet of the URB, if the device takes it. Returns 1 when the URB is
+ * complete, 0 while it is still going, a negative errno when it failed. */
+static int urb_step(struct urb* u)
+{
+	uint8_t  packet[MAX_PACKET];
+	uint8_t  size = ep_size[u->ep][u->in] ? ep_size[u->ep][u->in] : 8;
+	uint32_t sz;
+	int      ret;
+
+	if (u->ep == 0) {
+		switch (u->stage) {
+			case STAGE_SETUP:
+				sz = 8;
+				usb_packet(AVR_IOCTL_USB_SETUP, 0, u->setup, &sz);
+				ctl_packets++;
+				u->stage = u->len ? STAGE_DATA : STAGE_STATUS;
+				return 0;
+			case STAGE_DATA:
+				sz = ((u->len - u->done) < size) ? (u->len - u->done) : size;
+				if (u->in) {
+					ret = usb_packet(AVR_IOCTL_USB_READ, 0, packet, &sz);
+					if (ret == AVR_IOCTL_USB_OK) memcpy(u->buf + u->done, packet, sz);
+				} else {
+					ret = usb_packet(AVR_IOCTL_USB_WRITE, 0, u->buf + u->done, &sz);
+				}
+				if (ret == AVR_IOCTL_USB_NAK) return 0;
+				if (ret == AVR_IOCTL_USB_STALL) return -EPIPE;
+				ctl_packets++;
+				u->done += sz;
+				if ((u->done == u->len) || (u->in && (sz < size))) u->stage = STAGE_STATUS;
+				return 0;
+			default:
+				/* Status in the direction opposite to the data, IN for no data. */
+				sz = 0;
+				ret = usb_packet((u->in && u->len) ? AVR_IOCTL_USB_WRITE : AVR_IOCTL_USB_READ, 0, packet, &sz);
+				if (ret == AVR_IOCTL_USB_NAK) return 0;
+				ctl_packets++;
+				return (ret == AVR_IOCTL_USB_STALL) ? -EPIPE : 1;
+		}
+	}
+
+	if (u->in) {
+		sz = size;
+		ret = usb_packet(AVR_IOCTL_USB_READ, u->ep, packet, &sz);
+		if (ret == AVR_IOCTL_USB_NAK) return 0;
+		if (ret == AVR_IOCTL_USB_STALL) return -EPIPE;
+		if (sz > (uint32_t)(u->len - u->done)) return -EOVERFLOW;
+		memcpy(u->buf + u->done, packet, sz);
+		u->done += sz;
+		return ((sz < size) || (u->done == u->len)) ? 1 : 0;
+	}
+
+	sz = ((u->len - u->done) < size) ? (u->len - u->done) : size;
+	if (!sz && u->done && !u->zlp) return 1;
+	ret = usb_packet(AVR_IOCTL_USB_WRITE, u->ep, u->buf + u->done, &sz);
+	if (ret == AVR_IOCTL_USB_NAK) return 0;
+	if (ret == AVR_IOCTL_USB_STALL) return -EPIPE;
+	if (!sz) return 1;
+	u->done += sz;
+	if (u->done < u->len) return 0;
+	/* A full last packet needs a zero length one after it if the URB asked. */
+	return (u->zlp && !(u->len % size)) ? 0 : 1;
+}
+
+static struct urb* urb_new(uint8_t ep, bool in, int32_t len)
+{
+	struct urb* u = calloc(1, sizeof(*u) + len);
+	if (!u) {
+		perror("usbip-board");
+		exit(1);
+	}
+	u->ep = ep;
+	u->in = in;
+	u->len = len;
+	u->buf = (uint8_t*)(u + 1);
+	return u;
+}
+
+/* A control transfer of our own, before the device is exported. */
+static int control_sync(const uint8_t* setup, uint8_t* data)
+{
+	int32_t len = setup[6] | (setup[7] << 8);
+	struct urb* u = urb_new(0, setup[0] & 0x80, len);
+	memcpy(u->setup, setup, 8);
+	if (!u->in && len) memcpy(u->buf, data, len);
+
+	int ret;
+	avr_cycle_count_t deadline = avr->cycle + F_CPU;
+	while (!(ret = urb_step(u))) {
+		if (avr->cycle > deadline) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+		avr_step(USB_SLICE);
+	}
+	if ((ret > 0) && u->in) {
+		memcpy(data, u->buf, u->done);
+		ret = u->done + 1;
+	}
+	free(u);
+	return (ret > 0) ? (ret - 1) : ret;
+}
+
+/* Waits for the firmware to attach, resets and addresses it, and reads
+ * what USB/IP needs to announce it. */
+static void enumerate(void)
+{
+	static const uint8_t set_address[8] = { 0x00, 0x05, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	uint8_t get_desc[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x12, 0x00 };
+	uint8_t d[512];
+
+	avr_ioctl(avr, AVR_IOCTL_USB_VBUS, (void*)1);
+	avr_cycle_count_t deadline = avr->cycle + 2 * F_CPU;
+	while (!usb_attached) {
+		if (avr->cycle > deadline) {
+			fprintf(stderr, "usbip-board: the firmware never attached to the bus\n");
+			exit(1);
+		}
+		avr_step(IO_SLICE);
+	}
+	avr_ioctl(avr, AVR_IOCTL_USB_RESET, NULL);
+	avr_step(F_CPU / 100);
+
+	/* The first 8 bytes tell the control endpoint size. */
+	get_desc[6] = 8;
+	if (control_sync(get_desc, d) < 8) goto fail;
+	ep_size[0][0] = ep_size[0][1] = d[7];
+	if (control_sync(set_address, NULL) < 0) goto fail;
+	get_desc[6] = 18;
+	if (control_sync(get_desc, d) < 18) goto fail;
+
+	memset(&dev, 0, sizeof(dev));
+	snprintf(dev.path, sizeof(dev.path), "/sys/devices/simavr/usb1/%s", USBIP_BUSID);
+	snprintf(dev.busid, sizeof(dev.busid), "%s", USBIP_BUSID);
+	dev.busnum = htonl(1);
+	dev.devnum = htonl(1);
+	dev.speed = htonl(2); /* USB_SPEED_FULL */
+	dev.idVendor = htons(d[8] | (d[9] << 8));
+	dev.idProduct = htons(d[10] | (d[11] << 8));
+	dev.bcdDevice = htons(d[12] | (d[13] << 8));
+	dev.bDeviceClass = d[4];
+	dev.bDeviceSubClass = d[5];
+	dev.bDeviceProtocol = d[6];
+	dev.bNumConfigurations = d[17];
+
+	get_desc[3] = 0x02;
+	get_desc[6] = sizeof(d) & 0xFF;
+	get_desc[7] = sizeof(d) >> 8;
+	int n = control_sync(get_desc, d);
+	if (n < 9) goto fail;
+	for (int i = 0; (i + 2 <= n) && d[i]; i += d[i]) {
+		if ((d[i + 1] == 0x04) && (dev.bNumInterfaces < MAX_IFACES)) {
+			memcpy(ifaces[dev.bNumInterfaces++], &d[i + 5], 3);
+		} else if (d[i + 1] == 0x05) {
+			uint8_t ep = d[i + 2] & 0x0F;
+			if (ep < MAX_EP) ep_size[ep][d[i + 2] >> 7] = d[i + 4];
+		}
+	}
+	printf("usbip-board: %04x:%04x, %u interfaces, exported as %s on port %d\n",
+	       ntohs(dev.idVendor), ntohs(dev.idProduct), dev.bNumInterfaces, USBIP_BUSID, USBIP_PORT);
+	return;
+
+fail:
+	fprintf(stderr, "usbip-board: the firmware did not enumerate\n");
+	exit(1);
+}
+
+/* USB/IP server *********************************************************/
+
+static bool read_full(int fd, void* buf, size_t n)
+{
+	uint8_t* p = buf;
+	while (n) {
+		ssize_t r = read(fd, p, n);
+		if (r <= 0) {
+			if ((r < 0) && (errno == EINTR)) continue;
+			return false;
+		}
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+static bool write_full(int fd, const void* buf, size_t n)
+{
+	const uint8_t* p = buf;
+	while (n) {
+		ssize_t r = write(fd, p, n);
+		if (r <= 0) {
+			if ((r < 0) && (errno == EINTR)) continue;
+			return false;
+		}
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+static void drop_urbs(void)
+{
+	for (int e = 0; e < MAX_EP; e++) {
+		for (int d = 0; d < 2; d++) {
+			while (queue[e][d]) {
+				struct urb* u = queue[e][d];
+				queue[e][d] = u->next;
+				free(u);
+			}
+		}
+	}
+}
+
+static void disconnect(void)
+{
+	if (conn >= 0) close(conn);
+	conn = -1;
+	imported = false;
+	drop_urbs();
+	if (verbose) printf("usbip-board: client gone\n");
+}
+
+static void op_reply(uint16_t code, uint32_t status)
+{
+	uint16_t h[4] = { htons(USBIP_VERSION), htons(code), htons(status >> 16), htons(status) };
+	write_full(conn, h, sizeof(h));
+}
+
+/* DEVLIST or IMPORT on a new connection. */
+static void handle_op(void)
+{
+	uint16_t h[4];
+	if (!read_full(conn, h, sizeof(h))) {
+		disconnect();
+		return;
+	}
+	if (ntohs(h[1]) == OP_REQ_DEVLIST) {
+		op_reply(OP_REP_DEVLIST, 0);
+		uint32_t ndev = htonl(1);
+		write_full(conn, &ndev, 4);
+		write_full(conn, &dev, sizeof(dev));
+		for (int i = 0; i < dev.bNumInterfaces; i++) {
+			uint8_t iface[4] = { ifaces[i][0], ifaces[i][1], ifaces[i][2], 0 };
+			write_full(conn, iface, sizeof(iface));
+		}
+		disconnect();
+	} else if (ntohs(h[1]) == OP_REQ_IMPORT) {
+		char busid[32];
+		if (!read_full(conn, busid, sizeof(busid))) {
+			disconnect();
+			return;
+		}
+		busid[sizeof(busid) - 1] = 0;
+		if (strcmp(busid, USBIP_BUSID)) {
+			op_reply(OP_REP_IMPORT, 1);
+			disconnect();
+			return;
+		}
+		op_reply(OP_REP_IMPORT, 0);
+		write_full(conn, &dev, sizeof(dev));
+		imported = true;
+		printf("usbip-board: imported\n");
+	} else {
+		disconnect();
+	}
+}
+
+static void ret_submit(struct urb* u, int status)
+{
+	struct usbip_header h;
+	memset(&h, 0, sizeof(h));
+	h.command = htonl(USBIP_RET_SUBMIT);
+	h.seqnum = htonl(u->seqnum);
+	h.u.ret_submit.status = htonl(status);
+	h.u.ret_submit.actual_length = htonl(u->done);
+	if (!write_full(conn, &h, sizeof(h)) || (u->in && u->done && !write_full(conn, u->buf, u->done)))
+	  disconnect();
+}
+
+static void handle_cmd(void)
+{
+	struct usbip_header h;
+	if (!read_full(conn, &h, sizeof(h))) {
+		disconnect();
+		return;
+	}
+	uint32_t ep = ntohl(h.ep);
+	bool     in = (ntohl(h.direction) == USBIP_DIR_IN);
+
+	if (ntohl(h.command) == USBIP_CMD_SUBMIT) {
+		int32_t len = ntohl(h.u.submit.transfer_buffer_length);
+		if ((ep >= MAX_EP) || (len < 0) || (len > (1 << 20))) {
+			disconnect();
+			return;
+		}
+		if (ep == 0) in = h.u.submit.setup[0] & 0x80;
+		struct urb* u = urb_new(ep, in, len);
+		u->seqnum = ntohl(h.seqnum);
+		u->zlp = ntohl(h.u.submit.transfer_flags) & URB_ZERO_PACKET;
+		memcpy(u->setup, h.u.submit.setup, 8);
+		if (!in && len && !read_full(conn, u->buf, len)) {
+			free(u);
+			disconnect();
+			return;
+		}
+		/* One control pipe, whichever the direction. */
+		struct urb** q = &queue[ep][ep ? in : 0];
+		while (*q) q = &(*q)->next;
+		*q = u;
+	} else if (ntohl(h.command) == USBIP_CMD_UNLINK) {
+		uint32_t seq = ntohl(h.u.unlink.seqnum);
+		int32_t status = 0;
+		for (int e = 0; (e < MAX_EP) && !status; e++) {
+			for (int d = 0; (d < 2) && !status; d++) {
+				for (struct urb** q = &queue[e][d]; *q; q = &(*q)->next) {
+					if ((*q)->seqnum == seq) {
+						struct urb* u = *q;
+						*q = u->next;
+						free(u);
+						status = -ECONNRESET;
+						break;
+					}
+				}
+			}
+		}
+		memset(&h.u, 0, sizeof(h.u));
+		h.command = htonl(USBIP_RET_UNLINK);
+		h.devid = h.direction = h.ep = 0;
+		h.u.ret_unlink.status = htonl(status);
+		if (!write_full(conn, &h, sizeof(h))) disconnect();
+	} else {
+		disconnect();
+	}
+}
+
+/* The first URB of every pipe gets a packet's worth of bus time. */
+static void usb_service(void)
+{
+	for (int e = 0; (e < MAX_EP) && (conn >= 0); e++) {
+		for (int d = 0; d < 2; d++) {
+			struct urb* u = queue[e][d];
+			if (!u) continue;
+			int ret = urb_step(u);
+			if (!ret) continue;
+			if (!e && (ret > 0) && !configured && (u->setup[0] == 0x00) && (u->setup[1] == 0x09)) {
+				configured = true;
+				printf("usbip-board: configured %.1f ms after power-up, %lu control packets\n",
+				       avr->cycle * 1e3 / F_CPU, ctl_packets);
+			}
+			queue[e][d] = u->next;
+			ret_submit(u, (ret < 0) ? ret : 0);
+			free(u);
+			if (conn < 0) return;
+		}
+	}
+}
+
+static void io_service(void)
+{
+	struct pollfd p[2];
+	int n = 0;
+
+	if (conn >= 0) {
+		p[n].fd = conn;
+	} else {
+		p[n].fd = listen_fd;
+	}
+	p[n++].events = POLLIN;
+	if (pty >= 0) {
+		p[n].fd = pty;
+		p[n++].events = POLLIN;
+	}
+
+	while (poll(p, n, 0) > 0) {
+		bool more = false;
+		if (p[0].revents) {
+			if (conn < 0) {
+				conn = accept(listen_fd, NULL, NULL);
+				if (conn >= 0) {
+					int one = 1;
+					setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+					handle_op();
+				}
+			} else if (!imported) {
+				handle_op();
+			} else {
+				handle_cmd();
+			}
+			p[0].fd = (conn >= 0) ? conn : listen_fd;
+			more = true;
+		}
+		if ((n > 1) && (p[1].revents & POLLIN) && (((uart_head + 1) % sizeof(uart_buf)) != uart_tail)) {
+			uint8_t c;
+			while ((((uart_head + 1) % sizeof(uart_buf)) != uart_tail) && (read(pty, &c, 1) == 1)) {
+				uart_buf[uart_head] = c;
+				uart_head = (uart_head + 1) % sizeof(uart_buf);
+			}
+			more = true;
+		}
+		if (!more) break;
+	}
+}
+
+static int open_pty(void)
+{
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((fd < 0) || grantpt(fd) || unlockpt(fd)) {
+		perror("usbip-board: pty");
+		exit(1);
+	}
+	/* Raw, and held open from this side so the master never sees a hangup. */
+	int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+	struct termios t;
+	if ((slave < 0) || tcgetattr(slave, &t)) {
+		perror("usbip-board: pty");
+		exit(1);
+	}
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	printf("usbip-board: UART on %s\n", ptsname(fd));
+	return fd;
+}
+
+static int open_listen(int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if ((fd < 0) || bind(fd, (struct sockaddr*)&a, sizeof(a)) || listen(fd, 1)) {
+		perror("usbip-board: listen");
+		exit(1);
+	}
+	return fd;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: usbip-board [-l] [-m mcu] [-p port] [-v] fast-usbserial.elf\n"
+	                "  -l  loop USART1 TX back to RX instead of the pty\n"
+	                "  -m  the MCU the ELF was built for: atmega8u2, atmega16u2 (default), atmega32u2\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int port = USBIP_PORT;
+	const char* mcu = "atmega16u2";
+	int c;
+	while ((c = getopt(argc, argv, "lm:p:v")) != -1) {
+		switch (c) {
+			case 'l': loopback = true; break;
+			case 'm': mcu = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'v': verbose = true; break;
+			default: usage();
+		}
+	}
+	if (optind != argc - 1) usage();
+	unsigned part = 0;
+	while (strcmp(sim_parts[part].mcu, mcu) != 0) {
+		if (++part == sizeof(sim_parts) / sizeof(sim_parts[0])) {
+			fprintf(stderr, "usbip-board: no core for %s\n", mcu);
+			return 1;
+		}
+	}
+
+	elf_firmware_t fw;
+	memset(&fw, 0, sizeof(fw));
+	if (elf_read_firmware(argv[optind], &fw)) {
+		fprintf(stderr, "usbip-board: cannot load %s\n", argv[optind]);
+		return 1;
+	}
+	avr = avr_make_mcu_by_name(SIM_CORE);
+	if (!avr) {
+		fprintf(stderr, "usbip-board: this simavr has no %s core\n", SIM_CORE);
+		return 1;
+	}
+	avr->ramend = sim_parts[part].ramend;
+	avr->flashend = sim_parts[part].flashend;
+	avr_init(avr);
+	fw.frequency = F_CPU;
+	avr_load_firmware(avr, &fw);
+
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('1'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('1'), &flags);
+	uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_INPUT);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_OUTPUT), uart_out_hook, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_OUT_XON), uart_xon_hook, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_OUT_XOFF), uart_xoff_hook, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_USB_GETIRQ(), USB_IRQ_ATTACH), usb_attach_hook, NULL);
+
+	signal(SIGPIPE, SIG_IGN);
+	if (!loopback) pty = open_pty();
+	listen_fd = open_listen(port);
+	enumerate();
+	fflush(stdout);
+
+	for (;;) {
+		for (int i = 0; i < IO_SLICE / USB_SLICE; i++) {
+			avr_step(USB_SLICE);
+			if (imported) usb_service();
+			uart_feed();
+		}
+		io_service();
+		if (verbose && uart_dropped) {
+			printf("usbip-board: %lu UART bytes dropped\n", uart_dropped);
+			uart_dropped = 0;
+		}
+	}
+}
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Timeline of an ENABLE_TRACE build of fast-usbserial.
+
+Drains the firmware's trace ring with VENDOR_REQ_GetTrace (see trace.h)
+through pyusb, alongside whatever driver owns the interfaces, and prints
+one line per record:
+
+      time_us   delta_us  event       arg
+    12345.678     16.000  OUT          64
+
+Times come from the device (16us ticks, 16 bits, about a second around)
+and are unwrapped here with the host clock as a guide to how many times the
+counter went around between two records. Records the device had to drop
+because it was not read fast enough are reported as "lost" lines where they
+happened.
+
+Example:
+  tools/trace.py 2341:0043 --seconds 5 --csv trace.csv
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+VENDOR_REQ_GetTrace = 0x09
+TRACE_LEN = 8
+HDR_LEN = 2
+RECORD_LEN = 4
+TICK_US = 16
+
+EVENTS = {
+    0x01: "START",
+    0x02: "STOP",
+    0x03: "OUT",
+    0x04: "OUT_HELD",
+    0x05: "IN",
+    0x06: "IN_FLUSH",
+    0x07: "SETUP",
+}
+
+# bRequest of the SETUP events, standard and CDC ones by name.
+REQUESTS = {
+    0x00: "GET_STATUS", 0x01: "CLEAR_FEATURE", 0x03: "SET_FEATURE", 0x05: "SET_ADDRESS",
+    0x06: "GET_DESCRIPTOR", 0x08: "GET_CONFIGURATION", 0x09: "SET_CONFIGURATION",
+    0x20: "SET_LINE_CODING", 0x21: "GET_LINE_CODING", 0x22: "SET_CONTROL_LINE_STATE",
+    0x23: "SEND_BREAK",
+}
+
+
+class Timeline:
+    """Unwraps the 16 bit tick counter into microseconds since the first wrap.
+
+    Of the times the ticks can stand for, takes the one at or after the
+    previous record that is closest to where the host clock says the
+    device should be by now.
+    """
+
+    PERIOD_US = (1 << 16) * TICK_US
+
+    def __init__(self):
+        self.last_us = None
+        self.last_host = None
+
+    def time_us(self, ticks, host):
+        t = ticks * TICK_US
+        if self.last_us is not None:
+            expect = self.last_us + (host - self.last_host) * 1e6
+            k = max(round((expect - t) / self.PERIOD_US), 0)
+            t += k * self.PERIOD_US
+            while t < self.last_us:
+                t += self.PERIOD_US
+        self.last_us = t
+        self.last_host = host
+        return t
+
+
+def read(dev):
+    """Returns (lost, [(event, arg, ticks), ...]) of one VENDOR_REQ_GetTrace."""
+    d = bytes(dev.ctrl_transfer(0xC0, VENDOR_REQ_GetTrace, 0, 0, HDR_LEN + TRACE_LEN * RECORD_LEN))
+    lost, n = d[0], d[1]
+    recs = [struct.unpack_from("<BBH", d, HDR_LEN + i * RECORD_LEN) for i in range(n)]
+    return lost, recs
+
+
+def describe(event, arg):
+    name = EVENTS.get(event, "0x%02x" % event)
+    if event == 0x07:
+        return name, REQUESTS.get(arg, "0x%02x" % arg)
+    return name, str(arg)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("usb", metavar="VID:PID", help="the ENABLE_TRACE build")
+    ap.add_argument("--seconds", type=float, help="stop after this long, default is until ^C")
+    ap.add_argument("--csv", help="also write the records to this file")
+    args = ap.parse_args()
+
+    import usb.core
+    vid, pid = (int(x, 16) for x in args.usb.split(":"))
+    dev = usb.core.find(idVendor=vid, idProduct=pid)
+    if dev is None:
+        raise SystemExit("no device %s" % args.usb)
+
+    csv = open(args.csv, "w") if args.csv else None
+    if csv:
+        csv.write("time_us,event,arg\n")
+    tl = Timeline()
+    prev = None
+    total_lost = 0
+    end = time.monotonic() + args.seconds if args.seconds else None
+    print("%12s  %9s  %-10s  %s" % ("time_us", "delta_us", "event", "arg"))
+    try:
+        while end is None or time.monotonic() < end:
+            lost, recs = read(dev)
+            host = time.monotonic()
+            if lost:
+                total_lost += lost
+                print("%12s  %9s  %-10s  %d%s" % ("", "", "lost", lost, "+" if lost == 255 else ""))
+            for event, arg, ticks in recs:
+                t = tl.time_us(ticks, host)
+                name, a = describe(event, arg)
+                delta = "" if prev is None else "%.3f" % (t - prev)
+                print("%12.3f  %9s  %-10s  %s" % (t, delta, name, a))
+                if csv:
+                    csv.write("%.3f,%s,%s\n" % (t, name, a))
+                prev = t
+            sys.stdout.flush()
+            if len(recs) < TRACE_LEN:
+                time.sleep(0.001)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if csv:
+            csv.close()
+    if total_lost:
+        print("%d records lost, the host did not read fast enough" % total_lost, file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,93 @@
+/* Event trace of fast-usbserial, see trace.h.
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#include "fast-usbserial.h"
+
+#ifdef ENABLE_TRACE
+
+#include "trace.h"
+
+typedef struct {
+	uint8_t  Event;
+	uint8_t  Arg;
+	uint16_t Time;
+} Trace_Record_t;
+
+/** The reply of VENDOR_REQ_GetTrace goes out straight from here, there is no RAM for a copy. */
+static struct {
+	uint8_t        Lost;
+	uint8_t        Count;
+	Trace_Record_t Ring[TRACE_LEN];
+} Trace;
+
+static uint8_t TraceWrp;
+static uint8_t TraceRdp;
+static bool    TraceHeld;
+
+/** Appends a record, or counts it as lost when the ring is full. Main loop only. */
+void Trace_Write(const uint8_t Event, const uint8_t Arg)
+{
+	if ((uint8_t)(TraceWrp - TraceRdp) == TRACE_LEN) {
+		if (Trace.Lost != 0xFF) Trace.Lost++;
+		return;
+	}
+	Trace_Record_t* r = &Trace.Ring[TraceWrp & (TRACE_LEN-1)];
+	r->Event = Event;
+	r->Arg = Arg;
+	r->Time = Ticks_Now();
+	TraceWrp++;
+}
+
+void Trace_Out(const uint8_t Bytes)
+{
+	TraceHeld = false;
+	Trace_Write(TRACE_EV_OUT, Bytes);
+}
+
+/** Called on every pass an OUT packet is held back, records only the first. */
+void Trace_OutHeld(const uint8_t Bytes)
+{
+	if (TraceHeld) return;
+	TraceHeld = true;
+	Trace_Write(TRACE_EV_OUT_HELD, Bytes);
+}
+
+/** Records the control request just handled, except the ones that drain the trace. */
+void Trace_Setup(void)
+{
+	if ((USB_ControlRequest.bRequest == VENDOR_REQ_GetTrace) &&
+	    ((USB_ControlRequest.bmRequestType & CONTROL_REQTYPE_TYPE) == REQTYPE_VENDOR))
+	  return;
+	Trace_Write(TRACE_EV_SETUP, USB_ControlRequest.bRequest);
+}
+
+/** Handles VENDOR_REQ_GetTrace. */
+void Trace_ProcessControlRequest(void)
+{
+	if ((USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE)) ||
+	    (USB_ControlRequest.wLength < TRACE_HDR_LEN))
+	  return;
+
+	/* Rotate the oldest record to the front, after the header. */
+	uint8_t k = TraceRdp & (TRACE_LEN-1);
+	TraceRdp -= k;
+	TraceWrp -= k;
+	while (k--) {
+		Trace_Record_t r = Trace.Ring[0];
+		memmove(&Trace.Ring[0], &Trace.Ring[1], sizeof(Trace.Ring) - sizeof(r));
+		Trace.Ring[TRACE_LEN-1] = r;
+	}
+
+	uint8_t n = TraceWrp - TraceRdp;
+	uint16_t room = (USB_ControlRequest.wLength - TRACE_HDR_LEN) / TRACE_RECORD_LEN;
+	if (n > room) n = room;
+	Trace.Count = n;
+
+	Endpoint_ClearSETUP();
+	Endpoint_Write_Control_Stream_LE(&Trace, TRACE_HDR_LEN + (n * TRACE_RECORD_LEN));
+	Endpoint_ClearOUT();
+	TraceRdp += n;
+	Trace.Lost = 0;
+}
+
+#endif
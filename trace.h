@@ -0,0 +1,48 @@
+/* Event trace of fast-usbserial (ENABLE_TRACE), in place of the bit-banged
+ * debug output on PB4 that needed a logic analyzer and, with interrupts off
+ * for every byte, changed the timing it was meant to show.
+ *
+ * The main loop writes fixed size records into a small RAM ring, a few
+ * dozen cycles each with interrupts left on, and the host drains it with
+ * VENDOR_REQ_GetTrace (tools/trace.py turns that into a timeline). When the
+ * host does not keep up, new records are dropped and counted, the ones in
+ * the ring stay in order.
+ *
+ * A record is 4 bytes: TRACE_EV_*, an argument and Ticks_Now() (16us ticks,
+ * 16 bits little endian). VENDOR_REQ_GetTrace returns the records dropped
+ * since the last read (saturating at 255), the number of records n that
+ * follow and n records, oldest first, as many as wLength has room for.
+ *
+ * Under the LUFA License, see fast-usbserial.c. */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		/** Records in the ring, a power of two. */
+		#define TRACE_LEN                8
+
+		#define TRACE_HDR_LEN            2
+		#define TRACE_RECORD_LEN         4
+
+		/* Events, the argument in brackets. */
+		#define TRACE_EV_START           0x01 /**< UART loop entered, configured (0). */
+		#define TRACE_EV_STOP            0x02 /**< UART loop left (USB_DeviceState). */
+		#define TRACE_EV_OUT             0x03 /**< OUT packet copied to the USART ring (bytes). */
+		#define TRACE_EV_OUT_HELD        0x04 /**< OUT packet waits for room in the USART ring (bytes). */
+		#define TRACE_EV_IN              0x05 /**< IN packet committed, the ring was full enough (bytes). */
+		#define TRACE_EV_IN_FLUSH        0x06 /**< IN packet committed by the flush timer (bytes). */
+		#define TRACE_EV_SETUP           0x07 /**< Control request handled (bRequest). */
+
+	/* Function Prototypes: */
+		void Trace_Write(const uint8_t Event, const uint8_t Arg);
+		void Trace_Out(const uint8_t Bytes);
+		void Trace_OutHeld(const uint8_t Bytes);
+		void Trace_Setup(void);
+		void Trace_ProcessControlRequest(void);
+
+#endif